@@ -0,0 +1,657 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include <rte_config.h>
+#include <rte_atomic.h>
+#include <rte_errno.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+
+#include <netinet/in.h>
+
+#include "acl.h"
+
+// Time between two checks of the reload thread for a requested reload (us).
+#define ACL_RELOAD_POLL_US 100000
+// Time between two checks for the lcores still classifying with a replaced rule set (us).
+#define ACL_READER_POLL_US 10
+// Separators of the fields of a rule.
+#define ACL_FIELD_SEPARATORS " \t\r\n"
+
+// The 5-tuple of a packet as the rules are matched against it, in network byte
+// order. 'rte_acl' reads the input after the first byte in groups of 4 bytes.
+typedef struct acl_key
+{
+    uint8_t proto;
+    uint8_t pad[3];
+    uint32_t src_addr;
+    uint32_t dst_addr;
+    uint16_t src_port;
+    uint16_t dst_port;
+} acl_key;
+
+static const struct rte_acl_field_def acl_field_defs[ACL_NUM_FIELDS] = {
+    {
+        .type = RTE_ACL_FIELD_TYPE_BITMASK,
+        .size = sizeof(uint8_t),
+        .field_index = ACL_FIELD_PROTO,
+        .input_index = 0,
+        .offset = offsetof(acl_key, proto),
+    },
+    {
+        .type = RTE_ACL_FIELD_TYPE_MASK,
+        .size = sizeof(uint32_t),
+        .field_index = ACL_FIELD_SRC,
+        .input_index = 1,
+        .offset = offsetof(acl_key, src_addr),
+    },
+    {
+        .type = RTE_ACL_FIELD_TYPE_MASK,
+        .size = sizeof(uint32_t),
+        .field_index = ACL_FIELD_DST,
+        .input_index = 2,
+        .offset = offsetof(acl_key, dst_addr),
+    },
+    // Both ports share a group of 4 bytes.
+    {
+        .type = RTE_ACL_FIELD_TYPE_RANGE,
+        .size = sizeof(uint16_t),
+        .field_index = ACL_FIELD_SRC_PORT,
+        .input_index = 3,
+        .offset = offsetof(acl_key, src_port),
+    },
+    {
+        .type = RTE_ACL_FIELD_TYPE_RANGE,
+        .size = sizeof(uint16_t),
+        .field_index = ACL_FIELD_DST_PORT,
+        .input_index = 3,
+        .offset = offsetof(acl_key, dst_port),
+    },
+};
+
+typedef struct acl_rule_info
+{
+    // Line of the rule in the rule file.
+    unsigned int line;
+    char text[ACL_RULE_TEXT_LEN];
+} acl_rule_info;
+
+// A rule set as loaded from the rule file, with a classifier on every socket.
+// 'rte_acl' reports a packet that matches no rule as 0, so rule i is at i + 1
+// in 'actions', 'infos' and the rows of 'hits'.
+typedef struct acl_ruleset
+{
+    struct rte_acl_ctx *ctxs[RTE_MAX_NUMA_NODES];
+    unsigned int nb_rules;
+    uint8_t *actions;
+    acl_rule_info *infos;
+    // Hits of every rule, one row per lcore so that no counter is shared.
+    uint64_t *hits;
+    unsigned int hits_stride;
+} acl_ruleset, *acl_ruleset_ptr;
+
+// The epoch of an lcore is odd while it uses the current rule set, see 'wait_readers'.
+typedef struct acl_reader
+{
+    volatile uint64_t epoch;
+} __rte_cache_aligned acl_reader;
+
+static acl_reader readers[RTE_MAX_LCORE];
+// The rule set the lcores classify with, replaced as a whole by a reload.
+static acl_ruleset_ptr volatile current = NULL;
+// Leaves room for the generation and the socket in the names of the classifiers.
+static char ctx_prefix[RTE_ACL_NAMESIZE - 16];
+static char rule_path[PATH_MAX];
+static unsigned int next_generation;
+static pthread_t reload_thread;
+static bool reload_thread_started = false;
+static volatile bool reload_requested;
+static volatile bool reload_stopping;
+
+/**
+ * Parses an address prefix as 'ip/cidr', 'ip' (a single host) or 'any'.
+ */
+static bool parse_prefix(char *str, uint32_t *addr, uint32_t *depth)
+{
+    char *slash = strchr(str, '/'), *end;
+    long cidr = IPV4_MAX_CIDR_VAL;
+    if (strcmp(str, "any") == 0)
+    {
+        *addr = 0;
+        *depth = 0;
+        return true;
+    }
+    if (slash != NULL)
+    {
+        *slash = '\0';
+        cidr = strtol(slash + 1, &end, 10);
+        if (end == slash + 1 || *end != '\0' || cidr < IPV4_MIN_CIDR_VAL || cidr > IPV4_MAX_CIDR_VAL)
+            return false;
+    }
+    if (ipv4_addr_from_str(str, addr) == -1)
+        return false;
+    if (slash != NULL)
+        *slash = '/';
+    *depth = (uint32_t)cidr;
+    return true;
+}
+
+/**
+ * Parses a protocol as its name, its number or 'any'.
+ */
+static bool parse_proto(const char *str, uint8_t *proto, uint8_t *mask)
+{
+    static const struct
+    {
+        const char *name;
+        uint8_t proto;
+    } names[] = {{"icmp", IPPROTO_ICMP}, {"tcp", IPPROTO_TCP}, {"udp", IPPROTO_UDP}, {"sctp", IPPROTO_SCTP}};
+    unsigned int i;
+    char *end;
+    *mask = UINT8_MAX;
+    if (strcmp(str, "any") == 0)
+    {
+        *proto = 0;
+        *mask = 0;
+        return true;
+    }
+    for (i = 0; i < RTE_DIM(names); i++)
+    {
+        if (strcmp(str, names[i].name) == 0)
+        {
+            *proto = names[i].proto;
+            return true;
+        }
+    }
+    unsigned long value = strtoul(str, &end, 10);
+    if (end == str || *end != '\0' || value > UINT8_MAX)
+        return false;
+    *proto = (uint8_t)value;
+    return true;
+}
+
+/**
+ * Parses a port range as 'port', 'low-high' or 'any'.
+ */
+static bool parse_ports(const char *str, uint16_t *low, uint16_t *high)
+{
+    unsigned long first, last;
+    char *end;
+    if (strcmp(str, "any") == 0)
+    {
+        *low = 0;
+        *high = UINT16_MAX;
+        return true;
+    }
+    first = last = strtoul(str, &end, 10);
+    if (end != str && *end == '-')
+    {
+        const char *next = end + 1;
+        last = strtoul(next, &end, 10);
+        if (end == next)
+            return false;
+    }
+    if (end == str || *end != '\0' || first > last || last > UINT16_MAX)
+        return false;
+    *low = (uint16_t)first;
+    *high = (uint16_t)last;
+    return true;
+}
+
+/**
+ * Parses a rule as 'action source destination [protocol [source ports [destination ports]]]'.
+ * The missing fields match anything, ports only go with TCP, UDP or SCTP.
+ */
+static bool parse_rule(char *line, struct acl_rule *rule, uint8_t *action, acl_rule_info *info)
+{
+    char *fields[6] = {NULL, NULL, "any", "any", "any", "any"}, *save = NULL, *field;
+    unsigned int nb_fields = 0, i;
+    uint32_t src_addr, src_depth, dst_addr, dst_depth;
+    uint16_t src_low, src_high, dst_low, dst_high;
+    uint8_t proto, proto_mask;
+    int len = 0;
+
+    for (field = strtok_r(line, ACL_FIELD_SEPARATORS, &save); field != NULL; field = strtok_r(NULL, ACL_FIELD_SEPARATORS, &save))
+    {
+        if (nb_fields == RTE_DIM(fields))
+            return false;
+        fields[nb_fields++] = field;
+    }
+    if (nb_fields < 3)
+        return false;
+    // Keep the rule as it was given for printing its hits.
+    for (i = 0; i < nb_fields && len < (int)sizeof(info->text); i++)
+        len += snprintf(info->text + len, sizeof(info->text) - (size_t)len, "%s%s", i == 0 ? "" : " ", fields[i]);
+
+    if (strcmp(fields[0], "permit") == 0)
+        *action = ACL_ACTION_PERMIT;
+    else if (strcmp(fields[0], "deny") == 0)
+        *action = ACL_ACTION_DENY;
+    else
+        return false;
+    if (!parse_prefix(fields[1], &src_addr, &src_depth) ||
+        !parse_prefix(fields[2], &dst_addr, &dst_depth) ||
+        !parse_proto(fields[3], &proto, &proto_mask) ||
+        !parse_ports(fields[4], &src_low, &src_high) ||
+        !parse_ports(fields[5], &dst_low, &dst_high))
+        return false;
+    if (nb_fields > 4 && (proto_mask == 0 || (proto != IPPROTO_TCP && proto != IPPROTO_UDP && proto != IPPROTO_SCTP)))
+        return false;
+
+    // The values of the rules are in host byte order.
+    memset(rule, 0, sizeof(*rule));
+    rule->field[ACL_FIELD_PROTO].value.u8 = proto;
+    rule->field[ACL_FIELD_PROTO].mask_range.u8 = proto_mask;
+    rule->field[ACL_FIELD_SRC].value.u32 = src_addr;
+    rule->field[ACL_FIELD_SRC].mask_range.u32 = src_depth;
+    rule->field[ACL_FIELD_DST].value.u32 = dst_addr;
+    rule->field[ACL_FIELD_DST].mask_range.u32 = dst_depth;
+    rule->field[ACL_FIELD_SRC_PORT].value.u16 = src_low;
+    rule->field[ACL_FIELD_SRC_PORT].mask_range.u16 = src_high;
+    rule->field[ACL_FIELD_DST_PORT].value.u16 = dst_low;
+    rule->field[ACL_FIELD_DST_PORT].mask_range.u16 = dst_high;
+    return true;
+}
+
+/**
+ * Parses a rule like the rule file gives it, the table tests check the parser with it.
+ */
+bool acl_parse_rule(char *line, struct acl_rule *rule, uint8_t *action)
+{
+    acl_rule_info info;
+    return parse_rule(line, rule, action, &info);
+}
+
+static void free_ruleset(acl_ruleset_ptr self)
+{
+    unsigned int i;
+    if (self == NULL)
+        return;
+    for (i = 0; i < RTE_MAX_NUMA_NODES; i++)
+        rte_acl_free(self->ctxs[i]);
+    rte_free(self->hits);
+    free(self->actions);
+    free(self->infos);
+    free(self);
+}
+
+/**
+ * Builds a classifier of the rules on every socket with an lcore. A rule set
+ * without rules does not need any.
+ */
+static bool build_ruleset(acl_ruleset_ptr self, unsigned int generation, const struct acl_rule *rules)
+{
+    bool sockets[RTE_MAX_NUMA_NODES] = {false};
+    struct rte_acl_config cfg;
+    unsigned int lcore_id, socket_id;
+    int ret;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.num_categories = 1;
+    cfg.num_fields = ACL_NUM_FIELDS;
+    memcpy(cfg.defs, acl_field_defs, sizeof(acl_field_defs));
+    RTE_LCORE_FOREACH(lcore_id)
+    {
+        sockets[rte_lcore_to_socket_id(lcore_id)] = true;
+    }
+    for (socket_id = 0; socket_id < RTE_MAX_NUMA_NODES && self->nb_rules > 0; socket_id++)
+    {
+        if (!sockets[socket_id])
+            continue;
+        char name[RTE_ACL_NAMESIZE];
+        snprintf(name, sizeof(name), "%s_%u_%u", ctx_prefix, generation, socket_id);
+        struct rte_acl_param param = {
+            .name = name,
+            .socket_id = (int)socket_id,
+            .rule_size = RTE_ACL_RULE_SZ(ACL_NUM_FIELDS),
+            .max_rule_num = self->nb_rules,
+        };
+        if ((self->ctxs[socket_id] = rte_acl_create(&param)) == NULL)
+        {
+            printf("could not create the ACL classifier: %s\n", rte_strerror(rte_errno));
+            return false;
+        }
+        if ((ret = rte_acl_add_rules(self->ctxs[socket_id], (const struct rte_acl_rule *)rules, self->nb_rules)) != 0 ||
+            (ret = rte_acl_build(self->ctxs[socket_id], &cfg)) != 0)
+        {
+            printf("could not build the ACL classifier: %s\n", rte_strerror(-ret));
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Reads the rules of the rule file, one per line, and builds their classifiers.
+ * Everything after a '#' is a comment. The first rule a packet matches decides.
+ * Returns NULL if the file is invalid.
+ */
+static acl_ruleset_ptr load_ruleset(const char *path, unsigned int generation)
+{
+    char line[MAX_STR_LEN];
+    unsigned int line_nr = 0, capacity = 0;
+    struct acl_rule *rules = NULL;
+    bool valid = true;
+
+    FILE *file = fopen(path, "r");
+    acl_ruleset_ptr self = (acl_ruleset_ptr)calloc(1, sizeof(acl_ruleset));
+    if (file == NULL || self == NULL)
+    {
+        printf("could not read the ACL rule file %s.\n", path);
+        if (file != NULL)
+            fclose(file);
+        free(self);
+        return NULL;
+    }
+    while (valid && fgets(line, sizeof(line), file) != NULL)
+    {
+        line_nr++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        if (line[strspn(line, ACL_FIELD_SEPARATORS)] == '\0')
+            continue;
+        if (self->nb_rules == ACL_MAX_RULES)
+        {
+            printf("too many rules in %s (at most %d).\n", path, ACL_MAX_RULES);
+            valid = false;
+            break;
+        }
+        // Grow the arrays, with room for the packets that match no rule.
+        if (self->nb_rules == capacity)
+        {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            struct acl_rule *new_rules = (struct acl_rule *)realloc(rules, capacity * sizeof(struct acl_rule));
+            uint8_t *new_actions = (uint8_t *)realloc(self->actions, (capacity + 1) * sizeof(uint8_t));
+            acl_rule_info *new_infos = (acl_rule_info *)realloc(self->infos, (capacity + 1) * sizeof(acl_rule_info));
+            rules = new_rules != NULL ? new_rules : rules;
+            self->actions = new_actions != NULL ? new_actions : self->actions;
+            self->infos = new_infos != NULL ? new_infos : self->infos;
+            if (new_rules == NULL || new_actions == NULL || new_infos == NULL)
+            {
+                printf("could not allocate the rules of %s.\n", path);
+                valid = false;
+                break;
+            }
+        }
+        unsigned int idx = self->nb_rules + 1;
+        memset(&self->infos[idx], 0, sizeof(acl_rule_info));
+        self->infos[idx].line = line_nr;
+        if (!parse_rule(line, &rules[self->nb_rules], &self->actions[idx], &self->infos[idx]))
+        {
+            printf("invalid ACL rule at line %u of %s.\n", line_nr, path);
+            valid = false;
+            break;
+        }
+        // Earlier rules take precedence.
+        rules[self->nb_rules].data.category_mask = 1;
+        rules[self->nb_rules].data.priority = (int32_t)(ACL_MAX_RULES - self->nb_rules);
+        rules[self->nb_rules].data.userdata = idx;
+        self->nb_rules++;
+    }
+    fclose(file);
+
+    // Packets that match no rule are permitted.
+    if (valid && self->actions == NULL)
+    {
+        self->actions = (uint8_t *)malloc(sizeof(uint8_t));
+        self->infos = (acl_rule_info *)malloc(sizeof(acl_rule_info));
+    }
+    self->hits_stride = RTE_ALIGN_CEIL(self->nb_rules + 1, RTE_CACHE_LINE_SIZE / sizeof(uint64_t));
+    if (valid && self->actions != NULL && self->infos != NULL)
+    {
+        self->actions[0] = ACL_ACTION_PERMIT;
+        memset(&self->infos[0], 0, sizeof(acl_rule_info));
+        snprintf(self->infos[0].text, sizeof(self->infos[0].text), "no rule");
+        self->hits = (uint64_t *)rte_zmalloc("acl_hits", self->hits_stride * rte_lcore_count() * sizeof(uint64_t), RTE_CACHE_LINE_SIZE);
+    }
+    if (!valid || self->hits == NULL || !build_ruleset(self, generation, rules))
+    {
+        if (valid && self->hits == NULL)
+            printf("could not allocate the ACL hit counters.\n");
+        free(rules);
+        free_ruleset(self);
+        return NULL;
+    }
+    free(rules);
+    return self;
+}
+
+static inline void reader_enter(acl_reader *reader)
+{
+    reader->epoch++;
+    rte_smp_mb();
+}
+
+static inline void reader_exit(acl_reader *reader)
+{
+    rte_smp_mb();
+    reader->epoch++;
+}
+
+/**
+ * Waits until every lcore that might still use the rule set replaced before
+ * is done with it: the ones that were using a rule set (odd epoch) must have
+ * left it since.
+ */
+static void wait_readers()
+{
+    uint64_t epochs[RTE_MAX_LCORE];
+    unsigned int lcore_id;
+    RTE_LCORE_FOREACH(lcore_id)
+    {
+        epochs[lcore_id] = readers[lcore_id].epoch;
+    }
+    RTE_LCORE_FOREACH(lcore_id)
+    {
+        while ((epochs[lcore_id] & 1) && readers[lcore_id].epoch == epochs[lcore_id])
+            usleep(ACL_READER_POLL_US);
+    }
+}
+
+/**
+ * Loads the rule file again and replaces the rule set the lcores classify
+ * with, once the new one is built. The old one is freed when no lcore uses it
+ * anymore. The rule set stays as it was if the file is invalid.
+ */
+static bool reload_rules()
+{
+    acl_ruleset_ptr self = load_ruleset(rule_path, next_generation++), old = current;
+    if (self == NULL)
+        return false;
+    // The rule set must be complete before it is published.
+    rte_smp_wmb();
+    current = self;
+    rte_smp_mb();
+    if (old != NULL)
+    {
+        wait_readers();
+        free_ruleset(old);
+    }
+    printf("acl: %u rules loaded from %s.\n", self->nb_rules, rule_path);
+    return true;
+}
+
+/**
+ * Main function of the thread that reloads the rule file when asked to, off
+ * the lcores, since building a classifier can take long.
+ */
+static void *reload_thread_main(void *arg)
+{
+    while (!reload_stopping)
+    {
+        if (reload_requested)
+        {
+            reload_requested = false;
+            if (!reload_rules())
+                printf("acl: keeping the previous rules.\n");
+        }
+        usleep(ACL_RELOAD_POLL_US);
+    }
+    return NULL;
+}
+
+/**
+ * Loads the rules of the ACL from the given file and starts the thread that
+ * reloads them on request. 'name' names the DPDK objects of the ACL. Must be
+ * called once, after the EAL was initialized.
+ */
+bool acl_init(const char *name, const char *path)
+{
+    if (current != NULL)
+    {
+        printf("only one ACL rule file can be given.\n");
+        return false;
+    }
+    snprintf(ctx_prefix, sizeof(ctx_prefix), "%s", name);
+    snprintf(rule_path, sizeof(rule_path), "%s", path);
+    memset(readers, 0, sizeof(readers));
+    next_generation = 0;
+    reload_requested = false;
+    reload_stopping = false;
+    if (!reload_rules())
+        return false;
+    if (pthread_create(&reload_thread, NULL, reload_thread_main, NULL) != 0)
+    {
+        printf("could not start the thread that reloads the ACL rules.\n");
+        acl_finalize();
+        return false;
+    }
+    reload_thread_started = true;
+    return true;
+}
+
+void acl_finalize()
+{
+    if (reload_thread_started)
+    {
+        reload_stopping = true;
+        pthread_join(reload_thread, NULL);
+        reload_thread_started = false;
+    }
+    free_ruleset(current);
+    current = NULL;
+}
+
+/**
+ * Asks for the rule file to be loaded again. Safe to call from a signal handler.
+ */
+void acl_request_reload()
+{
+    reload_requested = true;
+}
+
+/**
+ * Takes the 5-tuple of an IPv4 packet. Only the first fragment carries the
+ * ports, the others (and the packets of other protocols) have ports 0.
+ */
+static inline void fill_key(acl_key *key, struct rte_mbuf *buf)
+{
+    const struct ipv4_hdr *hdr = rte_pktmbuf_mtod_offset(
+        buf, const struct ipv4_hdr *,
+        sizeof(struct ether_hdr));
+    uint16_t hdr_len = (hdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER;
+    key->proto = hdr->next_proto_id;
+    key->src_addr = hdr->src_addr;
+    key->dst_addr = hdr->dst_addr;
+    key->src_port = 0;
+    key->dst_port = 0;
+    if ((key->proto == IPPROTO_TCP || key->proto == IPPROTO_UDP || key->proto == IPPROTO_SCTP) &&
+        (hdr->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_OFFSET_MASK)) == 0 &&
+        hdr_len >= sizeof(struct ipv4_hdr) &&
+        buf->data_len >= sizeof(struct ether_hdr) + hdr_len + 2 * sizeof(uint16_t))
+    {
+        const uint16_t *ports = (const uint16_t *)((const uint8_t *)hdr + hdr_len);
+        key->src_port = ports[0];
+        key->dst_port = ports[1];
+    }
+}
+
+/**
+ * Classifies the IPv4 packets of a burst of (untagged) frames with a single
+ * lookup, and counts the hits of their rules. 'denied' tells which frames must
+ * be dropped; frames of other types are never denied. Returns the number of
+ * denied frames. Must be called by an lcore, with at most ACL_MAX_BURST frames.
+ */
+uint16_t acl_classify(struct rte_mbuf *bufs[], uint16_t nb_bufs, bool denied[])
+{
+    acl_key keys[ACL_MAX_BURST];
+    const uint8_t *data[ACL_MAX_BURST];
+    uint32_t results[ACL_MAX_BURST];
+    uint16_t idxs[ACL_MAX_BURST];
+    uint16_t i, nb_keys = 0, nb_denied = 0;
+    unsigned int lcore_id = rte_lcore_id();
+    acl_reader *reader = &readers[lcore_id];
+
+    for (i = 0; i < nb_bufs; i++)
+    {
+        denied[i] = false;
+        if (rte_pktmbuf_mtod(bufs[i], struct ether_hdr *)->ether_type != rte_cpu_to_be_16(ETHER_TYPE_IPv4))
+            continue;
+        fill_key(&keys[nb_keys], bufs[i]);
+        data[nb_keys] = (const uint8_t *)&keys[nb_keys];
+        idxs[nb_keys++] = i;
+    }
+    if (nb_keys == 0)
+        return 0;
+
+    reader_enter(reader);
+    acl_ruleset_ptr rs = current;
+    struct rte_acl_ctx *ctx = rs->ctxs[rte_socket_id()];
+    uint64_t *hits = rs->hits + (size_t)rs->hits_stride * (unsigned int)rte_lcore_index((int)lcore_id);
+    if (ctx != NULL)
+        rte_acl_classify(ctx, data, results, nb_keys, 1);
+    else
+        memset(results, 0, nb_keys * sizeof(results[0]));
+    for (i = 0; i < nb_keys; i++)
+    {
+        hits[results[i]]++;
+        if (rs->actions[results[i]] == ACL_ACTION_DENY)
+        {
+            denied[idxs[i]] = true;
+            nb_denied++;
+        }
+    }
+    reader_exit(reader);
+    return nb_denied;
+}
+
+/**
+ * Prints the packets the ACL permitted and denied, and the hits of every rule
+ * that matched any packet. The counters start over with every reload.
+ */
+void acl_print_stats()
+{
+    unsigned int lcore_id = rte_lcore_id(), nb_lcores = rte_lcore_count(), i, j;
+    uint64_t permitted = 0, denied = 0;
+    acl_reader *reader = lcore_id < RTE_MAX_LCORE ? &readers[lcore_id] : NULL;
+
+    if (reader != NULL)
+        reader_enter(reader);
+    acl_ruleset_ptr rs = current;
+    for (i = 0; rs != NULL && i <= rs->nb_rules; i++)
+    {
+        uint64_t hits = 0;
+        for (j = 0; j < nb_lcores; j++)
+            hits += rs->hits[(size_t)rs->hits_stride * j + i];
+        if (rs->actions[i] == ACL_ACTION_DENY)
+            denied += hits;
+        else
+            permitted += hits;
+        if (i > 0 && hits > 0)
+            printf("acl: rule at line %u (%s): %" PRIu64 " hits.\n", rs->infos[i].line, rs->infos[i].text, hits);
+        else if (i == 0)
+            printf("acl: %u rules, %" PRIu64 " packets matched no rule.\n", rs->nb_rules, hits);
+    }
+    if (rs != NULL)
+        printf("acl: %" PRIu64 " packets permitted, %" PRIu64 " denied.\n", permitted, denied);
+    if (reader != NULL)
+        reader_exit(reader);
+}
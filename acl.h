@@ -0,0 +1,47 @@
+#ifndef ACL_H__
+#define ACL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <rte_config.h>
+#include <rte_acl.h>
+#include <rte_mbuf.h>
+
+#include "utils/utils.h"
+
+// Maximum number of rules of a rule file.
+#define ACL_MAX_RULES 65536
+// Maximum number of frames classified at once.
+#define ACL_MAX_BURST 64
+// Characters of a rule kept for printing its hits.
+#define ACL_RULE_TEXT_LEN 96
+
+typedef enum acl_action
+{
+    ACL_ACTION_PERMIT = 0,
+    ACL_ACTION_DENY
+} acl_action;
+
+// Fields of a rule, with the values in host byte order.
+enum
+{
+    ACL_FIELD_PROTO,
+    ACL_FIELD_SRC,
+    ACL_FIELD_DST,
+    ACL_FIELD_SRC_PORT,
+    ACL_FIELD_DST_PORT,
+    ACL_NUM_FIELDS
+};
+
+RTE_ACL_RULE_DEF(acl_rule, ACL_NUM_FIELDS);
+
+bool acl_init(const char *name, const char *path);
+void acl_finalize();
+void acl_request_reload();
+uint16_t acl_classify(struct rte_mbuf *bufs[], uint16_t nb_bufs, bool denied[]);
+void acl_print_stats();
+// parse a line of the rule file (without its comment) into a rule and its action
+bool acl_parse_rule(char *line, struct acl_rule *rule, uint8_t *action);
+
+#endif
@@ -0,0 +1 @@
+../../lib/librte_acl/rte_acl_osdep.h
\ No newline at end of file
@@ -335,6 +335,7 @@
 #undef RTE_LIBRTE_LPM
 #undef RTE_LIBRTE_LPM_DEBUG
 #undef RTE_LIBRTE_ACL
+#define RTE_LIBRTE_ACL 1
 #undef RTE_LIBRTE_ACL_DEBUG
 #undef RTE_LIBRTE_POWER
 #define RTE_LIBRTE_POWER 1
@@ -347,8 +348,9 @@
 #define RTE_LIBRTE_IP_FRAG 1
 #undef RTE_LIBRTE_IP_FRAG_DEBUG
 #undef RTE_LIBRTE_IP_FRAG_MAX_FRAG
-#define RTE_LIBRTE_IP_FRAG_MAX_FRAG 4
+#define RTE_LIBRTE_IP_FRAG_MAX_FRAG 8
 #undef RTE_LIBRTE_IP_FRAG_TBL_STAT
+#define RTE_LIBRTE_IP_FRAG_TBL_STAT 1
 #undef RTE_LIBRTE_GRO
 #define RTE_LIBRTE_GRO 1
 #undef RTE_LIBRTE_METER
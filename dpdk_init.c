@@ -5,6 +5,8 @@
 #include "dpdk_init.h"
 
 #include <stdlib.h>
+#include <errno.h>
+#include <string.h>
 
 #include <rte_config.h>
 #include <rte_common.h>
@@ -12,6 +14,10 @@
 #include <rte_errno.h>
 #include <rte_mempool.h>
 #include <rte_mbuf.h>
+#include <rte_cycles.h>
+#include <rte_pause.h>
+#include <rte_vdev.h>
+#include <rte_eventdev.h>
 
 static void check_dpdk_error(uint32_t rc, const char *operation)
 {
@@ -22,55 +28,568 @@ static void check_dpdk_error(uint32_t rc, const char *operation)
 	}
 }
 
-static const uint32_t RX_DESCS = 256;
-static const uint32_t TX_DESCS = 256;
+// Descriptors of the rx and tx queues of ports without 'set_device_descs'.
+static const uint16_t RX_DESCS = 256;
+static const uint16_t TX_DESCS = 256;
 static const uint32_t MEMPOOL_CACHE_SIZE = 256;
-static const uint32_t MEMPOOL_SIZE = 2047;
-static const uint32_t MBUF_SIZE = 1600;
+// Size of a mempool nobody reserved mbufs for with 'reserve_mbufs'.
+static const uint32_t MEMPOOL_SIZE = 8191;
+// Share of a mempool in use above which 'print_mempool_stats' warns.
+static const uint32_t MEMPOOL_PRESSURE_PERCENT = 90;
+// Data room of the mbufs without 'set_mbuf_size', frames that do not fit are received scattered.
+static const uint16_t MBUF_SIZE = 1600;
+// Time a device gets to send the frames posted to its tx queues before it is stopped (us).
+static const uint32_t TX_DRAIN_TIMEOUT_US = 10000;
 
-static struct rte_mempool *create_mempool()
+// Hash fields used for RSS, restricted to what the PMD supports in 'configure_device'.
+static const uint64_t RSS_HASH_FIELDS = ETH_RSS_IP | ETH_RSS_TCP | ETH_RSS_UDP;
+// Largest RSS hash key of the supported NICs (i40e), most PMDs use only the first 40 bytes.
+#define RSS_MAX_KEY_LEN 52
+
+/**
+ * Symmetric RSS key: with a repeated 16-bit pattern, the Toeplitz hash does not change when the
+ * source and destination addresses (and ports) are swapped, so both directions of a flow land
+ * in the same queue (see "Scalable TCP Session Monitoring with Symmetric Receive-side Scaling").
+ */
+static uint8_t rss_sym_key[RSS_MAX_KEY_LEN] = {
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d,
+	0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d,
+	0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a};
+
+// Name of the software event device created by 'configure_event_device'.
+static const char EVENT_DEV_NAME[] = "event_sw0";
+// Number of flows the atomic event queue tracks at once.
+static const uint32_t EVENT_QUEUE_FLOWS = 1024;
+
+// Descriptor ring sizes and tx thresholds requested for every port.
+static device_descs port_descs[RTE_MAX_ETHPORTS];
+// MTU of every port, 0 for ETHER_MTU.
+static uint16_t port_mtus[RTE_MAX_ETHPORTS];
+// Does every port carry VLAN sub-interfaces ('set_device_vlans')?
+static bool port_vlans[RTE_MAX_ETHPORTS];
+// Data room of the mbufs (without the headroom).
+static uint16_t mbuf_size = MBUF_SIZE;
+
+// The mbuf pool of every socket, and the number of mbufs reserved for it.
+static struct rte_mempool *socket_pools[RTE_MAX_NUMA_NODES];
+static uint32_t socket_mbufs[RTE_MAX_NUMA_NODES];
+// The pool of indirect mbufs (without data room) of every socket, which
+// reference the payload of the packets the router fragments.
+static struct rte_mempool *socket_indirect_pools[RTE_MAX_NUMA_NODES];
+
+// Should the devices be configured with RX queue interrupts?
+static bool rx_intr_enabled = false;
+
+void set_rx_interrupts(bool enable)
+{
+	rx_intr_enabled = enable;
+}
+
+/**
+ * Create the mbuf pool shared by all queues and lcores of a socket, or with
+ * 'indirect' the one of its indirect mbufs.
+ */
+static struct rte_mempool *create_mempool(int socket_id, uint32_t num_mbufs, bool indirect)
 {
-	static volatile int pool_id = 0;
 	char pool_name[32];
-	sprintf(pool_name, "pool%d", __sync_fetch_and_add(&pool_id, 1));
-	struct rte_mempool *pool = rte_pktmbuf_pool_create(pool_name, MEMPOOL_SIZE, MEMPOOL_CACHE_SIZE,
-													   0, MBUF_SIZE + RTE_PKTMBUF_HEADROOM,
-													   rte_socket_id());
+	snprintf(pool_name, sizeof(pool_name), indirect ? "ipool_s%d" : "pool_s%d", socket_id);
+	// Mempools are the most memory efficient with 2^n - 1 elements.
+	struct rte_mempool *pool = rte_pktmbuf_pool_create(pool_name, rte_align32pow2(num_mbufs + 1) - 1, MEMPOOL_CACHE_SIZE,
+													   0, indirect ? 0 : mbuf_size + RTE_PKTMBUF_HEADROOM,
+													   socket_id);
 	if (!pool)
 	{
-		printf("could not allocate mempool\n");
+		printf("could not allocate mempool of %u mbufs on socket %d: %s\n", num_mbufs, socket_id, rte_strerror(rte_errno));
 		exit(1);
 	}
+	printf("%s on socket %d: %u mbufs\n", indirect ? "indirect mempool" : "mempool", socket_id, pool->size);
 	return pool;
 }
 
+/**
+ * Returns the socket to place a queue on: the one of its polling lcore if
+ * known, otherwise the one of the port.
+ */
+static int queue_socket(uint8_t port_id, const int *socket_ids, uint16_t queue)
+{
+	if (socket_ids != NULL && socket_ids[queue] != SOCKET_ID_ANY)
+		return socket_ids[queue];
+	int socket_id = rte_eth_dev_socket_id(port_id);
+	return socket_id < 0 ? (int)rte_socket_id() : socket_id;
+}
+
+void set_device_descs(uint8_t port_id, const device_descs *descs)
+{
+	port_descs[port_id] = *descs;
+}
+
+void set_device_mtu(uint8_t port_id, uint16_t mtu)
+{
+	port_mtus[port_id] = mtu;
+}
+
+/**
+ * Get the largest frame (without CRC) a port receives and sends, as far as its
+ * MTU is concerned.
+ */
+uint32_t get_device_max_frame_len(uint8_t port_id)
+{
+	return (port_mtus[port_id] ? port_mtus[port_id] : ETHER_MTU) + ETHER_HDR_LEN;
+}
+
+/**
+ * Mark a port as carrying VLAN sub-interfaces, so that 'configure_device'
+ * enables the VLAN offloads it supports.
+ */
+void set_device_vlans(uint8_t port_id)
+{
+	port_vlans[port_id] = true;
+}
+
+/**
+ * Does the port insert the VLAN tag of the frames sent with PKT_TX_VLAN_PKT
+ * itself? Otherwise the tag must be pushed in software.
+ */
+bool has_vlan_insert(uint8_t port_id)
+{
+	struct rte_eth_dev_info dev_info;
+	rte_eth_dev_info_get(port_id, &dev_info);
+	return port_vlans[port_id] && (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_VLAN_INSERT);
+}
+
+/**
+ * Might the port have to send chained mbufs? It does if any port receives
+ * frames scattered over several mbufs, or if a port with a larger MTU feeds
+ * it packets to fragment.
+ */
+static bool needs_multi_segs(uint8_t port_id)
+{
+	uint32_t max_frame_len = 0;
+	for (uint8_t port = 0; port < RTE_MAX_ETHPORTS; ++port)
+		max_frame_len = RTE_MAX(max_frame_len, get_device_max_frame_len(port));
+	return max_frame_len + ETHER_CRC_LEN > mbuf_size || max_frame_len > get_device_max_frame_len(port_id);
+}
+
+/**
+ * Set the data room of the mbufs of all pools. Must be called before the
+ * pools are created.
+ */
+void set_mbuf_size(uint16_t size)
+{
+	mbuf_size = size;
+}
+
+/**
+ * Get the number of rx and tx descriptors per queue of a port: the requested
+ * (or default) ones, clamped to the limits of its PMD and rounded to its alignment.
+ */
+static void get_device_descs(uint8_t port_id, uint16_t *num_rx_descs, uint16_t *num_tx_descs)
+{
+	*num_rx_descs = port_descs[port_id].rx_descs ? port_descs[port_id].rx_descs : RX_DESCS;
+	*num_tx_descs = port_descs[port_id].tx_descs ? port_descs[port_id].tx_descs : TX_DESCS;
+	rte_eth_dev_adjust_nb_rx_tx_desc(port_id, num_rx_descs, num_tx_descs);
+}
+
+/**
+ * Reserve mbufs for the descriptors of the given queues of a port in the
+ * pools of their sockets (see 'configure_device').
+ */
+void reserve_mbufs(uint8_t port_id, const int *rx_socket_ids, uint16_t num_rx_queues,
+				   const int *tx_socket_ids, uint16_t num_tx_queues)
+{
+	uint16_t num_rx_descs, num_tx_descs;
+	get_device_descs(port_id, &num_rx_descs, &num_tx_descs);
+	for (uint16_t queue = 0; queue < num_rx_queues; ++queue)
+		socket_mbufs[queue_socket(port_id, rx_socket_ids, queue)] += num_rx_descs;
+	for (uint16_t queue = 0; queue < num_tx_queues; ++queue)
+		socket_mbufs[queue_socket(port_id, tx_socket_ids, queue)] += num_tx_descs;
+}
+
+/**
+ * Reserve mbufs for the mempool cache of an lcore and for the 'num_mbufs' it
+ * holds in software (bursts, rings) in the pool of its socket.
+ */
+void reserve_lcore_mbufs(unsigned int lcore_id, uint32_t num_mbufs)
+{
+	// A cache holds up to 1.5 times its size before it flushes.
+	socket_mbufs[rte_lcore_to_socket_id(lcore_id)] += num_mbufs + MEMPOOL_CACHE_SIZE * 3 / 2;
+}
+
+/**
+ * Create the pools of all sockets mbufs were reserved on, with 'num_mbufs'
+ * mbufs each instead if not 0. Every socket gets a pool of as many indirect
+ * mbufs, since each fragment of a packet holds one until it is sent.
+ */
+void create_mempools(uint32_t num_mbufs)
+{
+	for (int socket_id = 0; socket_id < RTE_MAX_NUMA_NODES; ++socket_id)
+	{
+		if (socket_mbufs[socket_id] == 0)
+			continue;
+		if (socket_pools[socket_id] == NULL)
+			socket_pools[socket_id] = create_mempool(socket_id, num_mbufs > 0 ? num_mbufs : socket_mbufs[socket_id], false);
+		if (socket_indirect_pools[socket_id] == NULL)
+			socket_indirect_pools[socket_id] = create_mempool(socket_id, socket_pools[socket_id]->size, true);
+	}
+}
+
+/**
+ * Returns the pool of the given socket out of 'pools', or the one of any other
+ * socket if it has none. A hot restarted instance looks up the pools of the
+ * running one.
+ */
+static struct rte_mempool *find_mempool(struct rte_mempool **pools, int socket_id, bool indirect)
+{
+	char pool_name[32];
+	if (socket_id < 0 || socket_id >= RTE_MAX_NUMA_NODES)
+		socket_id = 0;
+	for (int i = 0; i < RTE_MAX_NUMA_NODES; ++i)
+	{
+		int socket = (socket_id + i) % RTE_MAX_NUMA_NODES;
+		if (pools[socket] == NULL && rte_eal_process_type() == RTE_PROC_SECONDARY)
+		{
+			snprintf(pool_name, sizeof(pool_name), indirect ? "ipool_s%d" : "pool_s%d", socket);
+			pools[socket] = rte_mempool_lookup(pool_name);
+		}
+		if (pools[socket] != NULL)
+			return pools[socket];
+	}
+	return NULL;
+}
+
+/**
+ * Returns the pool of the given socket (or of another one) to allocate the
+ * frames the router sends itself.
+ */
+struct rte_mempool *get_mempool(int socket_id)
+{
+	return find_mempool(socket_pools, socket_id, false);
+}
+
+/**
+ * Returns the pool of indirect mbufs of the given socket (or of another one).
+ */
+struct rte_mempool *get_indirect_mempool(int socket_id)
+{
+	return find_mempool(socket_indirect_pools, socket_id, true);
+}
+
+/**
+ * Print how many mbufs of every pool are in use, to see the pressure on the
+ * pools before frames are dropped for the lack of mbufs.
+ */
+void print_mempool_stats()
+{
+	for (int socket_id = 0; socket_id < RTE_MAX_NUMA_NODES; ++socket_id)
+	{
+		struct rte_mempool *pool = socket_pools[socket_id];
+		if (pool == NULL)
+			continue;
+		unsigned int in_use = rte_mempool_in_use_count(pool);
+		unsigned int percent = in_use * 100 / pool->size;
+		printf("mempool on socket %d: %u of %u mbufs in use (%u%%)%s\n", socket_id, in_use, pool->size, percent,
+			   percent >= MEMPOOL_PRESSURE_PERCENT ? ", nearly exhausted" : "");
+	}
+}
+
 /**
  * Initialize a device by configuring hardware queues.
  *
  * Number of allocated queues for device with port_id:
- * - 1 RX queue
- * - num_queues rx/tx queues
+ * - num_rx_queues RX queues
+ * - num_tx_queues TX queues
+ *
+ * The descriptors of every queue (and the mbufs of the RX queues) are placed on
+ * the socket given in rx_socket_ids/tx_socket_ids, i.e. the one of the lcore
+ * using the queue. The RX queues take their mbufs from the pool of their socket,
+ * which is created with MEMPOOL_SIZE mbufs if 'create_mempools' did not.
+ * The descriptor ring sizes and tx thresholds are the ones of 'set_device_descs'.
+ * With an MTU above ETHER_MTU ('set_device_mtu') the device receives jumbo frames,
+ * scattered over several mbufs if they do not fit into one. The TX queues take
+ * chained mbufs if the frames of any port are scattered or a port with a larger
+ * MTU might hand them packets to fragment. A port with VLAN sub-interfaces
+ * ('set_device_vlans') strips and inserts the tags, as far as it can.
  */
-void configure_device(uint8_t port_id, uint16_t num_queues)
+void configure_device(uint8_t port_id, uint16_t num_rx_queues, uint16_t num_tx_queues,
+					  const int *rx_socket_ids, const int *tx_socket_ids)
 {
-	struct rte_eth_conf port_conf = {.rxmode = {.hw_strip_crc = 1}};
-	check_dpdk_error(rte_eth_dev_configure(port_id, num_queues, num_queues, &port_conf), "configure device");
 	struct rte_eth_dev_info dev_info;
 	rte_eth_dev_info_get(port_id, &dev_info);
-	for (uint16_t queue = 0; queue < num_queues; ++queue)
+	struct rte_eth_conf port_conf = {.rxmode = {.hw_strip_crc = 1}};
+	port_conf.intr_conf.rxq = rx_intr_enabled;
+	uint16_t mtu = port_mtus[port_id] ? port_mtus[port_id] : ETHER_MTU;
+	if ((uint32_t)mtu + ETHER_HDR_LEN + ETHER_CRC_LEN > dev_info.max_rx_pktlen)
+	{
+		mtu = (uint16_t)(dev_info.max_rx_pktlen - ETHER_HDR_LEN - ETHER_CRC_LEN);
+		printf("port %u supports an mtu of at most %u\n", port_id, mtu);
+	}
+	port_mtus[port_id] = mtu;
+	if (mtu > ETHER_MTU)
+	{
+		port_conf.rxmode.jumbo_frame = 1;
+		port_conf.rxmode.max_rx_pkt_len = (uint32_t)mtu + ETHER_HDR_LEN + ETHER_CRC_LEN;
+	}
+	// Receive the frames that do not fit into an mbuf as a chain of mbufs.
+	bool scatter = (uint32_t)mtu + ETHER_HDR_LEN + ETHER_CRC_LEN > mbuf_size;
+	port_conf.rxmode.enable_scatter = scatter;
+	// Tagged frames arrive with the tag in 'vlan_tci' instead of the frame.
+	port_conf.rxmode.hw_vlan_strip = port_vlans[port_id] && (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_VLAN_STRIP);
+	// Spread the flows over the rx queues, as far as the PMD can hash them.
+	if (num_rx_queues > 1)
+	{
+		port_conf.rx_adv_conf.rss_conf.rss_hf = RSS_HASH_FIELDS & dev_info.flow_type_rss_offloads;
+		if (port_conf.rx_adv_conf.rss_conf.rss_hf != 0)
+		{
+			port_conf.rxmode.mq_mode = ETH_MQ_RX_RSS;
+			port_conf.rx_adv_conf.rss_conf.rss_key = rss_sym_key;
+			port_conf.rx_adv_conf.rss_conf.rss_key_len = dev_info.hash_key_size ? RTE_MIN(dev_info.hash_key_size, RSS_MAX_KEY_LEN) : 40;
+		}
+		else
+		{
+			printf("port %u does not support rss, its %u rx queues will not be balanced\n", port_id, num_rx_queues);
+		}
+	}
+	int rc = rte_eth_dev_configure(port_id, num_rx_queues, num_tx_queues, &port_conf);
+	if (rc && port_conf.intr_conf.rxq)
 	{
-		check_dpdk_error(rte_eth_tx_queue_setup(port_id, queue, TX_DESCS, rte_socket_id(), &dev_info.default_txconf), "configure tx queue");
-		check_dpdk_error(rte_eth_rx_queue_setup(port_id, queue, RX_DESCS, rte_socket_id(), &dev_info.default_rxconf, create_mempool()), "configure rx queue");
+		// Not every PMD supports RX interrupts, the port can still be polled without them.
+		printf("port %u does not support rx interrupts: %s\n", port_id, rte_strerror(-rc));
+		port_conf.intr_conf.rxq = 0;
+		rc = rte_eth_dev_configure(port_id, num_rx_queues, num_tx_queues, &port_conf);
 	}
+	check_dpdk_error(rc, "configure device");
+	if (mtu != ETHER_MTU)
+	{
+		rc = rte_eth_dev_set_mtu(port_id, mtu);
+		// Without it the PMD only goes by 'max_rx_pkt_len'.
+		if (rc == -ENOTSUP)
+			printf("port %u cannot set its mtu to %u, only jumbo frames are enabled\n", port_id, mtu);
+		else
+			check_dpdk_error(rc, "set mtu");
+	}
+	uint16_t num_rx_descs, num_tx_descs;
+	get_device_descs(port_id, &num_rx_descs, &num_tx_descs);
+	if ((port_descs[port_id].rx_descs && num_rx_descs != port_descs[port_id].rx_descs) ||
+		(port_descs[port_id].tx_descs && num_tx_descs != port_descs[port_id].tx_descs))
+		printf("port %u uses %u rx and %u tx descriptors per queue, the limits of its pmd\n", port_id, num_rx_descs, num_tx_descs);
+	port_descs[port_id].rx_descs = num_rx_descs;
+	port_descs[port_id].tx_descs = num_tx_descs;
+	struct rte_eth_txconf txconf = dev_info.default_txconf;
+	if (port_descs[port_id].tx_free_thresh)
+		txconf.tx_free_thresh = port_descs[port_id].tx_free_thresh;
+	if (port_descs[port_id].tx_rs_thresh)
+		txconf.tx_rs_thresh = port_descs[port_id].tx_rs_thresh;
+	// Scattered frames are sent as they were received, and fragments are chained.
+	if (needs_multi_segs(port_id))
+		txconf.txq_flags &= ~ETH_TXQ_FLAGS_NOMULTSEGS;
+	if (has_vlan_insert(port_id))
+		txconf.txq_flags &= ~ETH_TXQ_FLAGS_NOVLANOFFL;
+	int port_socket_id = rte_eth_dev_socket_id(port_id);
+	bool remote = false;
+	for (uint16_t queue = 0; queue < num_tx_queues; ++queue)
+	{
+		int socket_id = queue_socket(port_id, tx_socket_ids, queue);
+		remote |= port_socket_id >= 0 && socket_id != port_socket_id;
+		check_dpdk_error(rte_eth_tx_queue_setup(port_id, queue, num_tx_descs, socket_id, &txconf), "configure tx queue");
+	}
+	for (uint16_t queue = 0; queue < num_rx_queues; ++queue)
+	{
+		int socket_id = queue_socket(port_id, rx_socket_ids, queue);
+		remote |= port_socket_id >= 0 && socket_id != port_socket_id;
+		if (socket_pools[socket_id] == NULL)
+			socket_pools[socket_id] = create_mempool(socket_id, MEMPOOL_SIZE, false);
+		check_dpdk_error(rte_eth_rx_queue_setup(port_id, queue, num_rx_descs, socket_id, &dev_info.default_rxconf, socket_pools[socket_id]), "configure rx queue");
+	}
+	if (remote)
+		printf("port %u on socket %d is polled from another socket, its frames cross the socket interconnect\n", port_id, port_socket_id);
 	check_dpdk_error(rte_eth_dev_start(port_id), "starting device");
 }
 
+/**
+ * Check that a device, configured by another process, has the given number
+ * of queues and is running.
+ */
+bool is_device_configured(uint8_t port_id, uint16_t num_rx_queues, uint16_t num_tx_queues)
+{
+	struct rte_eth_dev_info dev_info;
+	rte_eth_dev_info_get(port_id, &dev_info);
+	return rte_eth_devices[port_id].data->dev_started && dev_info.nb_rx_queues == num_rx_queues && dev_info.nb_tx_queues == num_tx_queues;
+}
+
+/**
+ * Stop and close a device once it sent the frames posted to its tx queues (or
+ * TX_DRAIN_TIMEOUT_US passed). The frames left in its rings go back to their
+ * mempools. If 'stats' is not NULL, it receives the final statistics.
+ *
+ * Returns the number of received frames that were left in the rx queues, as
+ * far as the PMD can tell.
+ */
+uint32_t close_device(uint8_t port_id, struct rte_eth_stats *stats)
+{
+	struct rte_eth_dev_info dev_info;
+	uint32_t left = 0;
+	rte_eth_dev_info_get(port_id, &dev_info);
+	for (uint16_t queue = 0; queue < dev_info.nb_rx_queues; ++queue)
+	{
+		int count = rte_eth_rx_queue_count(port_id, queue);
+		if (count > 0)
+			left += (uint32_t)count;
+	}
+	uint64_t deadline = rte_get_timer_cycles() + rte_get_timer_hz() * TX_DRAIN_TIMEOUT_US / 1000000;
+	for (uint16_t queue = 0; queue < dev_info.nb_tx_queues; ++queue)
+	{
+		// The descriptor before the tail was posted last, PMDs without descriptor status are not waited for.
+		while (rte_eth_tx_descriptor_status(port_id, queue, port_descs[port_id].tx_descs - 1) == RTE_ETH_TX_DESC_FULL &&
+			   rte_get_timer_cycles() < deadline)
+			rte_pause();
+	}
+	rte_eth_dev_stop(port_id);
+	if (stats != NULL)
+		rte_eth_stats_get(port_id, stats);
+	rte_eth_dev_close(port_id);
+	return left;
+}
+
+/**
+ * Rebalance the RSS redirection table of a device given the load of each of its
+ * rx queues (e.g. frames received since the last call). Half of the load
+ * difference between the busiest and the idlest queue is moved by redirecting
+ * a proportional share of the busiest queue's table entries to the idlest one.
+ *
+ * Returns the number of moved entries, or a negative errno value.
+ */
+int rebalance_rss_reta(uint8_t port_id, const uint64_t *queue_load, uint16_t num_rx_queues)
+{
+	struct rte_eth_dev_info dev_info;
+	rte_eth_dev_info_get(port_id, &dev_info);
+	uint16_t reta_size = dev_info.reta_size;
+	if (num_rx_queues < 2 || reta_size == 0 || reta_size > ETH_RSS_RETA_SIZE_512)
+		return -ENOTSUP;
+
+	// Find the busiest and the idlest queue.
+	uint16_t hot = 0, cold = 0;
+	for (uint16_t queue = 1; queue < num_rx_queues; ++queue)
+	{
+		if (queue_load[queue] > queue_load[hot])
+			hot = queue;
+		if (queue_load[queue] < queue_load[cold])
+			cold = queue;
+	}
+	if (queue_load[hot] == queue_load[cold])
+		return 0;
+
+	struct rte_eth_rss_reta_entry64 reta_conf[ETH_RSS_RETA_SIZE_512 / RTE_RETA_GROUP_SIZE];
+	uint16_t nb_groups = (reta_size + RTE_RETA_GROUP_SIZE - 1) / RTE_RETA_GROUP_SIZE;
+	memset(reta_conf, 0, sizeof(reta_conf));
+	for (uint16_t group = 0; group < nb_groups; ++group)
+		reta_conf[group].mask = ~0ULL;
+	int rc = rte_eth_dev_rss_reta_query(port_id, reta_conf, reta_size);
+	if (rc)
+		return rc;
+
+	// Count the entries of the busiest queue and move a share proportional to the imbalance.
+	uint32_t hot_entries = 0, to_move, moved = 0;
+	for (uint16_t i = 0; i < reta_size; ++i)
+		if (reta_conf[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE] == hot)
+			hot_entries++;
+	// Always leave at least one entry to the busiest queue.
+	if (hot_entries <= 1)
+		return 0;
+	to_move = (uint32_t)((hot_entries * (queue_load[hot] - queue_load[cold])) / (2 * queue_load[hot]));
+	to_move = RTE_MIN(to_move, hot_entries - 1);
+	for (uint16_t i = 0; i < reta_size && moved < to_move; ++i)
+	{
+		uint16_t *entry = &reta_conf[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE];
+		if (*entry == hot)
+		{
+			*entry = cold;
+			moved++;
+		}
+	}
+	if (moved == 0)
+		return 0;
+	rc = rte_eth_dev_rss_reta_update(port_id, reta_conf, reta_size);
+	return rc ? rc : (int)moved;
+}
+
+/**
+ * Create and start a software event device (event_sw PMD) with a single atomic
+ * event queue, which keeps the events of a flow on one worker at a time.
+ *
+ * Event ports of the device:
+ * - num_producer_ports ports that only inject new events, starting from port 0
+ * - num_worker_ports ports linked to the queue, following the producer ports
+ *
+ * A producer port stops accepting new events when new_event_threshold events
+ * are in flight. Returns the id of the event device.
+ */
+uint8_t configure_event_device(uint8_t num_producer_ports, uint8_t num_worker_ports, uint16_t burst_size, int32_t new_event_threshold)
+{
+	check_dpdk_error(rte_vdev_init(EVENT_DEV_NAME, NULL), "create event device");
+	int dev_id = rte_event_dev_get_dev_id(EVENT_DEV_NAME);
+	check_dpdk_error(dev_id < 0 ? dev_id : 0, "find event device");
+	struct rte_event_dev_info dev_info;
+	check_dpdk_error(rte_event_dev_info_get(dev_id, &dev_info), "query event device");
+	uint32_t num_ports = (uint32_t)num_producer_ports + num_worker_ports;
+	if (num_ports > dev_info.max_event_ports)
+	{
+		printf("event device supports at most %u ports (%u needed)\n", dev_info.max_event_ports, num_ports);
+		exit(1);
+	}
+	burst_size = RTE_MIN(burst_size, dev_info.max_event_port_dequeue_depth);
+	burst_size = RTE_MIN(burst_size, dev_info.max_event_port_enqueue_depth);
+
+	struct rte_event_dev_config dev_conf = {
+		.dequeue_timeout_ns = dev_info.min_dequeue_timeout_ns,
+		.nb_events_limit = dev_info.max_num_events,
+		.nb_event_queues = 1,
+		.nb_event_ports = (uint8_t)num_ports,
+		.nb_event_queue_flows = RTE_MIN(EVENT_QUEUE_FLOWS, dev_info.max_event_queue_flows),
+		.nb_event_port_dequeue_depth = burst_size,
+		.nb_event_port_enqueue_depth = burst_size,
+	};
+	check_dpdk_error(rte_event_dev_configure(dev_id, &dev_conf), "configure event device");
+
+	struct rte_event_queue_conf queue_conf;
+	check_dpdk_error(rte_event_queue_default_conf_get(dev_id, 0, &queue_conf), "query event queue");
+	queue_conf.event_queue_cfg = RTE_EVENT_QUEUE_CFG_ATOMIC_ONLY;
+	queue_conf.nb_atomic_flows = dev_conf.nb_event_queue_flows;
+	check_dpdk_error(rte_event_queue_setup(dev_id, 0, &queue_conf), "configure event queue");
+
+	for (uint8_t port = 0; port < num_ports; ++port)
+	{
+		struct rte_event_port_conf port_conf;
+		check_dpdk_error(rte_event_port_default_conf_get(dev_id, port, &port_conf), "query event port");
+		port_conf.new_event_threshold = RTE_MIN(new_event_threshold, dev_conf.nb_events_limit);
+		port_conf.dequeue_depth = burst_size;
+		port_conf.enqueue_depth = burst_size;
+		check_dpdk_error(rte_event_port_setup(dev_id, port, &port_conf), "configure event port");
+		// Link the worker ports to all queues.
+		if (port >= num_producer_ports && rte_event_port_link(dev_id, port, NULL, NULL, 0) != 1)
+		{
+			printf("could not link event port %u: %s\n", port, rte_strerror(rte_errno));
+			exit(1);
+		}
+	}
+	check_dpdk_error(rte_event_dev_start(dev_id), "starting event device");
+	return (uint8_t)dev_id;
+}
+
+void close_event_device(uint8_t dev_id)
+{
+	rte_event_dev_stop(dev_id);
+	rte_event_dev_close(dev_id);
+}
+
 void init_dpdk()
 {
-	uint32_t argc = 1;
+	uint32_t argc = 2;
 	char *argv[argc];
 	//argv[0] = "-c1";
 	//argv[1] = "--lcores=(0-7)@0";
 	argv[0] = "-n1";
+	// A second instance attaches to the running one as a secondary process (hot restart).
+	argv[1] = "--proc-type=auto";
 	rte_eal_init(argc, argv);
 }
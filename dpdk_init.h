@@ -2,12 +2,42 @@
 #define DPDK_INIT_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <unistd.h>
 #include <rte_mbuf.h>
 #include <rte_ethdev.h>
 
+// Descriptor ring sizes and tx thresholds of a port, 0 for the default.
+typedef struct device_descs
+{
+	uint16_t rx_descs;
+	uint16_t tx_descs;
+	uint16_t tx_free_thresh;
+	uint16_t tx_rs_thresh;
+} device_descs;
+
 void init_dpdk();
-void configure_device(uint8_t port_id, uint16_t num_tx_queues);
+void set_rx_interrupts(bool enable);
+int rebalance_rss_reta(uint8_t port_id, const uint64_t *queue_load, uint16_t num_rx_queues);
+void set_device_descs(uint8_t port_id, const device_descs *descs);
+void set_device_mtu(uint8_t port_id, uint16_t mtu);
+uint32_t get_device_max_frame_len(uint8_t port_id);
+void set_device_vlans(uint8_t port_id);
+bool has_vlan_insert(uint8_t port_id);
+void set_mbuf_size(uint16_t size);
+void reserve_mbufs(uint8_t port_id, const int *rx_socket_ids, uint16_t num_rx_queues,
+				   const int *tx_socket_ids, uint16_t num_tx_queues);
+void reserve_lcore_mbufs(unsigned int lcore_id, uint32_t num_mbufs);
+void create_mempools(uint32_t num_mbufs);
+struct rte_mempool *get_mempool(int socket_id);
+struct rte_mempool *get_indirect_mempool(int socket_id);
+void print_mempool_stats();
+void configure_device(uint8_t port_id, uint16_t num_rx_queues, uint16_t num_tx_queues,
+					  const int *rx_socket_ids, const int *tx_socket_ids);
+bool is_device_configured(uint8_t port_id, uint16_t num_rx_queues, uint16_t num_tx_queues);
+uint32_t close_device(uint8_t port_id, struct rte_eth_stats *stats);
+uint8_t configure_event_device(uint8_t num_producer_ports, uint8_t num_worker_ports, uint16_t burst_size, int32_t new_event_threshold);
+void close_event_device(uint8_t dev_id);
 
 static inline uint16_t recv_from_device(uint8_t port_id, uint16_t num_rx_queues, struct rte_mbuf *bufs[], uint32_t num_bufs)
 {
@@ -160,14 +160,14 @@ int main(int argc, char *argv[])
 	if (src_interface == dst_interface)
 	{
 		/* open 1x RX and 1xTX for src */
-		configure_device(src_interface, 1);
+		configure_device(src_interface, 1, 1, NULL, NULL);
 		printf("same interface\n");
 	}
 	else
 	{
 		/* open 1x RX and 1xTX for src/dst */
-		configure_device(dst_interface, 1);
-		configure_device(src_interface, 1);
+		configure_device(dst_interface, 1, 1, NULL, NULL);
+		configure_device(src_interface, 1, 1, NULL, NULL);
 	}
 	printf("Forwarding between interface %i to interface %i\n", src_interface, dst_interface);
 
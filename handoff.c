@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <rte_config.h>
+#include <rte_atomic.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
+#include <rte_memzone.h>
+#include <rte_pause.h>
+
+#include "handoff.h"
+
+// Name of the memzone a hot restarted instance finds the running one by.
+#define HANDOFF_MZ_NAME "router_handoff"
+// Time a hot restarted instance waits for the running one to release the interfaces (ms).
+#define HANDOFF_TIMEOUT_MS 5000
+
+// State the running instance shares with a hot restarted one (see README, "Hot restart").
+typedef struct handoff_state
+{
+    // Set by the new instance once it is ready to poll the interfaces.
+    volatile bool takeover_requested;
+    // Set by the running instance once its threads stopped, and the time
+    // (tsc) the threads stopped polling.
+    volatile bool released;
+    volatile uint64_t stop_tsc;
+} handoff_state, *handoff_state_ptr;
+
+// State shared with a hot restarted instance, and are the interfaces being handed over to it?
+static handoff_state_ptr handoff;
+static volatile bool handing_off;
+
+void handoff_init()
+{
+    handoff = NULL;
+    handing_off = false;
+}
+
+/**
+ * self function shares the state a hot restarted instance finds this one by.
+ * Without it the router still runs, it just cannot be hot restarted.
+*/
+bool handoff_share()
+{
+    const struct rte_memzone *mz = rte_memzone_reserve(HANDOFF_MZ_NAME, sizeof(handoff_state), SOCKET_ID_ANY, 0);
+    if (mz == NULL)
+    {
+        printf("could not share the handoff state, a hot restart will not be possible: %s\n", rte_strerror(rte_errno));
+        return true;
+    }
+    handoff = (handoff_state_ptr)mz->addr;
+    memset(handoff, 0, sizeof(handoff_state));
+    return true;
+}
+
+/**
+ * self function asks the running instance to release the interfaces and waits
+ * until its threads stopped. Returns false if it does not answer in time.
+*/
+bool handoff_take_over()
+{
+    const struct rte_memzone *mz = rte_memzone_lookup(HANDOFF_MZ_NAME);
+    if (mz == NULL)
+    {
+        printf("the running instance cannot be hot restarted.\n");
+        return false;
+    }
+    handoff_state_ptr state = (handoff_state_ptr)mz->addr;
+    if (state->released)
+    {
+        printf("the running instance was already hot restarted, restart it from scratch.\n");
+        return false;
+    }
+    uint64_t deadline = rte_get_timer_cycles() + rte_get_timer_hz() * HANDOFF_TIMEOUT_MS / 1000;
+    state->takeover_requested = true;
+    while (!state->released)
+    {
+        if (rte_get_timer_cycles() > deadline)
+        {
+            printf("the running instance did not release the interfaces within %d ms.\n", HANDOFF_TIMEOUT_MS);
+            return false;
+        }
+        rte_pause();
+    }
+    printf("took over the interfaces %" PRIu64 " us after the running instance stopped polling them.\n",
+           (rte_get_tsc_cycles() - state->stop_tsc) * 1000000 / rte_get_tsc_hz());
+    return true;
+}
+
+/**
+ * self function tells whether a hot restarted instance asked for the interfaces.
+*/
+bool handoff_requested()
+{
+    return handoff != NULL && handoff->takeover_requested;
+}
+
+/**
+ * self function records the time the threads stop polling the interfaces for
+ * the new instance. Must be called before the threads are told to stop.
+*/
+void handoff_begin()
+{
+    handoff->stop_tsc = rte_get_tsc_cycles();
+    handing_off = true;
+    rte_wmb();
+}
+
+bool handoff_in_progress()
+{
+    return handing_off;
+}
+
+/**
+ * self function lets the new instance take over, once all threads stopped.
+*/
+void handoff_complete()
+{
+    handoff->released = true;
+}
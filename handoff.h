@@ -0,0 +1,14 @@
+#ifndef HANDOFF_H__
+#define HANDOFF_H__
+
+#include <stdbool.h>
+
+void handoff_init();
+bool handoff_share();
+bool handoff_take_over();
+bool handoff_requested();
+void handoff_begin();
+bool handoff_in_progress();
+void handoff_complete();
+
+#endif
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_config.h>
+#include <rte_ethdev.h>
+#include <rte_interrupts.h>
+#include <rte_power.h>
+
+#include "idle.h"
+
+// Upper bound of a single backoff step, in 'rte_pause()' spins.
+#define IDLE_MAX_PAUSE_SPINS 1024
+// Number of consecutive empty passes before a power-first lcore goes to sleep.
+#define IDLE_SLEEP_THRESHOLD 300
+// Maximum time to sleep on RX interrupts before re-checking the quit flag (ms).
+#define IDLE_EPOLL_TIMEOUT_MS 10
+// Sleep time used when the queues do not support RX interrupts (us).
+#define IDLE_FALLBACK_SLEEP_US 100
+
+static idle_policy policy = IDLE_POLICY_LATENCY;
+
+void idle_set_policy(idle_policy new_policy)
+{
+    policy = new_policy;
+}
+
+idle_policy idle_get_policy()
+{
+    return policy;
+}
+
+/**
+ * self function parses "latency" or "power" into an idle policy.
+ * Returns -1 if the string is neither of them.
+*/
+int idle_policy_from_str(const char *str, idle_policy *res)
+{
+    if (strcmp(str, "latency") == 0)
+        *res = IDLE_POLICY_LATENCY;
+    else if (strcmp(str, "power") == 0)
+        *res = IDLE_POLICY_POWER;
+    else
+        return -1;
+    return 0;
+}
+
+void idle_state_init(idle_state_ptr self, unsigned int lcore_id)
+{
+    memset(self, 0, sizeof(idle_state));
+    self->lcore_id = lcore_id;
+    self->pause_spins = 1;
+}
+
+void idle_state_add_queue(idle_state_ptr self, dpdk_interface int_id, dpdk_queue q_id)
+{
+    if (self->nb_queues >= IDLE_MAX_QUEUES)
+        return;
+    self->queues[self->nb_queues].int_id = int_id;
+    self->queues[self->nb_queues].q_id = q_id;
+    self->nb_queues++;
+}
+
+/**
+ * Must be called on the lcore that owns the state, since both the frequency
+ * scaling and the RX interrupt epoll instance are per thread.
+*/
+void idle_state_start(idle_state_ptr self)
+{
+    if (policy != IDLE_POLICY_POWER)
+        return;
+
+    // Frequency scaling is not available everywhere (e.g. inside most VMs).
+    if (rte_power_init(self->lcore_id) == 0)
+    {
+        self->freq_scaling = true;
+        rte_power_freq_max(self->lcore_id);
+        self->freq_max = true;
+    }
+    else
+    {
+        printf("lcore %u: frequency scaling is not available.\n", self->lcore_id);
+    }
+
+    // Register every queue with the per thread epoll instance.
+    self->rx_intr = self->nb_queues > 0;
+    uint16_t i;
+    for (i = 0; i < self->nb_queues; i++)
+    {
+        idle_queue *q = &self->queues[i];
+        if (rte_eth_dev_rx_intr_ctl_q(q->int_id, q->q_id, RTE_EPOLL_PER_THREAD,
+                                      RTE_INTR_EVENT_ADD, (void *)(uintptr_t)i) != 0)
+        {
+            self->rx_intr = false;
+            break;
+        }
+    }
+    if (self->nb_queues > 0 && !self->rx_intr)
+        printf("lcore %u: RX interrupts are not available, falling back to sleeping.\n", self->lcore_id);
+}
+
+void idle_state_finalize(idle_state_ptr self)
+{
+    if (self->freq_scaling)
+    {
+        rte_power_exit(self->lcore_id);
+        self->freq_scaling = false;
+    }
+}
+
+/**
+ * Arms the RX interrupts of all queues and blocks until one of them fires
+ * or the timeout expires, unless a queue already holds frames.
+*/
+static void idle_sleep(idle_state_ptr self)
+{
+    // Nobody needs the cycles while we sleep.
+    if (self->freq_scaling)
+    {
+        rte_power_freq_min(self->lcore_id);
+        self->freq_max = false;
+    }
+    if (!self->rx_intr)
+    {
+        usleep(IDLE_FALLBACK_SLEEP_US);
+        return;
+    }
+
+    uint16_t i;
+    bool pending = false;
+    for (i = 0; i < self->nb_queues; i++)
+        rte_eth_dev_rx_intr_enable(self->queues[i].int_id, self->queues[i].q_id);
+    // Frames that arrived before the interrupts were armed may not raise one.
+    for (i = 0; i < self->nb_queues && !pending; i++)
+        pending = rte_eth_rx_queue_count(self->queues[i].int_id, self->queues[i].q_id) > 0;
+    struct rte_epoll_event events[IDLE_MAX_QUEUES];
+    if (!pending)
+        rte_epoll_wait(RTE_EPOLL_PER_THREAD, events, self->nb_queues, IDLE_EPOLL_TIMEOUT_MS);
+    for (i = 0; i < self->nb_queues; i++)
+        rte_eth_dev_rx_intr_disable(self->queues[i].int_id, self->queues[i].q_id);
+}
+
+/**
+ * Must be called after every pass that did not receive any frames. Spins for
+ * an exponentially growing number of pauses and, with the power-first policy,
+ * eventually sleeps until traffic arrives.
+*/
+void idle_wait(idle_state_ptr self)
+{
+    self->zero_polls++;
+    if (policy == IDLE_POLICY_POWER && self->zero_polls >= IDLE_SLEEP_THRESHOLD)
+    {
+        idle_sleep(self);
+        return;
+    }
+
+    uint32_t i;
+    for (i = 0; i < self->pause_spins; i++)
+        rte_pause();
+    if (self->pause_spins < IDLE_MAX_PAUSE_SPINS)
+    {
+        self->pause_spins <<= 1;
+        // Step the frequency down once the load is low enough to hit the backoff ceiling.
+        if (self->pause_spins == IDLE_MAX_PAUSE_SPINS && self->freq_scaling)
+        {
+            rte_power_freq_down(self->lcore_id);
+            self->freq_max = false;
+        }
+    }
+}
+
+void idle_busy_slow(idle_state_ptr self, uint16_t rx, uint16_t burst_size)
+{
+    self->zero_polls = 0;
+    self->pause_spins = 1;
+    // Full bursts mean we are falling behind, so run at full speed.
+    if (rx == burst_size && self->freq_scaling && !self->freq_max)
+    {
+        rte_power_freq_max(self->lcore_id);
+        self->freq_max = true;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef IDLE_H__
+#define IDLE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <rte_config.h>
+#include <rte_pause.h>
+
+#include "utils/utils.h"
+
+// Maximum number of RX queues a single lcore can arm for interrupts.
+#define IDLE_MAX_QUEUES 64
+
+typedef enum idle_policy
+{
+    // Spin with an exponential 'rte_pause()' backoff, never sleep.
+    IDLE_POLICY_LATENCY,
+    // Back off, then sleep on RX interrupts and scale the lcore frequency.
+    IDLE_POLICY_POWER
+} idle_policy;
+
+typedef struct idle_queue
+{
+    dpdk_interface int_id;
+    dpdk_queue q_id;
+} idle_queue;
+
+typedef struct idle_state
+{
+    unsigned int lcore_id;
+    // Number of consecutive passes that did not receive any frames.
+    uint32_t zero_polls;
+    // Number of 'rte_pause()' spins of the next backoff step.
+    uint32_t pause_spins;
+    // Whether 'librte_power' could be initialized for this lcore.
+    bool freq_scaling;
+    // Whether the lcore is currently running at the maximum frequency.
+    bool freq_max;
+    // Whether all of the queues could be registered for RX interrupts.
+    bool rx_intr;
+    uint16_t nb_queues;
+    idle_queue queues[IDLE_MAX_QUEUES];
+} idle_state, *idle_state_ptr;
+
+void idle_set_policy(idle_policy policy);
+idle_policy idle_get_policy();
+int idle_policy_from_str(const char *str, idle_policy *policy);
+
+void idle_state_init(idle_state_ptr self, unsigned int lcore_id);
+void idle_state_add_queue(idle_state_ptr self, dpdk_interface int_id, dpdk_queue q_id);
+void idle_state_start(idle_state_ptr self);
+void idle_state_finalize(idle_state_ptr self);
+void idle_wait(idle_state_ptr self);
+void idle_busy_slow(idle_state_ptr self, uint16_t rx, uint16_t burst_size);
+
+/**
+ * Must be called after every pass that received 'rx' frames (at least 1).
+ * Resets the backoff and, on full bursts, raises the lcore frequency.
+ */
+static inline void idle_busy(idle_state_ptr self, uint16_t rx, uint16_t burst_size)
+{
+    if (self->zero_polls != 0 || (rx == burst_size && self->freq_scaling && !self->freq_max))
+        idle_busy_slow(self, rx, burst_size);
+}
+
+#endif
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <rte_config.h>
+#include <rte_atomic.h>
+#include <rte_byteorder.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+
+#include <netinet/ip.h>
+
+#include "meter.h"
+
+// Share of a bucket of a meter the forwarding threads may hold together (1 / n), see 'meter_bucket'.
+#define METER_BATCH_SHARE 2
+
+// A token bucket of a meter, shared by all threads. A thread takes its tokens
+// in batches with an atomic subtraction and spends them on its own, so that a
+// packet only touches the bucket once its thread ran out of tokens.
+typedef struct meter_bucket
+{
+    rte_atomic64_t tokens;
+    // Time (tsc) up to which the tokens were added.
+    rte_atomic64_t tsc;
+    // Rate (bytes per second) and size (bytes) of the bucket, and the tokens a thread takes at once.
+    uint64_t rate;
+    uint64_t size;
+    uint64_t batch;
+    // Time (tsc) it takes to fill the empty bucket.
+    uint64_t fill_cycles;
+} __rte_cache_aligned meter_bucket, *meter_bucket_ptr;
+
+typedef struct meter_config
+{
+    struct rte_meter_trtcm_params params;
+    meter_policy policy;
+    meter_bucket committed;
+    meter_bucket peak;
+} meter_config, *meter_config_ptr;
+
+// Meters the routes can be policed with ('--meter'), indexed by meter id.
+static meter_config meter_confs[METER_MAX_ID + 1];
+static unsigned int nb_meters;
+// Meters of every forwarding lcore, NULL for the other lcores.
+static meter_state_ptr lcore_states[RTE_MAX_LCORE];
+
+/**
+ * self function forgets all meters. Must be called before any meter is added.
+*/
+void meter_init()
+{
+    memset(meter_confs, 0, sizeof(meter_confs));
+    nb_meters = 0;
+    memset(lcore_states, 0, sizeof(lcore_states));
+}
+
+/**
+ * self function frees the meters of every lcore and forgets all meters.
+*/
+void meter_finalize()
+{
+    unsigned int lcore_id;
+    for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++)
+        rte_free(lcore_states[lcore_id]);
+    meter_init();
+}
+
+/**
+ * self function adds (or replaces) the meter with the given id, a two rate three
+ * color meter (RFC 2698) with its rates in bytes per second and its burst sizes
+ * in bytes. Returns false if the id or the rates and burst sizes are invalid.
+*/
+bool meter_add(uint8_t id, const struct rte_meter_trtcm_params *params, meter_policy policy)
+{
+    // The peak rate must not be below the committed one.
+    if (id == 0 || policy == METER_POLICY_NONE || params->cir == 0 || params->pir < params->cir ||
+        params->pir > METER_MAX_RATE || params->cbs == 0 || params->cbs > METER_MAX_BURST ||
+        params->pbs == 0 || params->pbs > METER_MAX_BURST)
+        return false;
+    meter_config_ptr meter_conf = &meter_confs[id];
+    if (meter_conf->policy == METER_POLICY_NONE)
+        nb_meters++;
+    meter_conf->params = *params;
+    meter_conf->policy = policy;
+    return true;
+}
+
+bool meter_exists(uint8_t id)
+{
+    return meter_confs[id].policy != METER_POLICY_NONE;
+}
+
+unsigned int meter_count()
+{
+    return nb_meters;
+}
+
+/**
+ * self function fills a bucket of a meter with the given rate and size. Together
+ * the forwarding threads hold at most 1 / 'METER_BATCH_SHARE' of its tokens.
+*/
+static void init_meter_bucket(meter_bucket_ptr bucket, uint64_t rate, uint64_t size, unsigned int nb_forwarding)
+{
+    bucket->rate = rate;
+    bucket->size = size;
+    bucket->batch = RTE_MAX(size / (METER_BATCH_SHARE * nb_forwarding), (uint64_t)1);
+    bucket->fill_cycles = size * rte_get_tsc_hz() / rate + 1;
+    rte_atomic64_set(&bucket->tokens, (int64_t)size);
+    rte_atomic64_set(&bucket->tsc, (int64_t)rte_rdtsc());
+}
+
+/**
+ * self function fills the buckets of every meter, which the given (forwarding)
+ * lcores share, and gives every one of them its own tokens and counters of every
+ * meter. Returns false on error.
+*/
+bool meter_create_states(const unsigned int lcore_ids[], unsigned int nb_lcores)
+{
+    unsigned int i, id;
+    for (i = 0; i < nb_lcores; i++)
+    {
+        lcore_states[lcore_ids[i]] = (meter_state_ptr)rte_zmalloc_socket("meters", (METER_MAX_ID + 1) * sizeof(meter_state), RTE_CACHE_LINE_SIZE,
+                                                                         (int)rte_lcore_to_socket_id(lcore_ids[i]));
+        if (lcore_states[lcore_ids[i]] == NULL)
+        {
+            printf("could not allocate the meters of lcore %u.\n", lcore_ids[i]);
+            return false;
+        }
+    }
+    for (id = 1; id <= METER_MAX_ID && nb_lcores > 0; id++)
+    {
+        meter_config_ptr meter_conf = &meter_confs[id];
+        if (meter_conf->policy == METER_POLICY_NONE)
+            continue;
+        init_meter_bucket(&meter_conf->committed, meter_conf->params.cir, meter_conf->params.cbs, nb_lcores);
+        init_meter_bucket(&meter_conf->peak, meter_conf->params.pir, meter_conf->params.pbs, nb_lcores);
+    }
+    printf("%u meters, shared by %u lcores.\n", nb_meters, nb_lcores);
+    return true;
+}
+
+meter_state_ptr meter_get_states(unsigned int lcore_id)
+{
+    return lcore_states[lcore_id];
+}
+
+/**
+ * self function adds the tokens of the time since the last refill to a bucket
+ * of a meter, up to its size. Only the thread that moves the time on adds them.
+*/
+static void refill_meter_bucket(meter_bucket_ptr bucket, uint64_t now)
+{
+    uint64_t last = (uint64_t)rte_atomic64_read(&bucket->tsc), hz = rte_get_tsc_hz(), next = now;
+    uint64_t elapsed = now - last, tokens = bucket->size;
+    if (elapsed < bucket->fill_cycles)
+    {
+        tokens = elapsed * bucket->rate / hz;
+        if (tokens == 0)
+            return;
+        // Keep the time of the fraction of a token for the next refill.
+        next = last + tokens * hz / bucket->rate;
+    }
+    if (!rte_atomic64_cmpset((volatile uint64_t *)&bucket->tsc.cnt, last, next))
+        return;
+    int64_t cur, val;
+    do
+    {
+        cur = rte_atomic64_read(&bucket->tokens);
+        val = RTE_MIN(cur + (int64_t)tokens, (int64_t)bucket->size);
+    } while (!rte_atomic64_cmpset((volatile uint64_t *)&bucket->tokens.cnt, (uint64_t)cur, (uint64_t)val));
+}
+
+/**
+ * self function takes at least 'needed' tokens from a bucket of a meter for the
+ * thread, a batch if the bucket has it. Returns the tokens taken, which are
+ * fewer than needed if the bucket ran out.
+*/
+static uint64_t take_meter_tokens(meter_bucket_ptr bucket, uint64_t needed)
+{
+    uint64_t wanted = RTE_MAX(needed, bucket->batch);
+    refill_meter_bucket(bucket, rte_rdtsc());
+    int64_t left = rte_atomic64_sub_return(&bucket->tokens, (int64_t)wanted);
+    if (left >= 0)
+        return wanted;
+    // Give back what the bucket did not have.
+    uint64_t missing = RTE_MIN((uint64_t)-left, wanted);
+    rte_atomic64_add(&bucket->tokens, (int64_t)missing);
+    return wanted - missing;
+}
+
+/**
+ * self function colors an ipv4 packet of a metered route with the tokens the
+ * thread took from the buckets of the meter, blind to any previous color
+ * (RFC 2698). 'states' are the meters of the thread. Returns false if the packet
+ * must be dropped: it is red and cannot be ECN marked instead.
+*/
+bool meter_police(meter_state_ptr states, uint8_t id, struct ipv4_hdr *hdr)
+{
+    meter_config_ptr meter_conf = &meter_confs[id];
+    meter_policy policy = meter_conf->policy;
+    if (policy == METER_POLICY_NONE || states == NULL)
+        return true;
+    meter_state_ptr meter = &states[id];
+    uint64_t len = rte_be_to_cpu_16(hdr->total_length);
+    enum rte_meter_color color = e_RTE_METER_RED;
+    if (unlikely(meter->peak_tokens < len))
+        meter->peak_tokens += take_meter_tokens(&meter_conf->peak, len - meter->peak_tokens);
+    if (meter->peak_tokens >= len)
+    {
+        if (unlikely(meter->committed_tokens < len))
+            meter->committed_tokens += take_meter_tokens(&meter_conf->committed, len - meter->committed_tokens);
+        color = e_RTE_METER_YELLOW;
+        meter->peak_tokens -= len;
+        if (meter->committed_tokens >= len)
+        {
+            color = e_RTE_METER_GREEN;
+            meter->committed_tokens -= len;
+        }
+    }
+    meter->colors[color]++;
+    if (color != e_RTE_METER_RED)
+        return true;
+    // The header checksum is calculated after the TTL decrement anyway.
+    if (policy == METER_POLICY_MARK && (hdr->type_of_service & IPTOS_ECN_MASK) != IPTOS_ECN_NOT_ECT)
+    {
+        hdr->type_of_service |= IPTOS_ECN_CE;
+        meter->marked++;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * self function prints the packets every meter colored, over all lcores, and
+ * how many of the red ones it marked rather than dropped.
+*/
+void meter_print_stats()
+{
+    unsigned int lcore_id, id;
+    for (id = 1; id <= METER_MAX_ID; id++)
+    {
+        uint64_t colors[e_RTE_METER_COLORS] = {0}, marked = 0;
+        if (meter_confs[id].policy == METER_POLICY_NONE)
+            continue;
+        for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++)
+        {
+            meter_state_ptr states = lcore_states[lcore_id];
+            if (states == NULL)
+                continue;
+            colors[e_RTE_METER_GREEN] += states[id].colors[e_RTE_METER_GREEN];
+            colors[e_RTE_METER_YELLOW] += states[id].colors[e_RTE_METER_YELLOW];
+            colors[e_RTE_METER_RED] += states[id].colors[e_RTE_METER_RED];
+            marked += states[id].marked;
+        }
+        printf("meter %u: %" PRIu64 " green, %" PRIu64 " yellow, %" PRIu64 " red packets (%" PRIu64 " marked, %" PRIu64 " dropped).\n",
+               id, colors[e_RTE_METER_GREEN], colors[e_RTE_METER_YELLOW], colors[e_RTE_METER_RED],
+               marked, colors[e_RTE_METER_RED] - marked);
+    }
+}
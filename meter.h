@@ -0,0 +1,50 @@
+#ifndef METER_H__
+#define METER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <rte_config.h>
+#include <rte_ip.h>
+#include <rte_meter.h>
+
+#include "utils/utils.h"
+
+// Highest id of a meter ('--meter'), 0 stands for none.
+#define METER_MAX_ID 255
+// Largest rate (bytes per second) and burst size (bytes) of a meter, the refills of its buckets must not overflow.
+#define METER_MAX_RATE (1ULL << 40)
+#define METER_MAX_BURST (1ULL << 30)
+
+// What a meter does with the packets that exceed its peak rate (red ones).
+typedef enum meter_policy
+{
+    // No such meter, its packets pass.
+    METER_POLICY_NONE = 0,
+    METER_POLICY_DROP,
+    // Mark them Congestion Experienced, the ones that are not ECN capable are dropped.
+    METER_POLICY_MARK
+} meter_policy;
+
+// The tokens a thread took from the buckets of a meter and did not spend yet,
+// and the packets it colored and marked.
+typedef struct meter_state
+{
+    uint64_t committed_tokens;
+    uint64_t peak_tokens;
+    uint64_t colors[e_RTE_METER_COLORS];
+    uint64_t marked;
+} __rte_cache_aligned meter_state, *meter_state_ptr;
+
+void meter_init();
+void meter_finalize();
+bool meter_add(uint8_t id, const struct rte_meter_trtcm_params *params, meter_policy policy);
+bool meter_exists(uint8_t id);
+unsigned int meter_count();
+bool meter_create_states(const unsigned int lcore_ids[], unsigned int nb_lcores);
+// the meters of an lcore given to 'meter_create_states', indexed by meter id
+meter_state_ptr meter_get_states(unsigned int lcore_id);
+bool meter_police(meter_state_ptr states, uint8_t id, struct ipv4_hdr *hdr);
+void meter_print_stats();
+
+#endif
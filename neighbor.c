@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+
+#include "neighbor.h"
+
+// Frames held per unresolved neighbor, the ones beyond are dropped.
+#define NEIGHBOR_HOLD_SIZE 16
+// Time a confirmed neighbor stays usable (ms).
+#define NEIGHBOR_LIFETIME_MS 30000
+// Age at which a confirmed neighbor is refreshed, well before it expires (ms).
+#define NEIGHBOR_REFRESH_MS 25000
+// Time between two requests for an unresolved (or refreshed) neighbor (ms).
+#define NEIGHBOR_RETRANS_MS 1000
+// Unanswered requests after which an unresolved neighbor failed.
+#define NEIGHBOR_MAX_REQUESTS 3
+// Time between two requests for a failed neighbor (ms).
+#define NEIGHBOR_FAILED_RETRANS_MS 5000
+
+// Maps the address of a neighbor to its entry. Keys are only added at startup,
+// so the lookups never race with a writer.
+static struct rte_hash *neighbor_hash = NULL;
+static neighbor_ptr neighbors = NULL;
+static unsigned int nb_neighbors = 0;
+// Leaves room for the index of the neighbor in the names of the rings.
+static char ring_prefix[RTE_RING_NAMESIZE - 4];
+static uint64_t lifetime_cycles, refresh_cycles, retrans_cycles, failed_retrans_cycles;
+
+/**
+ * Creates the (empty) neighbor cache. 'name' names the DPDK objects of the cache.
+ */
+bool neighbor_init(const char *name)
+{
+    struct rte_hash_parameters params = {
+        .name = name,
+        .entries = NEIGHBOR_MAX,
+        .key_len = sizeof(ipv4_addr),
+        .hash_func = rte_hash_crc,
+        .hash_func_init_val = 0,
+        .socket_id = (int)rte_socket_id(),
+    };
+    neighbor_hash = rte_hash_create(&params);
+    neighbors = (neighbor_ptr)rte_zmalloc(name, NEIGHBOR_MAX * sizeof(neighbor), RTE_CACHE_LINE_SIZE);
+    if (neighbor_hash == NULL || neighbors == NULL)
+    {
+        printf("could not create the neighbor cache: %s\n", rte_strerror(rte_errno));
+        neighbor_finalize();
+        return false;
+    }
+    snprintf(ring_prefix, sizeof(ring_prefix), "%s", name);
+    nb_neighbors = 0;
+    uint64_t hz = rte_get_timer_hz();
+    lifetime_cycles = hz * NEIGHBOR_LIFETIME_MS / 1000;
+    refresh_cycles = hz * NEIGHBOR_REFRESH_MS / 1000;
+    retrans_cycles = hz * NEIGHBOR_RETRANS_MS / 1000;
+    failed_retrans_cycles = hz * NEIGHBOR_FAILED_RETRANS_MS / 1000;
+    return true;
+}
+
+void neighbor_finalize()
+{
+    unsigned int i;
+    struct rte_mbuf *buf;
+    for (i = 0; i < nb_neighbors; i++)
+    {
+        while (rte_ring_dequeue(neighbors[i].hold, (void **)&buf) == 0)
+            rte_pktmbuf_free(buf);
+        rte_ring_free(neighbors[i].hold);
+    }
+    nb_neighbors = 0;
+    rte_free(neighbors);
+    neighbors = NULL;
+    rte_hash_free(neighbor_hash);
+    neighbor_hash = NULL;
+}
+
+/**
+ * Adds a neighbor to resolve on the given interface (and VLAN), or returns the
+ * existing one. Must be called before the forwarding starts. Returns NULL and sets
+ * rte_errno to EEXIST if the neighbor exists on another interface or VLAN, to
+ * ENOSPC if the cache is full, to ENOENT if it is not created, or to the error of
+ * its hold ring or hash.
+ */
+neighbor_ptr neighbor_add(ipv4_addr addr, dpdk_interface int_id, uint16_t vlan_id)
+{
+    neighbor_ptr self = neighbor_lookup(addr);
+    if (self != NULL)
+    {
+        if (self->int_id == int_id && self->vlan_id == vlan_id)
+            return self;
+        rte_errno = EEXIST;
+        return NULL;
+    }
+    if (neighbor_hash == NULL || nb_neighbors >= NEIGHBOR_MAX)
+    {
+        rte_errno = neighbor_hash == NULL ? ENOENT : ENOSPC;
+        return NULL;
+    }
+
+    char name[RTE_RING_NAMESIZE];
+    snprintf(name, sizeof(name), "%s_%u", ring_prefix, nb_neighbors);
+    self = &neighbors[nb_neighbors];
+    memset(self, 0, sizeof(neighbor));
+    self->addr = addr;
+    self->int_id = int_id;
+    self->vlan_id = vlan_id;
+    self->state = NEIGHBOR_INCOMPLETE;
+    rte_spinlock_init(&self->lock);
+    self->hold = rte_ring_create(name, NEIGHBOR_HOLD_SIZE, (int)rte_socket_id(), RING_F_EXACT_SZ);
+    if (self->hold == NULL)
+        return NULL;
+    int ret = rte_hash_add_key_data(neighbor_hash, &addr, self);
+    if (ret < 0)
+    {
+        rte_ring_free(self->hold);
+        rte_errno = -ret;
+        return NULL;
+    }
+    nb_neighbors++;
+    return self;
+}
+
+neighbor_ptr neighbor_lookup(ipv4_addr addr)
+{
+    void *data;
+    if (neighbor_hash == NULL || rte_hash_lookup_data(neighbor_hash, &addr, &data) < 0)
+        return NULL;
+    return (neighbor_ptr)data;
+}
+
+unsigned int neighbor_count()
+{
+    return nb_neighbors;
+}
+
+neighbor_ptr neighbor_get(unsigned int idx)
+{
+    return &neighbors[idx];
+}
+
+/**
+ * Holds a frame until the neighbor is resolved. Returns false if it cannot be
+ * held (the neighbor failed, or too many frames are waiting already), then the
+ * caller still owns the frame.
+ */
+bool neighbor_hold(neighbor_ptr self, struct rte_mbuf *buf)
+{
+    if (self->state == NEIGHBOR_FAILED)
+        return false;
+    return rte_ring_mp_enqueue(self->hold, buf) == 0;
+}
+
+/**
+ * Takes up to 'nb_bufs' of the held frames, to be sent once the neighbor is resolved
+ * (or dropped once it failed).
+ */
+unsigned int neighbor_release(neighbor_ptr self, struct rte_mbuf *bufs[], unsigned int nb_bufs)
+{
+    return rte_ring_mc_dequeue_burst(self->hold, (void **)bufs, nb_bufs, NULL);
+}
+
+/**
+ * Confirms the neighbor with the MAC address it answered with (or announced).
+ * Returns true if it was not usable before or its MAC address changed, so
+ * that the adjacencies using it must be updated.
+ */
+bool neighbor_confirm(neighbor_ptr self, const ether_addr *mac)
+{
+    rte_spinlock_lock(&self->lock);
+    bool changed = (self->state != NEIGHBOR_REACHABLE && self->state != NEIGHBOR_STALE) ||
+                   !is_same_ether_addr(&self->mac, mac);
+    ether_addr_copy(mac, &self->mac);
+    self->confirmed_tsc = rte_get_timer_cycles();
+    self->nb_requests = 0;
+    self->state = NEIGHBOR_REACHABLE;
+    rte_spinlock_unlock(&self->lock);
+    return changed;
+}
+
+/**
+ * Advances the state of the neighbor in time and tells the caller what to do
+ * about it. Must be called regularly (every few hundred ms) by a single thread.
+ */
+neighbor_action neighbor_timeout(neighbor_ptr self, uint64_t now)
+{
+    neighbor_action action = NEIGHBOR_ACTION_NONE;
+    rte_spinlock_lock(&self->lock);
+    switch (self->state)
+    {
+    case NEIGHBOR_INCOMPLETE:
+        if (self->nb_requests >= NEIGHBOR_MAX_REQUESTS && now - self->requested_tsc >= retrans_cycles)
+        {
+            self->state = NEIGHBOR_FAILED;
+            action = NEIGHBOR_ACTION_FAIL;
+        }
+        else if (self->nb_requests == 0 || now - self->requested_tsc >= retrans_cycles)
+        {
+            action = NEIGHBOR_ACTION_REQUEST;
+        }
+        break;
+    case NEIGHBOR_REACHABLE:
+        // Refresh it before it expires, it stays usable meanwhile.
+        if (now - self->confirmed_tsc >= refresh_cycles)
+        {
+            self->state = NEIGHBOR_STALE;
+            action = NEIGHBOR_ACTION_REQUEST;
+        }
+        break;
+    case NEIGHBOR_STALE:
+        if (now - self->confirmed_tsc >= lifetime_cycles)
+        {
+            self->state = NEIGHBOR_INCOMPLETE;
+            self->nb_requests = 0;
+            action = NEIGHBOR_ACTION_EXPIRE;
+        }
+        else if (now - self->requested_tsc >= retrans_cycles)
+        {
+            action = NEIGHBOR_ACTION_REQUEST;
+        }
+        break;
+    case NEIGHBOR_FAILED:
+        if (now - self->requested_tsc >= failed_retrans_cycles)
+            action = NEIGHBOR_ACTION_REQUEST;
+        break;
+    }
+    if (action == NEIGHBOR_ACTION_REQUEST)
+    {
+        self->requested_tsc = now;
+        self->nb_requests++;
+    }
+    rte_spinlock_unlock(&self->lock);
+    return action;
+}
+
+const char *neighbor_state_str(neighbor_state state)
+{
+    switch (state)
+    {
+    case NEIGHBOR_INCOMPLETE:
+        return "incomplete";
+    case NEIGHBOR_REACHABLE:
+        return "reachable";
+    case NEIGHBOR_STALE:
+        return "stale";
+    case NEIGHBOR_FAILED:
+        return "failed";
+    }
+    return "unknown";
+}
@@ -0,0 +1,73 @@
+#ifndef NEIGHBOR_H__
+#define NEIGHBOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <rte_config.h>
+#include <rte_ether.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_spinlock.h>
+
+#include "utils/utils.h"
+
+// Maximum number of neighbors (gateways of the routes) that are resolved.
+#define NEIGHBOR_MAX 256
+
+typedef enum neighbor_state
+{
+    // Not resolved yet, frames to it are held until it is.
+    NEIGHBOR_INCOMPLETE = 0,
+    // Resolved and confirmed recently.
+    NEIGHBOR_REACHABLE,
+    // Resolved, but about to expire; a refresh request is outstanding.
+    NEIGHBOR_STALE,
+    // Did not answer any request, frames to it are dropped until it does.
+    NEIGHBOR_FAILED
+} neighbor_state;
+
+// What the caller of 'neighbor_timeout' has to do for a neighbor.
+typedef enum neighbor_action
+{
+    NEIGHBOR_ACTION_NONE = 0,
+    // Send an ARP request for the neighbor.
+    NEIGHBOR_ACTION_REQUEST,
+    // The neighbor expired and must not be used until it is resolved again.
+    NEIGHBOR_ACTION_EXPIRE,
+    // The neighbor did not answer, drop the frames held for it.
+    NEIGHBOR_ACTION_FAIL
+} neighbor_action;
+
+typedef struct neighbor
+{
+    ipv4_addr addr;
+    dpdk_interface int_id;
+    // VLAN sub-interface of 'int_id' it is reached over, 0 for untagged.
+    uint16_t vlan_id;
+    volatile neighbor_state state;
+    ether_addr mac;
+    // Time (tsc) of the last confirmation and the last request.
+    uint64_t confirmed_tsc;
+    uint64_t requested_tsc;
+    // Requests sent since the last confirmation.
+    uint32_t nb_requests;
+    // Frames waiting for the neighbor to be resolved.
+    struct rte_ring *hold;
+    // Serializes the state changes, the forwarding path never takes it.
+    rte_spinlock_t lock;
+} neighbor, *neighbor_ptr;
+
+bool neighbor_init(const char *name);
+void neighbor_finalize();
+neighbor_ptr neighbor_add(ipv4_addr addr, dpdk_interface int_id, uint16_t vlan_id);
+neighbor_ptr neighbor_lookup(ipv4_addr addr);
+unsigned int neighbor_count();
+neighbor_ptr neighbor_get(unsigned int idx);
+bool neighbor_hold(neighbor_ptr self, struct rte_mbuf *buf);
+unsigned int neighbor_release(neighbor_ptr self, struct rte_mbuf *bufs[], unsigned int nb_bufs);
+bool neighbor_confirm(neighbor_ptr self, const ether_addr *mac);
+neighbor_action neighbor_timeout(neighbor_ptr self, uint64_t now);
+const char *neighbor_state_str(neighbor_state state);
+
+#endif
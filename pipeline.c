@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <rte_config.h>
+#include <rte_common.h>
+#include <rte_errno.h>
+#include <rte_eventdev.h>
+#include <rte_lcore.h>
+
+#include "pipeline.h"
+#include "dpdk_init.h"
+#include "qos.h"
+#include "steal.h"
+
+// Default number of slots of the rings between the stages of the pipeline ('--ring-size').
+#define DEFAULT_RING_SIZE 1024
+
+// Rx threads and workers of the pipeline, which drop frames on full rings.
+static pipeline_state_ptr rx_states[RTE_MAX_LCORE];
+static pipeline_state_ptr worker_states[RTE_MAX_LCORE];
+static unsigned int nb_rx_states;
+static unsigned int nb_worker_states;
+static unsigned int ring_size;
+// Are the frames of the rx threads scheduled to the workers by an event device ('--eventdev')?
+static bool eventdev_mode;
+static bool event_dev_started;
+static uint8_t event_dev_id;
+// Number of rx threads and workers that are still running.
+static volatile unsigned int nb_running_rx_threads;
+static volatile unsigned int nb_running_workers;
+
+/**
+ * self function forgets the pipeline. Must be called before the ring size is set.
+*/
+void pipeline_init()
+{
+    memset(rx_states, 0, sizeof(rx_states));
+    memset(worker_states, 0, sizeof(worker_states));
+    nb_rx_states = 0;
+    nb_worker_states = 0;
+    ring_size = DEFAULT_RING_SIZE;
+    eventdev_mode = false;
+    event_dev_started = false;
+    nb_running_rx_threads = 0;
+    nb_running_workers = 0;
+}
+
+/**
+ * self function closes the event device. The rings are freed with the states
+ * of their threads.
+*/
+void pipeline_finalize()
+{
+    if (event_dev_started)
+        close_event_device(event_dev_id);
+    pipeline_init();
+}
+
+/**
+ * self function sets the number of slots of the rings, which must be a power
+ * of 2 that can hold a few bursts. Returns false if the size is invalid.
+*/
+bool pipeline_set_ring_size(uint32_t size)
+{
+    if (size < 2 * PIPELINE_MAX_BURST || size > RTE_RING_SZ_MASK || !rte_is_power_of_2(size))
+        return false;
+    ring_size = size;
+    return true;
+}
+
+unsigned int pipeline_get_ring_size()
+{
+    return ring_size;
+}
+
+/**
+ * self function creates the ring 'name' from the thread of 'from' to the thread
+ * of 'to', on the socket of the latter. Returns false on error.
+*/
+bool pipeline_connect(pipeline_state_ptr from, pipeline_state_ptr to, const char *name)
+{
+    struct rte_ring *ring = rte_ring_create(name, ring_size, rte_lcore_to_socket_id(to->lcore_id),
+                                            RING_F_SP_ENQ | RING_F_SC_DEQ);
+    if (ring == NULL)
+    {
+        printf("could not create the pipeline ring %s: %s\n", name, rte_strerror(rte_errno));
+        return false;
+    }
+    pointer_list_append(&from->out_rings, (generic_ptr)ring);
+    pointer_list_append(&to->in_rings, (generic_ptr)ring);
+    return true;
+}
+
+/**
+ * self function connects every rx thread to every worker over the software
+ * event device instead of rings. Returns false if there are too many threads.
+*/
+bool pipeline_create_event_device(pipeline_state_ptr rx[], unsigned int nb_rx,
+                                  pipeline_state_ptr workers[], unsigned int nb_workers)
+{
+    unsigned int i;
+    uint8_t ev_port = 0;
+    if (nb_rx + nb_workers > UINT8_MAX)
+    {
+        printf("--eventdev supports at most %u rx and worker lcores.\n", UINT8_MAX);
+        return false;
+    }
+    for (i = 0; i < nb_rx; i++)
+    {
+        rx[i]->ev_port = ev_port++;
+        // The first rx thread runs the scheduler.
+        rx[i]->schedules_events = rx[i]->ev_port == 0;
+    }
+    for (i = 0; i < nb_workers; i++)
+        workers[i]->ev_port = ev_port++;
+    event_dev_id = configure_event_device((uint8_t)nb_rx, (uint8_t)nb_workers, PIPELINE_MAX_BURST, (int32_t)ring_size);
+    event_dev_started = true;
+    eventdev_mode = true;
+    return true;
+}
+
+/**
+ * self function marks the rx threads and workers of the connected pipeline as
+ * running. Must be called before the threads are launched.
+*/
+void pipeline_start(pipeline_state_ptr rx[], unsigned int nb_rx,
+                    pipeline_state_ptr workers[], unsigned int nb_workers, unsigned int nb_tx)
+{
+    memcpy(rx_states, rx, nb_rx * sizeof(pipeline_state_ptr));
+    memcpy(worker_states, workers, nb_workers * sizeof(pipeline_state_ptr));
+    nb_rx_states = nb_rx;
+    nb_worker_states = nb_workers;
+    nb_running_rx_threads = nb_rx;
+    nb_running_workers = nb_workers;
+    printf("pipeline: %u rx, %u worker and %u tx lcores, rings of %u frames%s.\n", nb_rx, nb_workers, nb_tx,
+           ring_size, eventdev_mode ? ", rx to worker scheduling by the event device" : "");
+}
+
+bool pipeline_rx_running()
+{
+    return nb_running_rx_threads > 0;
+}
+
+bool pipeline_workers_running()
+{
+    return nb_running_workers > 0;
+}
+
+/**
+ * self function returns true if the workers received every event the rx
+ * threads injected. Only meaningful after the rx threads stopped.
+*/
+bool pipeline_events_drained()
+{
+    uint64_t injected = 0, received = 0;
+    unsigned int i;
+    if (!eventdev_mode)
+        return true;
+    for (i = 0; i < nb_rx_states; i++)
+        injected += rx_states[i]->events;
+    for (i = 0; i < nb_worker_states; i++)
+        received += worker_states[i]->events;
+    return injected == received;
+}
+
+/**
+ * self function tells the tx threads that this worker does not send frames anymore.
+*/
+void pipeline_stop_worker()
+{
+    __sync_fetch_and_sub(&nb_running_workers, 1);
+}
+
+/**
+ * self function prints the frames every rx thread and worker dropped on full rings.
+*/
+void pipeline_print_stats()
+{
+    unsigned int i;
+    for (i = 0; i < nb_rx_states; i++)
+        if (rx_states[i]->ring_drops > 0)
+            printf("lcore %u: %" PRIu64 " frames dropped between the pipeline stages.\n", rx_states[i]->lcore_id, rx_states[i]->ring_drops);
+    for (i = 0; i < nb_worker_states; i++)
+        if (worker_states[i]->ring_drops > 0)
+            printf("lcore %u: %" PRIu64 " frames dropped between the pipeline stages.\n", worker_states[i]->lcore_id, worker_states[i]->ring_drops);
+}
+
+void pipeline_state_init(pipeline_state_ptr self, unsigned int lcore_id)
+{
+    memset(self, 0, sizeof(pipeline_state));
+    pointer_list_init(&self->in_rings);
+    pointer_list_init(&self->out_rings);
+    self->lcore_id = lcore_id;
+}
+
+void pipeline_state_finalize(pipeline_state_ptr self)
+{
+    unsigned int i;
+    for (i = 0; i < pointer_list_len(&self->out_rings); i++)
+        rte_ring_free((struct rte_ring *)pointer_list_get(&self->out_rings, i));
+    pointer_list_clear(&self->out_rings);
+    pointer_list_clear(&self->in_rings);
+}
+
+/**
+ * self function returns the frames the rings of the thread to the next stage
+ * (and the event device it schedules) can hold at most.
+*/
+uint32_t pipeline_reserved_mbufs(pipeline_state_ptr self)
+{
+    uint32_t nb_bufs = 0;
+    unsigned int i;
+    for (i = 0; i < pointer_list_len(&self->out_rings); i++)
+        nb_bufs += rte_ring_get_size((struct rte_ring *)pointer_list_get(&self->out_rings, i));
+    if (self->schedules_events)
+        nb_bufs += ring_size;
+    return nb_bufs;
+}
+
+/**
+ * self function hands the frames received by an rx thread to the workers.
+ * Every flow is pinned to a single worker by its hash, so its frames stay in
+ * order through the pipeline. The frames that do not fit into a ring are dropped.
+*/
+void pipeline_dispatch_frames(pipeline_state_ptr self, struct rte_mbuf *bufs[], const uint32_t hashes[], uint16_t nb_bufs)
+{
+    uint16_t keys[PIPELINE_MAX_BURST], *next_keys = keys, i, nb_workers = (uint16_t)pointer_list_len(&self->out_rings);
+    for (i = 0; i < nb_bufs; i++)
+        keys[i] = (uint16_t)(hashes[i] % nb_workers);
+    while (nb_bufs > 0)
+    {
+        uint16_t nb_group = group_frames_by_key(bufs, next_keys, nb_bufs);
+        struct rte_ring *ring = (struct rte_ring *)pointer_list_get(&self->out_rings, next_keys[0]);
+        unsigned int sent = rte_ring_sp_enqueue_burst(ring, (void **)bufs, nb_group, NULL);
+        self->ring_drops += nb_group - sent;
+        for (; sent < nb_group; sent++)
+            rte_pktmbuf_free(bufs[sent]);
+        bufs += nb_group;
+        next_keys += nb_group;
+        nb_bufs -= nb_group;
+    }
+}
+
+/**
+ * self function injects the frames received by an rx thread into the event
+ * device. The flow hash is the atomic flow id, so the events of a flow are
+ * processed by a single worker at a time while the flows are balanced
+ * dynamically over all workers.
+*/
+void pipeline_enqueue_events(pipeline_state_ptr self, struct rte_mbuf *bufs[], const uint32_t hashes[], uint16_t nb_bufs)
+{
+    struct rte_event evs[PIPELINE_MAX_BURST];
+    uint16_t i, sent;
+    for (i = 0; i < nb_bufs; i++)
+    {
+        evs[i].event = 0;
+        evs[i].flow_id = hashes[i];
+        evs[i].event_type = RTE_EVENT_TYPE_ETHDEV;
+        evs[i].op = RTE_EVENT_OP_NEW;
+        evs[i].sched_type = RTE_SCHED_TYPE_ATOMIC;
+        evs[i].queue_id = 0;
+        evs[i].priority = RTE_EVENT_DEV_PRIORITY_NORMAL;
+        evs[i].mbuf = bufs[i];
+    }
+    sent = rte_event_enqueue_new_burst(event_dev_id, self->ev_port, evs, nb_bufs);
+    self->events += sent;
+    // The device applies back pressure once too many events are in flight.
+    self->ring_drops += nb_bufs - sent;
+    for (; sent < nb_bufs; sent++)
+        rte_pktmbuf_free(bufs[sent]);
+}
+
+/**
+ * self function runs the scheduler of the software event device if this
+ * thread owns it. The device only moves events when it is scheduled.
+*/
+void pipeline_schedule_events(pipeline_state_ptr self)
+{
+    if (self->schedules_events)
+        rte_event_schedule(event_dev_id);
+}
+
+/**
+ * self function tells the workers that this rx thread does not send frames
+ * anymore. The thread that runs the scheduler keeps scheduling until the
+ * workers got every event.
+*/
+void pipeline_stop_rx(pipeline_state_ptr self)
+{
+    __sync_fetch_and_sub(&nb_running_rx_threads, 1);
+    if (self->schedules_events)
+        while (nb_running_workers > 0)
+            rte_event_schedule(event_dev_id);
+}
+
+/**
+ * self function takes up to 'nb_bufs' frames from the in ring 'ring_idx' of
+ * the thread. Returns the number of frames taken.
+*/
+uint16_t pipeline_dequeue(pipeline_state_ptr self, unsigned int ring_idx, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    struct rte_ring *ring = (struct rte_ring *)pointer_list_get(&self->in_rings, ring_idx);
+    return (uint16_t)rte_ring_sc_dequeue_burst(ring, (void **)bufs, nb_bufs, NULL);
+}
+
+/**
+ * self function takes a burst of events scheduled to a worker and returns
+ * the number of frames they carry. Dequeuing the next burst releases the
+ * flows of the previous one.
+*/
+uint16_t pipeline_dequeue_events(pipeline_state_ptr self, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    struct rte_event evs[PIPELINE_MAX_BURST];
+    uint16_t i, rx = rte_event_dequeue_burst(event_dev_id, self->ev_port, evs, RTE_MIN(nb_bufs, PIPELINE_MAX_BURST), 0);
+    self->events += rx;
+    for (i = 0; i < rx; i++)
+        bufs[i] = evs[i].mbuf;
+    return rx;
+}
+
+/**
+ * self function buffers a routed frame of a worker for the tx threads, which
+ * find the egress interface in the frame itself. A full buffer is flushed.
+*/
+void pipeline_buffer_frame(pipeline_state_ptr self, struct rte_mbuf *buf)
+{
+    self->tx_bufs[self->nb_tx_bufs++] = buf;
+    if (self->nb_tx_bufs == PIPELINE_MAX_BURST)
+        pipeline_flush(self);
+}
+
+/**
+ * self function hands the routed frames of a worker to the tx threads: the
+ * frames to an interface with a scheduler to the tx thread that owns it, the
+ * others to the tx thread of the worker. The frames that do not fit into a
+ * ring are dropped.
+*/
+void pipeline_flush(pipeline_state_ptr self)
+{
+    uint16_t keys[PIPELINE_MAX_BURST], *next_keys = keys, i, nb_bufs = self->nb_tx_bufs;
+    struct rte_mbuf **bufs = self->tx_bufs;
+    bool scheduled = false;
+    if (nb_bufs == 0)
+        return;
+    for (i = 0; i < nb_bufs; i++)
+    {
+        int owner = bufs[i]->port != STEAL_DROPPED_PORT ? qos_get_owner((dpdk_interface)bufs[i]->port) : -1;
+        keys[i] = owner >= 0 ? (uint16_t)owner : self->tx_ring;
+        scheduled |= owner >= 0;
+    }
+    while (nb_bufs > 0)
+    {
+        uint16_t nb_group = scheduled ? group_frames_by_key(bufs, next_keys, nb_bufs) : nb_bufs;
+        struct rte_ring *ring = (struct rte_ring *)pointer_list_get(&self->out_rings, next_keys[0]);
+        unsigned int sent = rte_ring_sp_enqueue_burst(ring, (void **)bufs, nb_group, NULL);
+        self->ring_drops += nb_group - sent;
+        for (; sent < nb_group; sent++)
+            rte_pktmbuf_free(bufs[sent]);
+        bufs += nb_group;
+        next_keys += nb_group;
+        nb_bufs -= nb_group;
+    }
+    self->nb_tx_bufs = 0;
+}
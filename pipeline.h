@@ -0,0 +1,66 @@
+#ifndef PIPELINE_H__
+#define PIPELINE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <rte_config.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+
+#include "utils/utils.h"
+#include "utils/pointer_list.h"
+
+// Maximum number of frames handed to the functions below at once.
+#define PIPELINE_MAX_BURST 32
+
+typedef struct pipeline_state
+{
+    unsigned int lcore_id;
+    // Single producer, single consumer rings to the next and from the previous
+    // stage of the pipeline. A thread only frees its 'out_rings'.
+    pointer_list in_rings;
+    pointer_list out_rings;
+    // Routed frames a worker has not handed to its tx thread yet.
+    struct rte_mbuf *tx_bufs[PIPELINE_MAX_BURST];
+    uint16_t nb_tx_bufs;
+    // Out ring (and tx thread) of a worker for the frames to interfaces without a scheduler.
+    uint16_t tx_ring;
+    // Frames dropped because the next stage of the pipeline was full.
+    uint64_t ring_drops;
+    // Event port of an rx or worker thread with '--eventdev', and the number
+    // of events it injected (rx) or received (worker).
+    uint8_t ev_port;
+    volatile uint64_t events;
+    // Does this thread run the scheduler of the software event device?
+    bool schedules_events;
+} pipeline_state, *pipeline_state_ptr;
+
+void pipeline_init();
+void pipeline_finalize();
+bool pipeline_set_ring_size(uint32_t size);
+unsigned int pipeline_get_ring_size();
+bool pipeline_connect(pipeline_state_ptr from, pipeline_state_ptr to, const char *name);
+bool pipeline_create_event_device(pipeline_state_ptr rx_states[], unsigned int nb_rx,
+                                  pipeline_state_ptr worker_states[], unsigned int nb_workers);
+void pipeline_start(pipeline_state_ptr rx_states[], unsigned int nb_rx,
+                    pipeline_state_ptr worker_states[], unsigned int nb_workers, unsigned int nb_tx);
+bool pipeline_rx_running();
+bool pipeline_workers_running();
+bool pipeline_events_drained();
+void pipeline_stop_worker();
+void pipeline_print_stats();
+
+void pipeline_state_init(pipeline_state_ptr self, unsigned int lcore_id);
+void pipeline_state_finalize(pipeline_state_ptr self);
+uint32_t pipeline_reserved_mbufs(pipeline_state_ptr self);
+void pipeline_dispatch_frames(pipeline_state_ptr self, struct rte_mbuf *bufs[], const uint32_t hashes[], uint16_t nb_bufs);
+void pipeline_enqueue_events(pipeline_state_ptr self, struct rte_mbuf *bufs[], const uint32_t hashes[], uint16_t nb_bufs);
+void pipeline_schedule_events(pipeline_state_ptr self);
+void pipeline_stop_rx(pipeline_state_ptr self);
+uint16_t pipeline_dequeue(pipeline_state_ptr self, unsigned int ring_idx, struct rte_mbuf *bufs[], uint16_t nb_bufs);
+uint16_t pipeline_dequeue_events(pipeline_state_ptr self, struct rte_mbuf *bufs[], uint16_t nb_bufs);
+void pipeline_buffer_frame(pipeline_state_ptr self, struct rte_mbuf *buf);
+void pipeline_flush(pipeline_state_ptr self);
+
+#endif
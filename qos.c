@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <rte_config.h>
+#include <rte_common.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_lcore.h>
+#include <rte_hash_crc.h>
+#include <rte_meter.h>
+#include <rte_sched.h>
+
+#include "qos.h"
+
+// Largest pipes and queue size of a scheduler ('--qos').
+#define QOS_MAX_PIPES 4096
+#define QOS_MAX_QUEUE_SIZE 4096
+// Period the traffic class rates of a scheduler are enforced over, which is also
+// the burst its token buckets hold (ms).
+#define QOS_TC_PERIOD_MS 10
+// Number of DSCP values ('--qos-dscp').
+#define DSCP_VALUES 64
+
+// Hierarchical scheduler of an egress interface ('--qos'): a single subport
+// whose pipes share the rate of the interface. Only the tx thread that owns it
+// touches the scheduler and its counters.
+typedef struct qos_config
+{
+    // Rate in bytes per second, 0 for an interface without a scheduler.
+    uint32_t rate;
+    uint32_t nb_pipes;
+    uint32_t queue_size;
+    // Index of the tx thread that runs the scheduler (see 'qos_assign_owners').
+    uint16_t owner;
+    struct rte_sched_port *sched;
+    // Frames scheduled per traffic class, dropped on full queues and released.
+    uint64_t frames[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
+    uint64_t drops;
+    uint64_t dequeued;
+} __rte_cache_aligned qos_config, *qos_config_ptr;
+
+// Schedulers of the egress interfaces, the interfaces that have one, and the
+// traffic class of every DSCP value ('--qos-dscp').
+static qos_config qos_confs[RTE_MAX_ETHPORTS];
+static dpdk_interface qos_ints[RTE_MAX_ETHPORTS];
+static unsigned int nb_qos_ints;
+static uint8_t dscp_tcs[DSCP_VALUES];
+
+/**
+ * self function maps the DSCP values to the traffic classes of the schedulers,
+ * from the highest priority (0) to best effort (3), after the service classes
+ * of RFC 4594: network control and telephony, then video, then the other
+ * assured forwarding classes, then the rest (default, AF1x and CS1).
+*/
+static void default_dscp_tcs()
+{
+    static const uint8_t tc0[] = {46, 44, 48, 56};
+    static const uint8_t tc1[] = {32, 34, 36, 38, 40};
+    static const uint8_t tc2[] = {16, 18, 20, 22, 24, 26, 28, 30};
+    unsigned int i;
+    memset(dscp_tcs, RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE - 1, sizeof(dscp_tcs));
+    for (i = 0; i < RTE_DIM(tc0); i++)
+        dscp_tcs[tc0[i]] = 0;
+    for (i = 0; i < RTE_DIM(tc1); i++)
+        dscp_tcs[tc1[i]] = 1;
+    for (i = 0; i < RTE_DIM(tc2); i++)
+        dscp_tcs[tc2[i]] = 2;
+}
+
+/**
+ * self function forgets all schedulers and restores the default traffic classes
+ * of the DSCP values. Must be called before any scheduler is added.
+*/
+void qos_init()
+{
+    memset(qos_confs, 0, sizeof(qos_confs));
+    nb_qos_ints = 0;
+    default_dscp_tcs();
+}
+
+/**
+ * self function frees the schedulers, with the frames that are still queued.
+*/
+void qos_finalize()
+{
+    dpdk_interface int_id;
+    for (int_id = 0; int_id < RTE_MAX_ETHPORTS; int_id++)
+        rte_sched_port_free(qos_confs[int_id].sched);
+    qos_init();
+}
+
+/**
+ * self function adds (or replaces) the scheduler of an egress interface: the rate
+ * of the interface in bytes per second, the number of pipes its destinations are
+ * hashed to and the frames each queue of a pipe holds (both powers of 2). Returns
+ * false if they are invalid.
+*/
+bool qos_add(dpdk_interface int_id, uint32_t rate, uint32_t nb_pipes, uint32_t queue_size)
+{
+    if (rate == 0 || nb_pipes == 0 || nb_pipes > QOS_MAX_PIPES || !rte_is_power_of_2(nb_pipes) ||
+        queue_size == 0 || queue_size > QOS_MAX_QUEUE_SIZE || !rte_is_power_of_2(queue_size))
+        return false;
+    qos_config_ptr qos_conf = &qos_confs[int_id];
+    qos_conf->rate = rate;
+    qos_conf->nb_pipes = nb_pipes;
+    qos_conf->queue_size = queue_size;
+    return true;
+}
+
+/**
+ * self function maps a DSCP value to a traffic class of the schedulers, 0 the
+ * highest priority to 3 best effort. Returns false if either is invalid.
+*/
+bool qos_set_dscp_class(unsigned int dscp, unsigned int tc)
+{
+    if (dscp >= DSCP_VALUES || tc >= RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE)
+        return false;
+    dscp_tcs[dscp] = (uint8_t)tc;
+    return true;
+}
+
+/**
+ * self function spreads the schedulers over the given number of tx threads, a
+ * single tx thread runs the scheduler of an interface, at its whole rate.
+*/
+void qos_assign_owners(unsigned int nb_tx)
+{
+    unsigned int i, j;
+    for (i = 0, j = 0; i < RTE_MAX_ETHPORTS; i++)
+        if (qos_confs[i].rate != 0)
+            qos_confs[i].owner = (uint16_t)(j++ % nb_tx);
+}
+
+int qos_get_owner(dpdk_interface int_id)
+{
+    return qos_confs[int_id].rate != 0 ? qos_confs[int_id].owner : -1;
+}
+
+/**
+ * self function returns the frames the schedulers of a tx thread can hold at
+ * most, even before they are created.
+*/
+uint32_t qos_reserved_mbufs(unsigned int tx_idx)
+{
+    uint32_t nb_bufs = 0;
+    unsigned int i;
+    for (i = 0; i < RTE_MAX_ETHPORTS; i++)
+        if (qos_confs[i].rate != 0 && qos_confs[i].owner == tx_idx)
+            nb_bufs += qos_confs[i].nb_pipes * RTE_SCHED_QUEUES_PER_PIPE * qos_confs[i].queue_size;
+    return nb_bufs;
+}
+
+/**
+ * self function creates the scheduler of an egress interface on the lcore of the
+ * tx thread that owns it, 'name' names the scheduler. The pipes and traffic
+ * classes of a scheduler may each use the whole rate of the interface.
+*/
+bool qos_create(dpdk_interface int_id, const char *name, unsigned int lcore_id, uint16_t mtu)
+{
+    qos_config_ptr qos_conf = &qos_confs[int_id];
+    unsigned int tc, pipe;
+    // Every traffic class must be able to send a whole frame per period.
+    uint32_t rate = qos_conf->rate, frame_len = mtu + RTE_SCHED_FRAME_OVERHEAD_DEFAULT;
+    uint32_t burst = (uint32_t)((uint64_t)rate * QOS_TC_PERIOD_MS / 1000);
+    if (burst < frame_len)
+    {
+        printf("--qos rate of interface id %d is too low for its MTU, it needs at least %u bytes per second.\n",
+               int_id, frame_len * (1000 / QOS_TC_PERIOD_MS));
+        return false;
+    }
+    struct rte_sched_subport_params subport_params = {.tb_rate = rate, .tb_size = burst, .tc_period = QOS_TC_PERIOD_MS};
+    struct rte_sched_pipe_params pipe_params = {.tb_rate = rate, .tb_size = burst, .tc_period = QOS_TC_PERIOD_MS};
+    for (tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; tc++)
+    {
+        subport_params.tc_rate[tc] = rate;
+        pipe_params.tc_rate[tc] = rate;
+    }
+    memset(pipe_params.wrr_weights, 1, sizeof(pipe_params.wrr_weights));
+    struct rte_sched_port_params params = {
+        .name = name,
+        .socket = (int)rte_lcore_to_socket_id(lcore_id),
+        .rate = rate,
+        .mtu = mtu,
+        .frame_overhead = RTE_SCHED_FRAME_OVERHEAD_DEFAULT,
+        .n_subports_per_port = 1,
+        .n_pipes_per_subport = qos_conf->nb_pipes,
+        .pipe_profiles = &pipe_params,
+        .n_pipe_profiles = 1,
+    };
+    for (tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; tc++)
+        params.qsize[tc] = (uint16_t)qos_conf->queue_size;
+    qos_conf->sched = rte_sched_port_config(&params);
+    if (qos_conf->sched == NULL || rte_sched_subport_config(qos_conf->sched, 0, &subport_params) != 0)
+    {
+        printf("could not create the scheduler of interface id %d on lcore %u.\n", int_id, lcore_id);
+        return false;
+    }
+    for (pipe = 0; pipe < qos_conf->nb_pipes; pipe++)
+    {
+        if (rte_sched_pipe_config(qos_conf->sched, 0, pipe, 0) != 0)
+        {
+            printf("could not configure pipe %u of the scheduler of interface id %d.\n", pipe, int_id);
+            return false;
+        }
+    }
+    printf("interface %d: scheduler of %u pipes with queues of %u frames, %u bytes per second on tx lcore %u.\n",
+           int_id, qos_conf->nb_pipes, qos_conf->queue_size, rate, lcore_id);
+    qos_ints[nb_qos_ints++] = int_id;
+    return true;
+}
+
+unsigned int qos_count()
+{
+    return nb_qos_ints;
+}
+
+dpdk_interface qos_get_interface(unsigned int idx)
+{
+    return qos_ints[idx];
+}
+
+/**
+ * self function writes the place of a frame in the hierarchy of its egress
+ * scheduler into the frame: the pipe its destination hashes to, the traffic
+ * class of its DSCP and the queue of the class its source hashes to, so that
+ * the frames of a flow stay in order. Frames other than IPv4, such as ARP
+ * requests, go to the first pipe and the highest class. Returns the class.
+*/
+static inline uint32_t classify_frame(struct rte_mbuf *buf, uint32_t nb_pipes)
+{
+    struct ether_hdr *eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+    uint16_t ether_type = eth->ether_type;
+    uint32_t l2_len = sizeof(struct ether_hdr), pipe = 0, tc = 0, queue = 0;
+    // The tags pushed in software sit in front of the IPv4 header.
+    if (ether_type == rte_cpu_to_be_16(ETHER_TYPE_VLAN))
+    {
+        ether_type = ((struct vlan_hdr *)(eth + 1))->eth_proto;
+        l2_len += sizeof(struct vlan_hdr);
+    }
+    if (ether_type == rte_cpu_to_be_16(ETHER_TYPE_IPv4))
+    {
+        struct ipv4_hdr *hdr = rte_pktmbuf_mtod_offset(buf, struct ipv4_hdr *, l2_len);
+        uint32_t hash = rte_hash_crc_4byte(hdr->dst_addr, 0);
+        tc = dscp_tcs[hdr->type_of_service >> 2];
+        pipe = hash & (nb_pipes - 1);
+        queue = rte_hash_crc_4byte(hdr->src_addr, hash) & (RTE_SCHED_QUEUES_PER_TRAFFIC_CLASS - 1);
+    }
+    rte_sched_port_pkt_write(buf, 0, pipe, tc, queue, e_RTE_METER_GREEN);
+    return tc;
+}
+
+/**
+ * self function hands a burst of processed frames of the tx thread that owns
+ * the schedulers of their egress interfaces to the schedulers, one burst per
+ * interface. The frames to other interfaces (or to none, 'port' beyond the
+ * interfaces) are moved to the front of 'bufs' for the caller to transmit
+ * right away. Returns their number.
+*/
+uint16_t qos_schedule_frames(struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    struct rte_mbuf *sched_bufs[QOS_MAX_BURST], **next_bufs = sched_bufs;
+    uint16_t keys[QOS_MAX_BURST], *next_keys = keys, i, nb_direct = 0, nb_sched = 0;
+    for (i = 0; i < nb_bufs; i++)
+    {
+        uint16_t int_id = bufs[i]->port;
+        if (int_id >= RTE_MAX_ETHPORTS || qos_confs[int_id].sched == NULL)
+        {
+            bufs[nb_direct++] = bufs[i];
+            continue;
+        }
+        qos_confs[int_id].frames[classify_frame(bufs[i], qos_confs[int_id].nb_pipes)]++;
+        keys[nb_sched] = int_id;
+        sched_bufs[nb_sched++] = bufs[i];
+    }
+    while (nb_sched > 0)
+    {
+        uint16_t nb_group = group_frames_by_key(next_bufs, next_keys, nb_sched);
+        // The scheduler frees the frames its full queues do not take.
+        qos_config_ptr qos_conf = &qos_confs[next_keys[0]];
+        qos_conf->drops += nb_group - (uint16_t)rte_sched_port_enqueue(qos_conf->sched, next_bufs, nb_group);
+        next_bufs += nb_group;
+        next_keys += nb_group;
+        nb_sched -= nb_group;
+    }
+    return nb_direct;
+}
+
+/**
+ * self function takes up to 'nb_bufs' frames the scheduler of an interface
+ * releases, to be transmitted by the tx thread that owns it.
+*/
+uint16_t qos_dequeue(dpdk_interface int_id, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    qos_config_ptr qos_conf = &qos_confs[int_id];
+    if (qos_conf->sched == NULL)
+        return 0;
+    uint16_t nb_dequeued = (uint16_t)rte_sched_port_dequeue(qos_conf->sched, bufs, nb_bufs);
+    qos_conf->dequeued += nb_dequeued;
+    return nb_dequeued;
+}
+
+/**
+ * self function prints the frames the scheduler of every interface took per
+ * traffic class, dropped on full queues, released and still holds.
+*/
+void qos_print_stats()
+{
+    unsigned int i, tc;
+    for (i = 0; i < nb_qos_ints; i++)
+    {
+        dpdk_interface int_id = qos_ints[i];
+        qos_config_ptr qos_conf = &qos_confs[int_id];
+        uint64_t scheduled = 0;
+        for (tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; tc++)
+            scheduled += qos_conf->frames[tc];
+        printf("interface %d: %" PRIu64 " frames scheduled (%" PRIu64 "/%" PRIu64 "/%" PRIu64 "/%" PRIu64 " in traffic classes 0-3), "
+               "%" PRIu64 " dropped on full queues, %" PRIu64 " released, %" PRIu64 " queued.\n",
+               int_id, scheduled, qos_conf->frames[0], qos_conf->frames[1], qos_conf->frames[2], qos_conf->frames[3],
+               qos_conf->drops, qos_conf->dequeued, scheduled - qos_conf->drops - qos_conf->dequeued);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef QOS_H__
+#define QOS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <rte_config.h>
+#include <rte_mbuf.h>
+
+#include "utils/utils.h"
+
+// Default pipes of the scheduler of an egress interface ('--qos'), the destinations
+// are hashed to, and frames of each of the 16 queues of a pipe.
+#define QOS_DEFAULT_PIPES 16
+#define QOS_DEFAULT_QUEUE_SIZE 64
+// Maximum number of frames scheduled at once.
+#define QOS_MAX_BURST 64
+
+void qos_init();
+void qos_finalize();
+bool qos_add(dpdk_interface int_id, uint32_t rate, uint32_t nb_pipes, uint32_t queue_size);
+bool qos_set_dscp_class(unsigned int dscp, unsigned int tc);
+void qos_assign_owners(unsigned int nb_tx);
+// index of the tx thread that runs the scheduler of an interface, -1 if it has none
+int qos_get_owner(dpdk_interface int_id);
+uint32_t qos_reserved_mbufs(unsigned int tx_idx);
+bool qos_create(dpdk_interface int_id, const char *name, unsigned int lcore_id, uint16_t mtu);
+unsigned int qos_count();
+dpdk_interface qos_get_interface(unsigned int idx);
+uint16_t qos_schedule_frames(struct rte_mbuf *bufs[], uint16_t nb_bufs);
+uint16_t qos_dequeue(dpdk_interface int_id, struct rte_mbuf *bufs[], uint16_t nb_bufs);
+void qos_print_stats();
+
+#endif
@@ -2,6 +2,10 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include <signal.h>
+#include <getopt.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <pthread.h>
 
 #include <rte_config.h>
 #include <rte_mbuf.h>
@@ -9,14 +13,37 @@
 #include <rte_arp.h>
 #include <rte_ether.h>
 #include <rte_ip.h>
+#include <rte_icmp.h>
 #include <rte_byteorder.h>
 #include <rte_launch.h>
+#include <rte_lcore.h>
+#include <rte_string_fns.h>
+#include <rte_errno.h>
+#include <rte_distributor.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_ring.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_memzone.h>
+#include <rte_cfgfile.h>
+#include <rte_ip_frag.h>
+#include <rte_meter.h>
 
 #include <arpa/inet.h>
+#include <netinet/ip_icmp.h>
 
 #include "router.h"
 #include "dpdk_init.h"
 #include "routing_table.h"
+#include "idle.h"
+#include "neighbor.h"
+#include "acl.h"
+#include "meter.h"
+#include "qos.h"
+#include "handoff.h"
+#include "steal.h"
+#include "pipeline.h"
 
 // An arbitrary maximum decimal digit length for those options that specify a number.
 #define MAX_DEC_DIGIT_LEN 10
@@ -27,30 +54,216 @@
 #else
 #define DPDK_MIN_WORKER_ID 0
 #endif
-// DPDK value of minimum slave id.
-#define DPDK_MIN_SLAVE_ID 1
 // Burst size will determine the frame capture buffer length.
 #define MAX_BURST_SIZE 32
 // Maximum number of trials for transmitting a packet.
 #define MAX_TRANSMIT_TRIAL 10
+// Maximum number of bursts taken from an rx queue when draining it at shutdown.
+#define DRAIN_MAX_BURSTS 64
+// Maximum number of worker lcores a distributed interface can spread its frames over
+// (RTE_DISTRIB_MAX_WORKERS, which is private to librte_distributor).
+#define MAX_DISTRIBUTOR_WORKERS 64
+// Maximum number of frames a distributor hands to a worker at once (RTE_DIST_BURST_SIZE).
+#define DISTRIBUTOR_BURST_SIZE 8
+// Maximum character length of a single '(port,queue,lcore)' tuple of '--config'.
+#define MAX_CONFIG_TUPLE_LEN 64
+// Default window of sequence numbers a thread can reorder its frames in ('--reorder-size').
+#define DEFAULT_REORDER_SIZE 2048
+// Default time a thread waits for an overdue frame before sending its successors ('--reorder-timeout', us).
+#define DEFAULT_REORDER_TIMEOUT_US 100
+// Interval the control thread checks for a requested RSS rebalancing at (us).
+#define CONTROL_POLL_US 100000
+// Interval of the neighbor cache timers (ms).
+#define NEIGHBOR_TICK_MS 100
+// Default number of ICMP errors every thread sends per second at most ('--icmp-rate').
+#define DEFAULT_ICMP_RATE 1000
+// Fragments a packet is split into at most, the ones that need more are dropped.
+#define MAX_FRAGMENTS 32
+// Reassembly table of every thread: buckets, entries per bucket and packets
+// reassembled at once at most (each holds up to RTE_LIBRTE_IP_FRAG_MAX_FRAG fragments).
+#define REASSEMBLY_BUCKETS 64
+#define REASSEMBLY_BUCKET_ENTRIES 4
+#define REASSEMBLY_MAX_ENTRIES 256
+// Time the fragments of a packet have to arrive in, before they are dropped (ms).
+#define REASSEMBLY_TIMEOUT_MS 2000
+// A 9000-byte ping over a 1500-byte MTU arrives in 7 fragments, and the expired
+// reassemblies are only counted with the table statistics (see 'dpdk/config/common_base').
+#if !defined(RTE_LIBRTE_IP_FRAG_MAX_FRAG) || RTE_LIBRTE_IP_FRAG_MAX_FRAG < 8
+#error "DPDK must be configured with CONFIG_RTE_LIBRTE_IP_FRAG_MAX_FRAG=8 or more"
+#endif
+#ifndef RTE_LIBRTE_IP_FRAG_TBL_STAT
+#error "DPDK must be configured with CONFIG_RTE_LIBRTE_IP_FRAG_TBL_STAT=y"
+#endif
+// TTL of the ICMP messages (errors and echo replies) the router sends.
+#define ICMP_TTL 64
 
 typedef struct interface_config
 {
     dpdk_interface int_id;
+    // VLAN of a sub-interface of the port ('-p PORT.VLAN,IP'), 0 for the port itself.
+    uint16_t vlan_id;
     ipv4_addr addr;
     ether_addr mac;
+    // Is the device configured and started (and must be closed)?
+    bool started;
 } interface_config, *interface_config_ptr;
 
+// Assignment of an RX queue of an interface to the lcore polling it ('--config').
+typedef struct queue_config
+{
+    dpdk_interface int_id;
+    dpdk_queue q_id;
+    unsigned int lcore_id;
+} queue_config, *queue_config_ptr;
+
+// An interface with a single rx queue whose frames are spread over the worker
+// lcores in software by 'librte_distributor' ('--distribute').
+typedef struct distributor_config
+{
+    interface_config_ptr int_conf;
+    struct rte_distributor *dist;
+    unsigned int nb_workers;
+} distributor_config, *distributor_config_ptr;
+
+// Membership of a thread in the workers of a distributor.
+typedef struct distributor_worker
+{
+    distributor_config_ptr dist_conf;
+    unsigned int worker_id;
+} distributor_worker, *distributor_worker_ptr;
+
+// An RX queue polled by a thread. In vswitch mode the thread polls all
+// 'nb_queues' queues of the interface starting from 'q_id'. Frames of a
+// queue with 'dist_conf' are handed to the distributor instead of being
+// processed by the polling thread.
+typedef struct rx_queue_config
+{
+    interface_config_ptr int_conf;
+    dpdk_queue q_id;
+    uint16_t nb_queues;
+    distributor_config_ptr dist_conf;
+    // Frames received from the queue, and the value at the last RSS rebalancing.
+    uint64_t rx_frames;
+    uint64_t rx_frames_at_rebalance;
+    // Frames taken from the queue after the router was asked to quit.
+    uint64_t drained_frames;
+} rx_queue_config, *rx_queue_config_ptr;
+
+// Role of the thread of an lcore. Without '--pipeline' every thread runs to
+// completion: it receives, processes and transmits its own frames.
+typedef enum thread_role
+{
+    THREAD_ROLE_RUN_TO_COMPLETION = 0,
+    // Polls rx queues and hands the frames to the workers over rings.
+    THREAD_ROLE_RX,
+    // Validates and routes the frames of the rx threads, hands them to its tx thread.
+    THREAD_ROLE_WORKER,
+    // Transmits the frames of its workers on its own tx queues.
+    THREAD_ROLE_TX
+} thread_role;
+
 typedef struct thread_config
 {
-    pointer_list int_confs;
-    uint16_t worker_count;
+    pointer_list rx_queues;
+    pointer_list dist_workers;
+    unsigned int lcore_id;
+    thread_role role;
+    // TX queue owned by this thread on every interface.
     dpdk_queue q_id;
+    // Rings (or event port) to the next and from the previous stage of the pipeline.
+    pipeline_state pipeline;
+    // Does this thread send the ARP requests of the neighbor cache, and when next?
+    bool ticks_neighbors;
+    uint64_t next_neighbor_tick;
+    // Token bucket limiting the ICMP errors of this thread (credit in tsc cycles and
+    // when it was last refilled), and the errors it sent and the ones it suppressed.
+    uint64_t icmp_credit;
+    uint64_t icmp_credit_tsc;
+    uint64_t icmp_errors;
+    uint64_t icmp_limited;
+    // Echo requests this thread answered, per interface.
+    uint64_t echo_replies[RTE_MAX_ETHPORTS];
+    // Packets this thread fragmented and the fragments it sent, per egress interface,
+    // the packets it could not fragment and the time (tsc) it spent fragmenting.
+    uint64_t frag_packets[RTE_MAX_ETHPORTS];
+    uint64_t frag_fragments[RTE_MAX_ETHPORTS];
+    uint64_t frag_failures;
+    uint64_t frag_cycles;
+    // Fragments of the packets to our addresses that are being reassembled, the
+    // fragments to free and the packets this thread reassembled.
+    struct rte_ip_frag_tbl *frag_tbl;
+    struct rte_ip_frag_death_row death_row;
+    uint64_t reassembled;
+    // Meters of the routes this thread polices, indexed by meter id (NULL without '--meter').
+    meter_state_ptr meters;
+    // Work stealing ('--steal').
+    steal_state steal;
+    // Are transmissions deferred until the processed frames are reordered?
+    bool defer_tx;
+    idle_state idle;
 } thread_config, *thread_config_ptr;
 
+// Maximum number of local (interface) addresses.
+#define MAX_LOCAL_ADDRS 64
+// Number of VLAN ids, the size of the VLAN table of a port.
+#define VLAN_IDS 4096
+
 static pointer_list int_confs;
+// VLAN sub-interfaces, which are not configured as devices of their own.
+static pointer_list vlan_confs;
+// Interface of every VLAN of the ports with sub-interfaces (the port itself for
+// VLAN 0, NULL for the VLANs it does not carry), so a tagged frame is classified
+// with a single lookup. NULL for the ports without sub-interfaces.
+static interface_config_ptr *vlan_ints[RTE_MAX_ETHPORTS];
+// Does every port insert the VLAN tags itself, or are they pushed in software?
+static bool vlan_insert[RTE_MAX_ETHPORTS];
+// Addresses of the interfaces (in network byte order) and the interfaces they
+// belong to, compared four at a time for every ARP message and IPv4 packet.
+static ipv4_addr local_addrs[MAX_LOCAL_ADDRS] __rte_cache_aligned;
+static interface_config_ptr local_ints[MAX_LOCAL_ADDRS];
+static unsigned int nb_local_addrs;
+static pointer_list queue_confs;
 static pointer_list thr_confs;
+static pointer_list dist_confs;
+// Interfaces selected with '--distribute'.
+static bool distributed_ints[RTE_MAX_ETHPORTS];
+// Number of distributed rx queues whose polling thread is still running.
+static volatile unsigned int nb_distributing_threads;
 static volatile bool force_quit;
+// Frames every interface failed to transmit, since its tx queues were full.
+static volatile uint64_t tx_drops[RTE_MAX_ETHPORTS];
+static volatile bool rebalance_requested;
+// Thread apart from the lcores that rebalances the RSS redirection tables.
+static pthread_t control_thread;
+// Largest frame (without CRC) every interface receives and sends, given its MTU ('--mtu').
+static uint32_t max_frame_lens[RTE_MAX_ETHPORTS];
+// Should every thread poll all queues of its interfaces (see README, "Remark on ACN-VM")?
+static bool vswitch_mode;
+// Are rx, processing and tx split over dedicated lcores ('--pipeline')?
+static bool pipeline_mode;
+static thread_role lcore_roles[RTE_MAX_LCORE];
+// Do idle threads steal the surplus frames of busy ones ('--steal'), and is the
+// order of the frames restored afterwards ('--steal-reorder')?
+static bool steal_mode;
+static bool steal_reorder;
+// Interval of the work stealing, mempool and ICMP statistics in seconds, 0 for only at exit ('--stats').
+static unsigned int stats_interval;
+// Mbufs of the pool of every socket, 0 for sized from the queues and rings ('--mbufs').
+static unsigned int nb_mbufs;
+// Window and timeout of the reorder buffers ('--reorder-size', '--reorder-timeout').
+static unsigned int reorder_size;
+static unsigned int reorder_timeout_us;
+// ICMP errors every thread sends per second at most, 0 for none ('--icmp-rate'), and the
+// cost of one error and the size of the token buckets of the threads in tsc cycles.
+static unsigned int icmp_rate;
+static uint64_t icmp_cost_cycles;
+static uint64_t icmp_burst_cycles;
+// Are the frames of the rx threads scheduled to the workers by an event device ('--eventdev')?
+static bool eventdev_mode;
+// Whether the ipv4 packets are filtered by the ACL ('--acl').
+static bool acl_mode;
+
+static bool qos_mode;
 
 //---------'interface_config' FUNCTIONS------------------
 static void interface_config_print(const generic_ptr ptr)
@@ -61,17 +274,73 @@ static void interface_config_print(const generic_ptr ptr)
     char mac_str[ETHER_ADDR_FMT_SIZE], msg_str[MAX_STR_LEN];
     ether_format_addr(mac_str, ETHER_ADDR_FMT_SIZE, &int_conf->mac);
     snprintf(msg_str, MAX_STR_LEN,
-             "-p argument: interface id %d, ipv4 addr 0x%08x, MAC %s\n",
-             int_conf->int_id, int_conf->addr, mac_str);
+             "-p argument: interface id %d, vlan %d, ipv4 addr 0x%08x, MAC %s\n",
+             int_conf->int_id, int_conf->vlan_id, int_conf->addr, mac_str);
     printf(msg_str);
 }
 
+//---------'queue_config' FUNCTIONS------------------------
+static void queue_config_print(const generic_ptr ptr)
+{
+    if (ptr == NULL)
+        return;
+    const queue_config_ptr q_conf = (const queue_config_ptr)ptr;
+    printf("--config argument: interface id %d, rx queue %d, lcore %u\n",
+           q_conf->int_id, q_conf->q_id, q_conf->lcore_id);
+}
+
 //---------'thread_config' FUNCTIONS-----------------------
-static void thread_config_init(thread_config_ptr self, uint16_t worker_count, dpdk_queue q_id)
+static void thread_config_init(thread_config_ptr self, unsigned int lcore_id, dpdk_queue q_id)
 {
-    pointer_list_init(&self->int_confs);
-    self->worker_count = worker_count;
+    pointer_list_init(&self->rx_queues);
+    pointer_list_init(&self->dist_workers);
+    self->lcore_id = lcore_id;
+    self->role = lcore_roles[lcore_id];
     self->q_id = q_id;
+    pipeline_state_init(&self->pipeline, lcore_id);
+    self->ticks_neighbors = false;
+    self->next_neighbor_tick = 0;
+    self->icmp_credit = 0;
+    self->icmp_credit_tsc = 0;
+    self->icmp_errors = 0;
+    self->icmp_limited = 0;
+    memset(self->echo_replies, 0, sizeof(self->echo_replies));
+    memset(self->frag_packets, 0, sizeof(self->frag_packets));
+    memset(self->frag_fragments, 0, sizeof(self->frag_fragments));
+    self->frag_failures = 0;
+    self->frag_cycles = 0;
+    self->frag_tbl = NULL;
+    self->death_row.cnt = 0;
+    self->reassembled = 0;
+    self->meters = NULL;
+    steal_state_init(&self->steal);
+    self->defer_tx = false;
+}
+
+static void thread_config_clear(thread_config_ptr self)
+{
+    pointer_list_deep_clear(&self->rx_queues);
+    pointer_list_deep_clear(&self->dist_workers);
+    pipeline_state_finalize(&self->pipeline);
+    steal_state_finalize(&self->steal);
+    // Frees the fragments that are still waiting for the others as well.
+    if (self->frag_tbl != NULL)
+        rte_ip_frag_table_destroy(self->frag_tbl);
+    rte_ip_frag_free_death_row(&self->death_row, 0);
+}
+
+static void thread_config_add_rx_queue(thread_config_ptr self, interface_config_ptr int_conf,
+                                       dpdk_queue q_id, uint16_t nb_queues)
+{
+    rx_queue_config_ptr rx_conf = (rx_queue_config_ptr)malloc(sizeof(rx_queue_config));
+    rx_conf->int_conf = int_conf;
+    rx_conf->q_id = q_id;
+    rx_conf->nb_queues = nb_queues;
+    rx_conf->dist_conf = NULL;
+    rx_conf->rx_frames = 0;
+    rx_conf->rx_frames_at_rebalance = 0;
+    rx_conf->drained_frames = 0;
+    pointer_list_append(&self->rx_queues, (generic_ptr)rx_conf);
 }
 
 /**
@@ -86,30 +355,67 @@ static void signal_handler(int signum)
                signum);
         force_quit = true;
     }
+    else if (signum == SIGUSR1)
+    {
+        rebalance_requested = true;
+    }
+    else if (signum == SIGHUP)
+    {
+        acl_request_reload();
+    }
+}
+
+/**
+ * self function parses a DPDK interface id, optionally followed by the VLAN
+ * of one of its sub-interfaces after a '.' (as in '0.100'). 'vlan_id' is 0
+ * without one.
+*/
+static bool parse_interface_id(char *arg, int *int_id, uint16_t *vlan_id)
+{
+    int vlan = 0;
+    char *dot = strchr(arg, '.');
+    if (dot != NULL)
+    {
+        // Check if all characters of the VLAN are decimal.
+        if (!are_all_char_decimal(dot + 1))
+            return false;
+        vlan = atoi(dot + 1);
+        // VLAN 0 (priority tagged) and 4095 are reserved.
+        if (!(vlan >= VLAN_MIN_ID && vlan <= VLAN_MAX_ID))
+            return false;
+        *dot = '\0';
+    }
+    // Check if all characters are decimal.
+    bool valid = *arg != '\0' && are_all_char_decimal(arg);
+    *int_id = atoi(arg);
+    if (dot != NULL)
+        *dot = '.';
+    // Interface value must be a 1-byte unsigned integer.
+    if (!valid || !(*int_id >= DPDK_MIN_INTERFACE_VAL && *int_id <= DPDK_MAX_INTERFACE_VAL))
+        return false;
+    *vlan_id = (uint16_t)vlan;
+    return true;
 }
 
 /**
- * self function parses the option '-p' into DPDK interface id and the
- * corresponding ipv4 address.
+ * self function parses the option '-p' into DPDK interface id (and VLAN) and
+ * the corresponding ipv4 address.
 */
 static interface_config_ptr parse_option_p(char *arg)
 {
     int i, int_id, status;
+    uint16_t vlan_id;
     ipv4_addr addr;
 
     // Get the index of next ',' character.
     if ((i = index_of_first_char(arg, ',', MAX_DEC_DIGIT_LEN)) == -1)
         return NULL;
 
-    // Convert the number specified before the ','.
+    // Convert the interface (and VLAN) specified before the ','.
     arg[i] = '\0';
-    // Check if all characters are decimal.
-    if (!are_all_char_decimal(arg))
-        return NULL;
-    int_id = atoi(arg);
+    bool valid = parse_interface_id(arg, &int_id, &vlan_id);
     arg[i++] = ',';
-    // Interface value must be a 1-byte unsigned integer.
-    if (!(int_id >= DPDK_MIN_INTERFACE_VAL && int_id <= DPDK_MAX_INTERFACE_VAL))
+    if (!valid)
         return NULL;
 
     // Get the ipv4 address.
@@ -120,21 +426,26 @@ static interface_config_ptr parse_option_p(char *arg)
     // Create a router config and fill its values.
     interface_config_ptr res = (interface_config_ptr)malloc(sizeof(interface_config));
     res->int_id = (dpdk_interface)int_id;
+    res->vlan_id = vlan_id;
     res->addr = addr;
     rte_eth_macaddr_get(int_id, &res->mac);
+    set_port_mac(res->int_id, &res->mac);
+    res->started = false;
 
     return res;
 }
 
 /**
  * self function parses the option '-r' into ipv4 CIDR destination address,
- * next hop MAC address and DPDK interface.
+ * next hop MAC address (or gateway ipv4 address to resolve) and DPDK interface.
 */
 bool parse_option_r(char *arg)
 {
-    ipv4_addr addr;
+    ipv4_addr addr, gateway = 0;
     ether_addr mac;
-    int begin_idx = 0, end_idx, offset, cidr, int_id, status;
+    int begin_idx = 0, end_idx, offset, cidr, int_id, status, meter_id = 0;
+    uint16_t vlan_id;
+    char *meter_sep = NULL;
 
     // Get the index of next '/' character.
     if ((offset = index_of_first_char(arg + begin_idx, '/', IPV4_MAX_ADDR_LEN)) == -1)
@@ -169,436 +480,3217 @@ bool parse_option_r(char *arg)
         return false;
     end_idx = begin_idx + offset;
 
-    // Convert the mac address specified before the ','.
+    // Convert the mac address specified before the ',', or else the address of the gateway.
     arg[end_idx] = '\0';
     status = mac_addr_from_str(arg + begin_idx, &mac);
+    if (status == -1 && (status = ipv4_addr_from_str(arg + begin_idx, &gateway)) != -1 && gateway == 0)
+        status = -1;
     arg[end_idx++] = ',';
     // Check validity of the addr.
     if (status == -1)
         return false;
     begin_idx = end_idx;
 
+    // The interface id may be followed by the meter of the route after a ','.
+    if ((offset = index_of_first_char(arg + begin_idx, ',', MAX_DEC_DIGIT_LEN)) != -1)
+    {
+        meter_sep = arg + begin_idx + offset;
+        // Check if all characters of the meter id are decimal.
+        if (meter_sep[1] == '\0' || strlen(meter_sep + 1) >= MAX_DEC_DIGIT_LEN || !are_all_char_decimal(meter_sep + 1))
+            return false;
+        meter_id = atoi(meter_sep + 1);
+        // The meter must have been given with '--meter' before.
+        if (!(meter_id >= 1 && meter_id <= METER_MAX_ID) || !meter_exists((uint8_t)meter_id))
+        {
+            printf("meter %d of a route is not given with --meter before the route.\n", meter_id);
+            return false;
+        }
+        *meter_sep = '\0';
+    }
+
     // Make sure the interface id string is not too long.
     if (strlen(arg + begin_idx) >= MAX_DEC_DIGIT_LEN)
         return false;
-    // Check if all characters are decimal.
-    if (!are_all_char_decimal(arg + begin_idx))
-        return false;
-    // Get the interface id value.
-    int_id = atoi(arg + begin_idx);
-    // Interface value must be a 1-byte unsigned integer.
-    if (!(int_id >= DPDK_MIN_INTERFACE_VAL && int_id <= DPDK_MAX_INTERFACE_VAL))
+    // Get the interface id (and VLAN) value.
+    status = parse_interface_id(arg + begin_idx, &int_id, &vlan_id) ? 0 : -1;
+    if (meter_sep != NULL)
+        *meter_sep = ',';
+    if (status == -1)
         return false;
 
     // Create a router config and fill its values.
-    add_route(addr, (uint8_t)cidr, &mac, int_id);
+    if (gateway == 0)
+    {
+        add_route(addr, (uint8_t)cidr, &mac, int_id);
+        set_route_vlan(vlan_id);
+        set_route_meter((uint8_t)meter_id);
+        return true;
+    }
+    // The cache resolves every gateway on a single interface (and VLAN).
+    if (neighbor_add(gateway, (dpdk_interface)int_id, vlan_id) == NULL)
+    {
+        neighbor_ptr nb = neighbor_lookup(gateway);
+        if (rte_errno == EEXIST && nb != NULL)
+            printf("gateway of a route is reached through interface id %d, vlan %d by an earlier route.\n",
+                   nb->int_id, nb->vlan_id);
+        else if (rte_errno == ENOSPC)
+            printf("cannot resolve more than %d gateways.\n", NEIGHBOR_MAX);
+        else
+            printf("cannot resolve the gateway of a route: %s\n", rte_strerror(rte_errno));
+        return false;
+    }
+    add_gateway_route(addr, (uint8_t)cidr, gateway, int_id);
+    set_route_vlan(vlan_id);
+    set_route_meter((uint8_t)meter_id);
     return true;
 }
 
-/** 
- * Usage of applicaiton
- */
-static void usage()
-{
-    printf(
-        "-p for specifying a DPDK interface and the corresponding IP address to attach self router program (comma separated).\n"
-        "-r for specifying a routing entry which will be used for forwarding IP packets on attached interfaces (comma separated).\n");
-}
-
 /**
- * Performs ipv4 header validity checks that have not been already done,
- * according to https://tools.ietf.org/html/rfc1812#section-5.2.2 .
+ * self function parses the option '--meter' as 'id,cir,cbs,pir,pbs[,drop|mark]': a
+ * two rate three color meter (RFC 2698) with its rates in bytes per second and its
+ * burst sizes in bytes, and whether the packets above the peak rate are dropped
+ * (the default) or ECN marked.
 */
-static bool is_ipv4_hdr_valid(struct ipv4_hdr *hdr, uint32_t payload_size)
+static bool parse_option_meter(const char *arg)
 {
-    // Check if the checksum is correct.
-    uint16_t checksum = hdr->hdr_checksum;
-    hdr->hdr_checksum = 0;
-    uint16_t calc_chksm = rte_ipv4_cksum(hdr);
-    if (calc_chksm != checksum)
-        return false;
-    // Check if the ip version is 4.
-    uint8_t version = (hdr->version_ihl & IPV4_HDR_VER_MASK) >> IPV4_HDR_VER_BIT_OFFSET;
-    if (version != 4)
-        return false;
-    // Check if the header length is at least 20 bytes.
-    uint8_t ihl = (hdr->version_ihl & IPV4_HDR_IHL_MASK);
-    if (ihl < 5)
+    enum meter_field
+    {
+        FLD_ID = 0,
+        FLD_CIR,
+        FLD_CBS,
+        FLD_PIR,
+        FLD_PBS,
+        FLD_POLICY,
+        NUM_FLD
+    };
+    char str[MAX_STR_LEN];
+    char *str_fld[NUM_FLD];
+    uint64_t int_fld[FLD_POLICY];
+    meter_policy policy = METER_POLICY_DROP;
+    int i, nb_fld;
+    char *end;
+
+    if (strlen(arg) >= MAX_STR_LEN)
         return false;
-    // Check if the datagram length is enough to hold the header.
-    uint16_t tot_len = rte_be_to_cpu_16(hdr->total_length);
-    if (tot_len < IPV4_IHL_MULTIPLIER * ihl)
+    snprintf(str, MAX_STR_LEN, "%s", arg);
+    nb_fld = rte_strsplit(str, sizeof(str), str_fld, NUM_FLD, ',');
+    if (nb_fld != FLD_POLICY && nb_fld != NUM_FLD)
         return false;
-
-    // Additionally check if the total length reported by the ipv4 header is no more than the frame payload size.
-    if ((uint32_t)tot_len > payload_size)
+    for (i = 0; i < FLD_POLICY; i++)
+    {
+        errno = 0;
+        int_fld[i] = strtoull(str_fld[i], &end, 10);
+        if (errno != 0 || end == str_fld[i] || *end != '\0' || !are_all_char_decimal(str_fld[i]) || int_fld[i] == 0)
+            return false;
+    }
+    if (int_fld[FLD_ID] > METER_MAX_ID)
         return false;
-    // Check if the TTL is zero (it must not be).
-    if (hdr->time_to_live == 0)
+    if (nb_fld == NUM_FLD && strcmp(str_fld[FLD_POLICY], "mark") == 0)
+        policy = METER_POLICY_MARK;
+    else if (nb_fld == NUM_FLD && strcmp(str_fld[FLD_POLICY], "drop") != 0)
         return false;
-    return true;
+    struct rte_meter_trtcm_params params = {
+        .cir = int_fld[FLD_CIR],
+        .pir = int_fld[FLD_PIR],
+        .cbs = int_fld[FLD_CBS],
+        .pbs = int_fld[FLD_PBS],
+    };
+    return meter_add((uint8_t)int_fld[FLD_ID], &params, policy);
 }
 
 /**
- * self function sends the ipv4 packet to the given next hop, given it is valid.
+ * self function parses the option '--config' into a list of (interface, rx queue, lcore)
+ * assignments, in the same format as the l3fwd example: '(0,0,1),(0,1,2),(1,0,1)'.
 */
-static void thread_send_ipv4_packet(
-    thread_config_ptr thr_conf, interface_config_ptr int_conf,
-    struct rte_mbuf *buf, struct routing_table_entry *next_hop)
+static bool parse_option_config(const char *arg)
 {
-    // Make sure the next hop is valid.
-    if (next_hop == NULL)
+    enum config_field
     {
-        rte_pktmbuf_free(buf);
-        return;
-    }
-    // Decrement the TTL and check if it is 0.
-    struct ipv4_hdr *hdr = rte_pktmbuf_mtod_offset(
-        buf, struct ipv4_hdr *,
-        sizeof(struct ether_hdr));
-    hdr->time_to_live--;
-    if (hdr->time_to_live == 0)
+        FLD_PORT = 0,
+        FLD_QUEUE,
+        FLD_LCORE,
+        NUM_FLD
+    };
+    char tuple[MAX_CONFIG_TUPLE_LEN];
+    char *str_fld[NUM_FLD], *end;
+    unsigned long int_fld[NUM_FLD];
+    const char *begin, *close = arg;
+    int i;
+
+    pointer_list_deep_clear(&queue_confs);
+    while ((begin = strchr(close, '(')) != NULL)
     {
-        // TODO: send a 'TTL exceeded' icmp error back to the sender.
-        rte_pktmbuf_free(buf);
-        return;
+        begin++;
+        // Get the matching ')' and make sure the tuple fits.
+        if ((close = strchr(begin, ')')) == NULL || close - begin >= MAX_CONFIG_TUPLE_LEN)
+            return false;
+        snprintf(tuple, MAX_CONFIG_TUPLE_LEN, "%.*s", (int)(close - begin), begin);
+        if (rte_strsplit(tuple, sizeof(tuple), str_fld, NUM_FLD, ',') != NUM_FLD)
+            return false;
+        // Convert each field, all of them are non-negative decimal numbers.
+        for (i = 0; i < NUM_FLD; i++)
+        {
+            errno = 0;
+            int_fld[i] = strtoul(str_fld[i], &end, 10);
+            if (errno != 0 || end == str_fld[i] || *end != '\0')
+                return false;
+        }
+        // Interface value must be a 1-byte unsigned integer.
+        if (int_fld[FLD_PORT] > DPDK_MAX_INTERFACE_VAL || int_fld[FLD_QUEUE] >= RTE_MAX_QUEUES_PER_PORT ||
+            int_fld[FLD_LCORE] >= RTE_MAX_LCORE)
+            return false;
+
+        queue_config_ptr q_conf = (queue_config_ptr)malloc(sizeof(queue_config));
+        q_conf->int_id = (dpdk_interface)int_fld[FLD_PORT];
+        q_conf->q_id = (dpdk_queue)int_fld[FLD_QUEUE];
+        q_conf->lcore_id = (unsigned int)int_fld[FLD_LCORE];
+        pointer_list_append(&queue_confs, (generic_ptr)q_conf);
     }
-    // Calculate the header checksum.
-    hdr->hdr_checksum = 0;
-    hdr->hdr_checksum = rte_ipv4_cksum(hdr);
-    // Set the destination and source MAC addresses.
-    struct ether_hdr *eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
-    rte_eth_macaddr_get(next_hop->dst_port, &eth->s_addr);
-    ether_addr_copy(&next_hop->dst_mac, &eth->d_addr);
-    // Send the packet.
-    unsigned int i;
-    for (i = 0; i < MAX_TRANSMIT_TRIAL; i++)
-        if (rte_eth_tx_burst(next_hop->dst_port, thr_conf->q_id, &buf, 1))
-            break;
-    if (i >= MAX_TRANSMIT_TRIAL)
-        rte_pktmbuf_free(buf);
+    return pointer_list_len(&queue_confs) > 0;
 }
 
 /**
- * self function handles ipv4 packet inside an ethernet frame.
+ * self function parses the option '--distribute' into a DPDK interface id.
 */
-static void thread_handle_ether_ipv4(thread_config_ptr thr_conf, interface_config_ptr int_conf, struct rte_mbuf *buf)
+static bool parse_option_distribute(const char *arg)
 {
-    struct ipv4_hdr *hdr = rte_pktmbuf_mtod_offset(
-        buf, struct ipv4_hdr *,
-        sizeof(struct ether_hdr));
-    // Check if the ipv4 header is valid.
-    if (!is_ipv4_hdr_valid(hdr, buf->pkt_len - sizeof(struct ether_hdr)))
+    // Make sure the interface id string is not too long.
+    if (strlen(arg) == 0 || strlen(arg) >= MAX_DEC_DIGIT_LEN || !are_all_char_decimal(arg))
+        return false;
+    int int_id = atoi(arg);
+    // Interface value must be a 1-byte unsigned integer.
+    if (!(int_id >= DPDK_MIN_INTERFACE_VAL && int_id <= DPDK_MAX_INTERFACE_VAL) || int_id >= RTE_MAX_ETHPORTS)
+        return false;
+    distributed_ints[int_id] = true;
+    return true;
+}
+
+/**
+ * self function parses a list of lcores such as '1,3-5' and gives all of them
+ * the given role. Fails if an lcore already has another role.
+*/
+static bool parse_lcore_list(char *arg, thread_role role)
+{
+    char *ranges[RTE_MAX_LCORE], *end;
+    unsigned long first, last, lcore_id;
+    int i, nb_ranges = rte_strsplit(arg, strlen(arg) + 1, ranges, RTE_MAX_LCORE, ',');
+    if (nb_ranges <= 0)
+        return false;
+    for (i = 0; i < nb_ranges; i++)
     {
-        rte_pktmbuf_free(buf);
-        return;
+        errno = 0;
+        first = last = strtoul(ranges[i], &end, 10);
+        if (errno != 0 || end == ranges[i])
+            return false;
+        if (*end == '-')
+        {
+            const char *begin = end + 1;
+            last = strtoul(begin, &end, 10);
+            if (errno != 0 || end == begin)
+                return false;
+        }
+        if (*end != '\0' || first > last || last >= RTE_MAX_LCORE)
+            return false;
+        for (lcore_id = first; lcore_id <= last; lcore_id++)
+        {
+            if (lcore_roles[lcore_id] != THREAD_ROLE_RUN_TO_COMPLETION)
+                return false;
+            lcore_roles[lcore_id] = role;
+        }
     }
-    // Get the next hop route entry.
-    struct routing_table_entry *next_hop = get_next_hop(rte_be_to_cpu_32(hdr->dst_addr));
-    thread_send_ipv4_packet(thr_conf, int_conf, buf, next_hop);
+    return true;
 }
 
 /**
- * Performs validity check on the fields of an ARP message. Currently
- * only mapping between MAC and IPv4 addresses are supported.
+ * self function parses the option '--pipeline' into the rx, worker and tx
+ * lcores of the pipeline, given as three colon separated lcore lists such as
+ * '1:2-4:5'.
 */
-static bool is_arp_msg_valid(struct arp_hdr *hdr, thread_config_ptr thr_conf)
+static bool parse_option_pipeline(const char *arg)
 {
-    // Check ARP hardware type (HTYPE).
-    if (rte_be_to_cpu_16(hdr->arp_hrd) != ARP_HRD_ETHER || hdr->arp_hln != 6)
+    enum pipeline_field
     {
+        FLD_RX = 0,
+        FLD_WORKER,
+        FLD_TX,
+        NUM_FLD
+    };
+    static const thread_role roles[NUM_FLD] = {THREAD_ROLE_RX, THREAD_ROLE_WORKER, THREAD_ROLE_TX};
+    char str[MAX_STR_LEN];
+    char *str_fld[NUM_FLD];
+    int i;
+
+    memset(lcore_roles, 0, sizeof(lcore_roles));
+    if (strlen(arg) >= MAX_STR_LEN)
         return false;
-    }
-    // Check ARP protocol type (PTYPE).
-    if (rte_be_to_cpu_16(hdr->arp_pro) != ETHER_TYPE_IPv4 || hdr->arp_pln != 4)
-    {
+    snprintf(str, MAX_STR_LEN, "%s", arg);
+    if (rte_strsplit(str, sizeof(str), str_fld, NUM_FLD, ':') != NUM_FLD)
         return false;
-    }
-    // Check if the target address belongs to any of our interfaces.
-    unsigned int i, sz = pointer_list_len(&int_confs);
-    for (i = 0; i < sz; i++)
+    for (i = 0; i < NUM_FLD; i++)
     {
-        interface_config_ptr int_conf = (interface_config_ptr)pointer_list_get(&int_confs, i);
-        if (int_conf->addr == rte_be_to_cpu_32(hdr->arp_data.arp_tip))
+        if (!parse_lcore_list(str_fld[i], roles[i]))
         {
-            return true;
+            memset(lcore_roles, 0, sizeof(lcore_roles));
+            return false;
         }
     }
-    return false;
+    pipeline_mode = true;
+    return true;
 }
 
 /**
- * self function handles arp request message inside an ethernet frame.
- * Sends back an arp reply with the hardware address of the protocol
- * address.
+ * self function parses a 16-bit unsigned decimal number, such as a descriptor ring size.
 */
-static void thread_handle_ether_arp_request(thread_config_ptr thr_conf, interface_config_ptr int_conf, struct rte_mbuf *buf)
+static bool parse_uint16_value(const char *str, uint16_t *res)
 {
-    struct arp_hdr *hdr = rte_pktmbuf_mtod_offset(
-        buf, struct arp_hdr *,
-        sizeof(struct ether_hdr));
-    // Swap destination and source MAC addresses.
-    struct ether_hdr *eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
-    ether_addr_copy(&eth->s_addr, &eth->d_addr);
-    ether_addr_copy(&int_conf->mac, &eth->s_addr);
-    // Change the op code to ARP reply.
-    hdr->arp_op = rte_cpu_to_be_16(ARP_OP_REPLY);
-    // Save sender mac and ip addresses.
-    ether_addr sender_mac;
-    ether_addr_copy(&hdr->arp_data.arp_sha, &sender_mac);
-    ipv4_addr sender_ip = hdr->arp_data.arp_sip;
-    // Set sender mac and ip addresses to our addresses.
-    ether_addr_copy(&int_conf->mac, &hdr->arp_data.arp_sha);
-    hdr->arp_data.arp_sip = hdr->arp_data.arp_tip;
-    // Set the target addresses from the previous sender addresses.
-    ether_addr_copy(&sender_mac, &hdr->arp_data.arp_tha);
-    hdr->arp_data.arp_tip = sender_ip;
-    // Send the ARP message.
-    unsigned int i;
-    for (i = 0; i < MAX_TRANSMIT_TRIAL; i++)
-        if (rte_eth_tx_burst(int_conf->int_id, thr_conf->q_id, &buf, 1))
-            break;
-    if (i >= MAX_TRANSMIT_TRIAL)
-        rte_pktmbuf_free(buf);
+    char *end;
+    errno = 0;
+    unsigned long value = strtoul(str, &end, 10);
+    if (errno != 0 || end == str || *end != '\0' || value > UINT16_MAX)
+        return false;
+    *res = (uint16_t)value;
+    return true;
 }
 
 /**
- * self function handles arp message inside an ethernet frame. Currently
- * only supports MAC and IPv4 address resolution.
+ * self function parses a 32-bit unsigned decimal number, such as a rate or a size.
 */
-static void thread_handle_ether_arp(thread_config_ptr thr_conf, interface_config_ptr int_conf, struct rte_mbuf *buf)
+static bool parse_uint32_value(const char *str, uint32_t *res)
 {
-    struct arp_hdr *hdr = rte_pktmbuf_mtod_offset(
-        buf, struct arp_hdr *,
-        sizeof(struct ether_hdr));
-    // Check if the arp message is valid.
-    if (!is_arp_msg_valid(hdr, thr_conf))
-    {
-        rte_pktmbuf_free(buf);
-        return;
-    }
-    // Check and handle the operation type, if possible.
-    switch (rte_be_to_cpu_16(hdr->arp_op))
-    {
-    case ARP_OP_REQUEST:
-        thread_handle_ether_arp_request(thr_conf, int_conf, buf);
-        break;
-    default:
-        rte_pktmbuf_free(buf);
-        return;
-    }
+    char *end;
+    errno = 0;
+    unsigned long value = strtoul(str, &end, 10);
+    if (errno != 0 || end == str || *end != '\0' || value > UINT32_MAX)
+        return false;
+    *res = (uint32_t)value;
+    return true;
 }
 
 /**
- * Checks if the frame can be further processed without worrying about the length
- * and the destination MAC address.
+ * self function parses the option '--ring-size' into the number of slots of
+ * the pipeline rings, which must be a power of 2 that can hold a few bursts.
 */
-static bool is_frame_valid(struct rte_mbuf *buf, interface_config_ptr int_conf)
+static bool parse_option_ring_size(const char *arg)
 {
-    // Check if the frame is too short.
-    if (buf->pkt_len < ETHER_HDR_LEN)
-        return false;
-    // Check if the frame was destined to us.
-    struct ether_hdr *eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
-    if (!is_broadcast_ether_addr(&eth->d_addr) && !is_same_ether_addr(&eth->d_addr, &int_conf->mac))
-        return false;
-    // Check if the frame has a recognized payload type.
-    uint16_t ether_type = rte_be_to_cpu_16(rte_pktmbuf_mtod(buf, struct ether_hdr *)->ether_type);
-    uint32_t min_payload_len = 0;
-    switch (ether_type)
-    {
-    case ETHER_TYPE_IPv4:
-        min_payload_len = sizeof(struct ipv4_hdr);
-        break;
-    case ETHER_TYPE_IPv6:
-        min_payload_len = sizeof(struct ipv6_hdr);
-        break;
-    case ETHER_TYPE_ARP:
-        min_payload_len = sizeof(struct arp_hdr);
-        break;
-    default:
-        return false;
-    }
-    // Check if the frame is too short given the payload type.
-    if (buf->pkt_len < ETHER_HDR_LEN + min_payload_len)
-        return false;
-    // Check if the frame is too long.
-    if (buf->pkt_len > ETHER_MAX_LEN - ETHER_CRC_LEN)
-        return false;
-    // Everything seems fine.
-    return true;
+    uint32_t size;
+    return parse_uint32_value(arg, &size) && pipeline_set_ring_size(size);
 }
 
 /**
- * self function checks each layer 2 frame for its type and if it knows
- * how to handle the frame, it is further processed. Otherwise, the frame
- * is discarded and freed.
+ * self function names a DPDK object of this instance. A hot restarted instance
+ * runs next to the old one for a moment, so its names get their own prefix.
 */
-static void thread_handle_frames(
-    thread_config_ptr thr_conf, interface_config_ptr int_conf,
-    struct rte_mbuf *bufs[MAX_BURST_SIZE], uint16_t rx)
+static void object_name(char *name, size_t size, const char *fmt, ...)
 {
+    va_list args;
+    int len = snprintf(name, size, "%s", rte_eal_process_type() == RTE_PROC_SECONDARY ? "hr_" : "");
+    va_start(args, fmt);
+    vsnprintf(name + len, size - (size_t)len, fmt, args);
+    va_end(args);
+}
+
+/**
+ * self function parses the window of the reorder buffers in frames.
+*/
+static bool parse_option_reorder_size(const char *arg)
+{
+    uint32_t size;
+    if (!parse_uint32_value(arg, &size))
+        return false;
+    if (size < 4 * MAX_BURST_SIZE || size > RTE_RING_SZ_MASK || !rte_is_power_of_2(size))
+        return false;
+    reorder_size = size;
+    return true;
+}
+
+/**
+ * self function parses the time a thread waits for overdue frames in microseconds.
+*/
+static bool parse_option_reorder_timeout(const char *arg)
+{
+    uint32_t us;
+    if (!parse_uint32_value(arg, &us) || us == 0)
+        return false;
+    reorder_timeout_us = us;
+    return true;
+}
+
+/**
+ * self function parses the number of ICMP errors every thread sends per second at most.
+*/
+static bool parse_option_icmp_rate(const char *arg)
+{
+    uint32_t rate;
+    if (!parse_uint32_value(arg, &rate))
+        return false;
+    icmp_rate = rate;
+    return true;
+}
+
+/**
+ * self function parses the option '--descs' as 'port,rx descs,tx descs[,tx free threshold,tx rs threshold]'.
+*/
+static bool parse_option_descs(const char *arg)
+{
+    enum descs_field
+    {
+        FLD_PORT = 0,
+        FLD_RX_DESCS,
+        FLD_TX_DESCS,
+        FLD_TX_FREE_THRESH,
+        FLD_TX_RS_THRESH,
+        NUM_FLD
+    };
+    char str[MAX_STR_LEN];
+    char *str_fld[NUM_FLD];
+    uint16_t int_fld[NUM_FLD] = {0};
+    int i, nb_fld;
+
+    if (strlen(arg) >= MAX_STR_LEN)
+        return false;
+    snprintf(str, MAX_STR_LEN, "%s", arg);
+    nb_fld = rte_strsplit(str, sizeof(str), str_fld, NUM_FLD, ',');
+    if (nb_fld != FLD_TX_FREE_THRESH && nb_fld != NUM_FLD)
+        return false;
+    for (i = 0; i < nb_fld; i++)
+        if (!parse_uint16_value(str_fld[i], &int_fld[i]))
+            return false;
+    if (int_fld[FLD_PORT] > DPDK_MAX_INTERFACE_VAL || int_fld[FLD_PORT] >= RTE_MAX_ETHPORTS)
+        return false;
+    device_descs descs = {int_fld[FLD_RX_DESCS], int_fld[FLD_TX_DESCS], int_fld[FLD_TX_FREE_THRESH], int_fld[FLD_TX_RS_THRESH]};
+    set_device_descs((uint8_t)int_fld[FLD_PORT], &descs);
+    return true;
+}
+
+/**
+ * self function reads the descriptor ring sizes and tx thresholds of the ports
+ * from a file with a section per port:
+ *
+ *     [port0]
+ *     rx_descs = 1024
+ *     tx_descs = 1024
+ *     tx_free_thresh = 32
+ *     tx_rs_thresh = 32
+ *
+ * Missing entries keep their defaults.
+*/
+static bool parse_option_descs_file(const char *arg)
+{
+    static const char *entries[] = {"rx_descs", "tx_descs", "tx_free_thresh", "tx_rs_thresh"};
+    char section[32];
+    unsigned int port_id, i;
+    bool valid = true;
+
+    struct rte_cfgfile *cfg = rte_cfgfile_load(arg, 0);
+    if (cfg == NULL)
+    {
+        printf("could not read the descriptor file %s.\n", arg);
+        return false;
+    }
+    for (port_id = 0; port_id < RTE_MAX_ETHPORTS && valid; port_id++)
+    {
+        snprintf(section, sizeof(section), "port%u", port_id);
+        if (!rte_cfgfile_has_section(cfg, section))
+            continue;
+        uint16_t values[RTE_DIM(entries)] = {0};
+        for (i = 0; i < RTE_DIM(entries) && valid; i++)
+        {
+            const char *value = rte_cfgfile_get_entry(cfg, section, entries[i]);
+            if (value != NULL && !parse_uint16_value(value, &values[i]))
+            {
+                printf("invalid %s of [%s] in %s.\n", entries[i], section, arg);
+                valid = false;
+            }
+        }
+        device_descs descs = {values[0], values[1], values[2], values[3]};
+        set_device_descs((uint8_t)port_id, &descs);
+    }
+    rte_cfgfile_close(cfg);
+    return valid;
+}
+
+/**
+ * self function parses the option '--mtu' as 'port,mtu'.
+*/
+static bool parse_option_mtu(const char *arg)
+{
+    char str[MAX_STR_LEN];
+    char *str_fld[2];
+    uint16_t int_fld[2];
+    int i;
+
+    if (strlen(arg) >= MAX_STR_LEN)
+        return false;
+    snprintf(str, MAX_STR_LEN, "%s", arg);
+    if (rte_strsplit(str, sizeof(str), str_fld, 2, ',') != 2)
+        return false;
+    for (i = 0; i < 2; i++)
+        if (!parse_uint16_value(str_fld[i], &int_fld[i]))
+            return false;
+    if (int_fld[0] > DPDK_MAX_INTERFACE_VAL || int_fld[0] >= RTE_MAX_ETHPORTS || int_fld[1] < ETHER_MIN_MTU)
+        return false;
+    set_device_mtu((uint8_t)int_fld[0], int_fld[1]);
+    return true;
+}
+
+/**
+ * self function parses the option '--qos' as 'port,rate[,pipes[,queue size]]': the
+ * rate of the egress interface in bytes per second, the number of pipes its
+ * destinations are hashed to and the frames each queue of a pipe holds (both
+ * powers of 2).
+*/
+static bool parse_option_qos(const char *arg)
+{
+    enum qos_field
+    {
+        FLD_PORT = 0,
+        FLD_RATE,
+        FLD_PIPES,
+        FLD_QUEUE_SIZE,
+        NUM_FLD
+    };
+    char str[MAX_STR_LEN];
+    char *str_fld[NUM_FLD];
+    uint64_t int_fld[NUM_FLD] = {0, 0, QOS_DEFAULT_PIPES, QOS_DEFAULT_QUEUE_SIZE};
+    int i, nb_fld;
+    char *end;
+
+    if (strlen(arg) >= MAX_STR_LEN)
+        return false;
+    snprintf(str, MAX_STR_LEN, "%s", arg);
+    nb_fld = rte_strsplit(str, sizeof(str), str_fld, NUM_FLD, ',');
+    if (nb_fld < FLD_PIPES)
+        return false;
+    for (i = 0; i < nb_fld; i++)
+    {
+        errno = 0;
+        int_fld[i] = strtoull(str_fld[i], &end, 10);
+        if (errno != 0 || end == str_fld[i] || *end != '\0' || !are_all_char_decimal(str_fld[i]))
+            return false;
+    }
+    if (int_fld[FLD_PORT] > DPDK_MAX_INTERFACE_VAL || int_fld[FLD_PORT] >= RTE_MAX_ETHPORTS ||
+        int_fld[FLD_RATE] == 0 || int_fld[FLD_RATE] > UINT32_MAX)
+        return false;
+    if (int_fld[FLD_PIPES] > UINT32_MAX || int_fld[FLD_QUEUE_SIZE] > UINT32_MAX ||
+        !qos_add((dpdk_interface)int_fld[FLD_PORT], (uint32_t)int_fld[FLD_RATE], (uint32_t)int_fld[FLD_PIPES], (uint32_t)int_fld[FLD_QUEUE_SIZE]))
+        return false;
+    qos_mode = true;
+    return true;
+}
+
+/**
+ * self function parses the option '--qos-dscp' as 'dscp,tc'.
+*/
+static bool parse_option_qos_dscp(const char *arg)
+{
+    char str[MAX_STR_LEN];
+    char *str_fld[2];
+    uint16_t int_fld[2];
+    int i;
+
+    if (strlen(arg) >= MAX_STR_LEN)
+        return false;
+    snprintf(str, MAX_STR_LEN, "%s", arg);
+    if (rte_strsplit(str, sizeof(str), str_fld, 2, ',') != 2)
+        return false;
+    for (i = 0; i < 2; i++)
+        if (!parse_uint16_value(str_fld[i], &int_fld[i]))
+            return false;
+    return qos_set_dscp_class(int_fld[0], int_fld[1]);
+}
+
+/**
+ * self function parses the data room of the mbufs in bytes.
+*/
+static bool parse_option_mbuf_size(const char *arg)
+{
+    uint16_t size;
+    if (!parse_uint16_value(arg, &size) || size < ETHER_MIN_LEN || size > UINT16_MAX - RTE_PKTMBUF_HEADROOM)
+        return false;
+    set_mbuf_size(size);
+    return true;
+}
+
+/**
+ * self function parses the number of mbufs of the pool of every socket.
+*/
+static bool parse_option_mbufs(const char *arg)
+{
+    uint32_t mbufs;
+    if (!parse_uint32_value(arg, &mbufs) || mbufs == 0 || mbufs > UINT32_MAX / 2)
+        return false;
+    nb_mbufs = mbufs;
+    return true;
+}
+
+/**
+ * self function parses the interval of the work stealing, mempool and ICMP statistics in seconds.
+*/
+static bool parse_option_stats(const char *arg)
+{
+    uint32_t secs;
+    if (!parse_uint32_value(arg, &secs))
+        return false;
+    stats_interval = secs;
+    return true;
+}
+
+/**
+ * self function finds the configuration of the given interface, or NULL if
+ * the interface is not attached to the router.
+*/
+static interface_config_ptr find_interface_config(dpdk_interface int_id)
+{
+    unsigned int i, len = pointer_list_len(&int_confs);
+    for (i = 0; i < len; i++)
+    {
+        interface_config_ptr int_conf = (interface_config_ptr)pointer_list_get(&int_confs, i);
+        if (int_conf->int_id == int_id)
+            return int_conf;
+    }
+    return NULL;
+}
+
+/**
+ * self function finds the configuration of the given interface or, if 'vlan_id'
+ * is not 0, of the given VLAN sub-interface of it. NULL if there is none.
+*/
+static interface_config_ptr find_vlan_interface_config(dpdk_interface int_id, uint16_t vlan_id)
+{
+    if (vlan_id == 0)
+        return find_interface_config(int_id);
+    return vlan_ints[int_id] == NULL ? NULL : vlan_ints[int_id][vlan_id];
+}
+
+/**
+ * self function adds a VLAN sub-interface to the VLAN table of its port, which
+ * must have been given with '-p' before. Returns false on error.
+*/
+static bool add_vlan_interface(interface_config_ptr int_conf)
+{
+    dpdk_interface int_id = int_conf->int_id;
+    interface_config_ptr port_conf = find_interface_config(int_id);
+    if (port_conf == NULL)
+    {
+        printf("interface id %d must be given with -p before its VLANs.\n", int_id);
+        return false;
+    }
+    if (vlan_ints[int_id] == NULL)
+    {
+        vlan_ints[int_id] = (interface_config_ptr *)calloc(VLAN_IDS, sizeof(interface_config_ptr));
+        if (vlan_ints[int_id] == NULL)
+        {
+            printf("could not allocate the VLAN table of interface id %d.\n", int_id);
+            return false;
+        }
+        // Priority tagged frames belong to the port itself.
+        vlan_ints[int_id][0] = port_conf;
+        set_device_vlans(int_id);
+    }
+    vlan_ints[int_id][int_conf->vlan_id] = int_conf;
+    pointer_list_append(&vlan_confs, (generic_ptr)int_conf);
+    return true;
+}
+
+/**
+ * self function adds the address of an interface to the local addresses.
+ * Returns false if there are too many.
+*/
+static bool add_local_addr(interface_config_ptr int_conf)
+{
+    if (nb_local_addrs >= MAX_LOCAL_ADDRS)
+        return false;
+    local_addrs[nb_local_addrs] = rte_cpu_to_be_32(int_conf->addr);
+    local_ints[nb_local_addrs++] = int_conf;
+    return true;
+}
+
+/**
+ * self function returns the interface (or VLAN sub-interface) the given
+ * address (in network byte order) belongs to, or NULL if it is not a local address.
+*/
+static inline interface_config_ptr find_local_addr(ipv4_addr addr)
+{
+    xmm_t key = _mm_set1_epi32((int)addr);
+    unsigned int i;
+    for (i = 0; i < nb_local_addrs; i += 4)
+    {
+        xmm_t addrs = _mm_load_si128((const xmm_t *)&local_addrs[i]);
+        unsigned int mask = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(key, addrs)));
+        // The unused slots after the last address must not match.
+        if (mask != 0 && i + __builtin_ctz(mask) < nb_local_addrs)
+            return local_ints[i + __builtin_ctz(mask)];
+    }
+    return NULL;
+}
+
+/**
+ * self function re-reads the MAC address of an interface from the device and
+ * refreshes the L2 templates of every adjacency egressing it.
+*/
+static void refresh_interface_mac(interface_config_ptr int_conf)
+{
+    unsigned int i;
+    rte_eth_macaddr_get(int_conf->int_id, &int_conf->mac);
+    set_port_mac(int_conf->int_id, &int_conf->mac);
+    // The VLAN sub-interfaces share the MAC address of their port.
+    for (i = 0; i < pointer_list_len(&vlan_confs); i++)
+    {
+        interface_config_ptr vlan_conf = (interface_config_ptr)pointer_list_get(&vlan_confs, i);
+        if (vlan_conf->int_id == int_conf->int_id)
+            ether_addr_copy(&int_conf->mac, &vlan_conf->mac);
+    }
+}
+
+/**
+ * self function changes the MAC address of an attached interface. The adjacency
+ * templates are refreshed so that forwarding picks up the new source MAC.
+*/
+int router_set_interface_mac(dpdk_interface int_id, ether_addr *mac)
+{
+    interface_config_ptr int_conf = find_interface_config(int_id);
+    if (int_conf == NULL)
+        return -1;
+    int status = rte_eth_dev_default_mac_addr_set(int_id, mac);
+    if (status != 0)
+        return status;
+    refresh_interface_mac(int_conf);
+    return 0;
+}
+
+/** 
+ * Usage of applicaiton
+ */
+static void usage()
+{
+    printf(
+        "-p for specifying a DPDK interface and the corresponding IP address to attach self router program (comma separated),\n"
+        "   as 'port,ip' or 'port.vlan,ip' for a VLAN sub-interface of a port given before.\n"
+        "-r for specifying a routing entry which will be used for forwarding IP packets on attached interfaces (comma separated),\n"
+        "   as 'ip/cidr,mac,port' or 'ip/cidr,gateway ip,port' to resolve the MAC address of the gateway with ARP,\n"
+        "   with 'port.vlan' for a VLAN sub-interface, optionally followed by ',meter' to police the route with a meter of '--meter'.\n"
+        "-i for specifying the idle policy of the lcores, 'latency' (default, busy polling) or 'power' (rx interrupts and frequency scaling).\n"
+        "--config for specifying which lcore polls which rx queue of an interface, as '(port,queue,lcore)[,(port,queue,lcore)...]'.\n"
+        "--vswitch for making every lcore poll all rx queues of its interfaces (work-around for the ACN virtual switch).\n"
+        "--distribute for polling a single rx queue of an interface and spreading its flows over all other lcores in software (repeatable).\n"
+        "--pipeline for splitting rx, processing and tx over dedicated lcores, as 'rx lcores:worker lcores:tx lcores' (e.g. '1:2-4:5').\n"
+        "--ring-size for specifying the number of slots of the rings between the pipeline stages (power of 2, default 1024).\n"
+        "--eventdev for scheduling the frames of the pipeline rx lcores to the workers with the software event device.\n"
+        "--steal for letting idle lcores steal the surplus frames of backlogged ones.\n"
+        "--steal-reorder for work stealing that restores the order of the frames of every lcore before transmitting.\n"
+        "--reorder-size for specifying the window of the reorder buffers of '--steal-reorder' in frames (power of 2, default 2048).\n"
+        "--reorder-timeout for specifying how long '--steal-reorder' waits for an overdue frame in microseconds (default 100).\n"
+        "--stats for printing the work stealing, mempool and ICMP statistics every given number of seconds (default: only at exit).\n"
+        "--descs for specifying the rx and tx descriptors per queue of an interface and optionally its tx free and rs thresholds, as 'port,rx,tx[,free,rs]' (repeatable).\n"
+        "--descs-file for reading the descriptors and tx thresholds of the interfaces from a file with a '[portN]' section per interface.\n"
+        "--mtu for specifying the MTU of an interface, as 'port,mtu' (repeatable, default 1500).\n"
+        "--mbuf-size for specifying the data room of the mbufs in bytes, larger frames are received scattered (default 1600).\n"
+        "--mbufs for specifying the number of mbufs of the pool of every socket (default: sized from the queues and rings).\n"
+        "--icmp-rate for specifying how many ICMP errors every lcore sends per second at most (0 for none, default 1000).\n"
+        "--meter for specifying a two rate three color meter to police routes with, as 'id,cir,cbs,pir,pbs[,drop|mark]'\n"
+        "   (rates in bytes per second, burst sizes in bytes up to 2^30, ids from 1 to 255), red packets are dropped or ECN marked.\n"
+        "--acl for filtering the IPv4 packets with the permit/deny rules of a file, reloaded on SIGHUP (see README).\n"
+        "--qos for scheduling the frames of an egress interface with a tx lcore of '--pipeline', as 'port,rate[,pipes[,queue size]]'\n"
+        "   (rate in bytes per second, pipes and queue size powers of 2, default 16 and 64; repeatable).\n"
+        "--qos-dscp for mapping a DSCP value to a traffic class of the schedulers, as 'dscp,tc' (tc 0 highest to 3 best effort; repeatable).\n"
+        "Started with the same arguments while the router runs, a new instance takes over its interfaces (hot restart, see README).\n"
+        "   Only the first instance can be hot restarted, the next restart has to stop the router and start it again.\n");
+}
+
+/**
+ * Performs ipv4 header validity checks that have not been already done,
+ * according to https://tools.ietf.org/html/rfc1812#section-5.2.2 .
+*/
+static bool is_ipv4_hdr_valid(struct ipv4_hdr *hdr, uint32_t payload_size)
+{
+    // Check if the checksum is correct.
+    uint16_t checksum = hdr->hdr_checksum;
+    hdr->hdr_checksum = 0;
+    uint16_t calc_chksm = rte_ipv4_cksum(hdr);
+    // Put it back, packets answered in place only patch it.
+    hdr->hdr_checksum = checksum;
+    if (calc_chksm != checksum)
+        return false;
+    // Check if the ip version is 4.
+    uint8_t version = (hdr->version_ihl & IPV4_HDR_VER_MASK) >> IPV4_HDR_VER_BIT_OFFSET;
+    if (version != 4)
+        return false;
+    // Check if the header length is at least 20 bytes.
+    uint8_t ihl = (hdr->version_ihl & IPV4_HDR_IHL_MASK);
+    if (ihl < 5)
+        return false;
+    // Check if the datagram length is enough to hold the header.
+    uint16_t tot_len = rte_be_to_cpu_16(hdr->total_length);
+    if (tot_len < IPV4_IHL_MULTIPLIER * ihl)
+        return false;
+
+    // Additionally check if the total length reported by the ipv4 header is no more than the frame payload size.
+    if ((uint32_t)tot_len > payload_size)
+        return false;
+    // Check if the TTL is zero (it must not be).
+    if (hdr->time_to_live == 0)
+        return false;
+    return true;
+}
+
+/**
+ * self function transmits a burst of frames on a tx queue of an interface and
+ * frees the frames that could not be sent.
+*/
+static void transmit_frames(dpdk_interface int_id, dpdk_queue q_id, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    uint16_t sent = 0;
+    unsigned int i;
+    for (i = 0; i < MAX_TRANSMIT_TRIAL && sent < nb_bufs; i++)
+        sent += rte_eth_tx_burst(int_id, q_id, bufs + sent, nb_bufs - sent);
+    if (unlikely(sent < nb_bufs))
+        __sync_fetch_and_add(&tx_drops[int_id], nb_bufs - sent);
+    for (; sent < nb_bufs; sent++)
+        rte_pktmbuf_free(bufs[sent]);
+}
+
+/**
+ * self function tags a frame for the VLAN sub-interface 'vlan_id' of its
+ * egress interface. The NIC inserts the tag if it can, otherwise it is pushed
+ * here ('rte_vlan_insert' refuses the frames shared with their owner under
+ * '--steal-reorder'). Returns false if the frame has no headroom for the tag.
+*/
+static inline bool tag_frame(struct rte_mbuf *buf, dpdk_interface int_id, uint16_t vlan_id)
+{
+    if (vlan_insert[int_id])
+    {
+        buf->vlan_tci = vlan_id;
+        buf->ol_flags |= PKT_TX_VLAN_PKT;
+        return true;
+    }
+    struct ether_hdr *eth = (struct ether_hdr *)rte_pktmbuf_prepend(buf, sizeof(struct vlan_hdr));
+    if (eth == NULL)
+        return false;
+    // Move the MAC addresses in front of the tag, the ether type of the payload stays behind it.
+    memmove(eth, (uint8_t *)eth + sizeof(struct vlan_hdr), 2 * ETHER_ADDR_LEN);
+    eth->ether_type = rte_cpu_to_be_16(ETHER_TYPE_VLAN);
+    ((struct vlan_hdr *)(eth + 1))->vlan_tci = rte_cpu_to_be_16(vlan_id);
+    return true;
+}
+
+/**
+ * self function transmits a frame on the given interface, tagged for its VLAN
+ * sub-interface 'vlan_id' unless it is 0. A pipeline worker does not own tx
+ * queues, it buffers the frame for its tx thread instead.
+*/
+static void thread_transmit_frame(thread_config_ptr thr_conf, dpdk_interface int_id, uint16_t vlan_id, struct rte_mbuf *buf)
+{
+    if (unlikely(vlan_id != 0) && !tag_frame(buf, int_id, vlan_id))
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    // The frame is transmitted once it is back in order (see 'thread_process_frames').
+    if (thr_conf->defer_tx)
+    {
+        buf->port = int_id;
+        return;
+    }
+    if (thr_conf->role == THREAD_ROLE_WORKER)
+    {
+        buf->port = int_id;
+        pipeline_buffer_frame(&thr_conf->pipeline, buf);
+        return;
+    }
+    transmit_frames(int_id, thr_conf->q_id, &buf, 1);
+}
+
+/**
+ * self function sends (or drops) the frames held for a neighbor. The frames
+ * already went through the forwarding, only their ethernet header is missing.
+*/
+static void thread_release_held_frames(thread_config_ptr thr_conf, neighbor_ptr nb, bool send)
+{
+    struct rte_mbuf *bufs[MAX_BURST_SIZE];
+    interface_config_ptr int_conf = find_interface_config(nb->int_id);
+    unsigned int i, nb_bufs;
+    // Held frames have no place in the order of stolen frames ('--steal-reorder').
+    bool defer_tx = thr_conf->defer_tx;
+    thr_conf->defer_tx = false;
+    while ((nb_bufs = neighbor_release(nb, bufs, MAX_BURST_SIZE)) > 0)
+    {
+        for (i = 0; i < nb_bufs; i++)
+        {
+            if (!send || int_conf == NULL)
+            {
+                rte_pktmbuf_free(bufs[i]);
+                continue;
+            }
+            struct ether_hdr *eth = rte_pktmbuf_mtod(bufs[i], struct ether_hdr *);
+            ether_addr_copy(&nb->mac, &eth->d_addr);
+            ether_addr_copy(&int_conf->mac, &eth->s_addr);
+            eth->ether_type = rte_cpu_to_be_16(ETHER_TYPE_IPv4);
+            thread_transmit_frame(thr_conf, nb->int_id, nb->vlan_id, bufs[i]);
+        }
+    }
+    thr_conf->defer_tx = defer_tx;
+}
+
+/**
+ * self function holds a frame until the gateway of its next hop is resolved.
+*/
+static void thread_hold_frame(thread_config_ptr thr_conf, struct routing_table_entry *next_hop, struct rte_mbuf *buf)
+{
+    neighbor_ptr nb = neighbor_lookup(next_hop->gateway);
+    // With '--steal-reorder' a frame must keep its place in the order, so it is not held.
+    if (nb == NULL || thr_conf->defer_tx || !neighbor_hold(nb, buf))
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    // The gateway might have been resolved meanwhile, then nobody else releases the frame.
+    if (next_hop->resolved)
+        thread_release_held_frames(thr_conf, nb, true);
+}
+
+/**
+ * self function takes the MAC address a neighbor answered with (or announced)
+ * over into the adjacencies of all routes via it and sends the frames held for it.
+*/
+static void thread_confirm_neighbor(thread_config_ptr thr_conf, neighbor_ptr nb, ether_addr *mac)
+{
+    if (!neighbor_confirm(nb, mac))
+        return;
+    set_gateway_mac(nb->addr, mac);
+    thread_release_held_frames(thr_conf, nb, true);
+}
+
+/**
+ * self function broadcasts an ARP request for a neighbor on its interface (or
+ * VLAN sub-interface), from the address of that interface.
+*/
+static void thread_send_arp_request(thread_config_ptr thr_conf, neighbor_ptr nb)
+{
+    interface_config_ptr int_conf = find_vlan_interface_config(nb->int_id, nb->vlan_id);
+    struct rte_mbuf *buf = rte_pktmbuf_alloc(get_mempool((int)rte_socket_id()));
+    if (int_conf == NULL || buf == NULL)
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    struct ether_hdr *eth = (struct ether_hdr *)rte_pktmbuf_append(buf, sizeof(struct ether_hdr) + sizeof(struct arp_hdr));
+    memset(&eth->d_addr, 0xff, sizeof(eth->d_addr));
+    ether_addr_copy(&int_conf->mac, &eth->s_addr);
+    eth->ether_type = rte_cpu_to_be_16(ETHER_TYPE_ARP);
+    struct arp_hdr *hdr = (struct arp_hdr *)(eth + 1);
+    hdr->arp_hrd = rte_cpu_to_be_16(ARP_HRD_ETHER);
+    hdr->arp_pro = rte_cpu_to_be_16(ETHER_TYPE_IPv4);
+    hdr->arp_hln = ETHER_ADDR_LEN;
+    hdr->arp_pln = sizeof(ipv4_addr);
+    hdr->arp_op = rte_cpu_to_be_16(ARP_OP_REQUEST);
+    ether_addr_copy(&int_conf->mac, &hdr->arp_data.arp_sha);
+    hdr->arp_data.arp_sip = rte_cpu_to_be_32(int_conf->addr);
+    memset(&hdr->arp_data.arp_tha, 0, sizeof(hdr->arp_data.arp_tha));
+    hdr->arp_data.arp_tip = rte_cpu_to_be_32(nb->addr);
+    thread_transmit_frame(thr_conf, nb->int_id, nb->vlan_id, buf);
+}
+
+/**
+ * self function resolves the neighbors, refreshes them before they expire and
+ * gives up on the ones that do not answer. Runs on a single thread.
+*/
+static void thread_tick_neighbors(thread_config_ptr thr_conf)
+{
+    uint64_t now = rte_get_timer_cycles();
+    unsigned int i;
+    if (!thr_conf->ticks_neighbors || now < thr_conf->next_neighbor_tick)
+        return;
+    thr_conf->next_neighbor_tick = now + rte_get_timer_hz() * NEIGHBOR_TICK_MS / 1000;
+    // The requests are not part of the order of stolen frames ('--steal-reorder').
+    bool defer_tx = thr_conf->defer_tx;
+    thr_conf->defer_tx = false;
+    for (i = 0; i < neighbor_count(); i++)
+    {
+        neighbor_ptr nb = neighbor_get(i);
+        switch (neighbor_timeout(nb, now))
+        {
+        case NEIGHBOR_ACTION_REQUEST:
+            thread_send_arp_request(thr_conf, nb);
+            break;
+        case NEIGHBOR_ACTION_EXPIRE:
+            // Frames to it are held again until it answers.
+            clear_gateway_mac(nb->addr);
+            break;
+        case NEIGHBOR_ACTION_FAIL:
+            printf("gateway 0x%08x on interface id %d does not answer.\n", nb->addr, nb->int_id);
+            thread_release_held_frames(thr_conf, nb, false);
+            break;
+        default:
+            break;
+        }
+    }
+    thr_conf->defer_tx = defer_tx;
+}
+
+/**
+ * self function splits a packet that exceeds the MTU of the egress interface
+ * 'int_id' into fragments and sends them (tagged for 'vlan_id' if not 0), to
+ * the given next hop or, without one, with the ethernet header of the packet. The payload is not copied: every
+ * fragment is a new ip header (and ethernet header) followed by indirect mbufs
+ * that reference the payload of the packet. The time spent is counted, to
+ * tell the cost of fragmentation per packet.
+*/
+static void thread_send_fragments(thread_config_ptr thr_conf, struct rte_mbuf *buf, dpdk_interface int_id,
+                                  uint16_t vlan_id, struct routing_table_entry *next_hop)
+{
+    struct rte_mbuf *frags[MAX_FRAGMENTS];
+    uint64_t start = rte_rdtsc();
+    int socket_id = (int)rte_socket_id();
+    int32_t i, nb_frags = -EINVAL;
+    struct ether_hdr eth_hdr = *rte_pktmbuf_mtod(buf, struct ether_hdr *);
+    struct ipv4_hdr *hdr = rte_pktmbuf_mtod_offset(
+        buf, struct ipv4_hdr *,
+        sizeof(struct ether_hdr));
+    // The fragments cannot be sent in the place of the packet ('--steal-reorder'), and
+    // 'rte_ipv4_fragment_packet' does not copy ip options into the fragments.
+    if (!thr_conf->defer_tx && (hdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER == sizeof(struct ipv4_hdr))
+    {
+        rte_pktmbuf_adj(buf, sizeof(struct ether_hdr));
+        nb_frags = rte_ipv4_fragment_packet(buf, frags, MAX_FRAGMENTS, (uint16_t)(max_frame_lens[int_id] - ETHER_HDR_LEN),
+                                            get_mempool(socket_id), get_indirect_mempool(socket_id));
+    }
+    // The fragments hold their own references to the payload.
+    rte_pktmbuf_free(buf);
+    if (nb_frags < 0)
+    {
+        thr_conf->frag_failures++;
+        return;
+    }
+    for (i = 0; i < nb_frags; i++)
+    {
+        struct ether_hdr *eth = (struct ether_hdr *)rte_pktmbuf_prepend(frags[i], sizeof(struct ether_hdr));
+        *eth = eth_hdr;
+        // The header checksum is left to the NIC, but not every NIC can.
+        hdr = (struct ipv4_hdr *)(eth + 1);
+        hdr->hdr_checksum = rte_ipv4_cksum(hdr);
+        frags[i]->ol_flags &= ~PKT_TX_IP_CKSUM;
+        if (next_hop != NULL)
+        {
+            if (unlikely(!next_hop->resolved))
+            {
+                thread_hold_frame(thr_conf, next_hop, frags[i]);
+                continue;
+            }
+            l2_template_apply(next_hop, eth);
+        }
+        else
+        {
+            // Replies go back out of the interface the request came in on, which might
+            // not send chained frames; only routed packets make it do so.
+            rte_pktmbuf_linearize(frags[i]);
+        }
+        thread_transmit_frame(thr_conf, int_id, vlan_id, frags[i]);
+    }
+    thr_conf->frag_packets[int_id]++;
+    thr_conf->frag_fragments[int_id] += (uint64_t)nb_frags;
+    thr_conf->frag_cycles += rte_rdtsc() - start;
+}
+
+/**
+ * self function tells if an ICMP error may be sent about the given packet,
+ * according to https://tools.ietf.org/html/rfc1812#section-4.3.2.7 : not about
+ * an ICMP error, a fragment other than the first one, or a packet from or to
+ * an address that is not unicast.
+*/
+static bool is_icmp_error_allowed(struct ipv4_hdr *hdr, uint16_t quoted_len)
+{
+    uint32_t src = rte_be_to_cpu_32(hdr->src_addr), dst = rte_be_to_cpu_32(hdr->dst_addr);
+    uint16_t hdr_len = (hdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER;
+    if ((rte_be_to_cpu_16(hdr->fragment_offset) & IPV4_HDR_OFFSET_MASK) != 0)
+        return false;
+    // Unspecified, loopback, multicast and (limited) broadcast addresses.
+    if (src == 0 || (src >> 24) == 127 || src >= IPv4(224, 0, 0, 0) || dst >= IPv4(224, 0, 0, 0))
+        return false;
+    // Only ICMP queries (echo requests and the like) get an error.
+    if (hdr->next_proto_id == IPPROTO_ICMP)
+        return quoted_len > hdr_len && ICMP_INFOTYPE(*((uint8_t *)hdr + hdr_len));
+    return true;
+}
+
+/**
+ * self function takes a token from the bucket limiting the ICMP errors of the
+ * thread, so that floods of expiring or unroutable packets (traceroutes, scans)
+ * do not eat into the forwarding. Returns false if the bucket is empty.
+*/
+static bool thread_take_icmp_token(thread_config_ptr thr_conf)
+{
+    uint64_t now = rte_get_timer_cycles();
+    if (icmp_rate == 0)
+        return false;
+    thr_conf->icmp_credit = RTE_MIN(thr_conf->icmp_credit + (now - thr_conf->icmp_credit_tsc), icmp_burst_cycles);
+    thr_conf->icmp_credit_tsc = now;
+    if (thr_conf->icmp_credit < icmp_cost_cycles)
+    {
+        thr_conf->icmp_limited++;
+        return false;
+    }
+    thr_conf->icmp_credit -= icmp_cost_cycles;
+    return true;
+}
+
+/**
+ * self function sends an ICMP error about an ipv4 packet back to its source,
+ * from the address of the interface the packet came in on. The frame of the
+ * packet is reused: the quoted ip header and the first 8 bytes of the payload
+ * stay in place, the new headers are put in front of them. 'mtu' is the MTU
+ * of the next hop for 'fragmentation needed', 0 otherwise.
+*/
+static void thread_send_icmp_error(
+    thread_config_ptr thr_conf, interface_config_ptr int_conf,
+    struct rte_mbuf *buf, uint8_t type, uint8_t code, uint16_t mtu)
+{
+    struct ipv4_hdr *hdr = rte_pktmbuf_mtod_offset(
+        buf, struct ipv4_hdr *,
+        sizeof(struct ether_hdr));
+    uint16_t quoted_len = RTE_MIN((hdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER + 8,
+                                  rte_be_to_cpu_16(hdr->total_length));
+    if (buf->data_len < sizeof(struct ether_hdr) + quoted_len || !is_icmp_error_allowed(hdr, quoted_len) ||
+        !thread_take_icmp_token(thr_conf))
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    struct routing_table_entry *next_hop = get_next_hop(rte_be_to_cpu_32(hdr->src_addr));
+    if (next_hop == NULL)
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    ipv4_addr dst_addr = hdr->src_addr;
+    // Cut the frame after the quoted bytes (they are in the first segment) and make room for the new headers.
+    if (buf->next != NULL)
+    {
+        rte_pktmbuf_free(buf->next);
+        buf->next = NULL;
+        buf->nb_segs = 1;
+    }
+    buf->data_len = sizeof(struct ether_hdr) + quoted_len;
+    buf->pkt_len = buf->data_len;
+    if (rte_pktmbuf_prepend(buf, sizeof(struct ipv4_hdr) + sizeof(struct icmp_hdr)) == NULL)
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    // The new ip and ICMP headers overwrite the old ethernet header.
+    struct ether_hdr *eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+    struct ipv4_hdr *ip = (struct ipv4_hdr *)(eth + 1);
+    struct icmp_hdr *icmp = (struct icmp_hdr *)(ip + 1);
+    // Version 4, header without options.
+    ip->version_ihl = 0x45;
+    ip->type_of_service = 0;
+    ip->total_length = rte_cpu_to_be_16(sizeof(struct ipv4_hdr) + sizeof(struct icmp_hdr) + quoted_len);
+    ip->packet_id = 0;
+    ip->fragment_offset = 0;
+    ip->time_to_live = ICMP_TTL;
+    ip->next_proto_id = IPPROTO_ICMP;
+    ip->src_addr = rte_cpu_to_be_32(int_conf->addr);
+    ip->dst_addr = dst_addr;
+    ip->hdr_checksum = 0;
+    ip->hdr_checksum = rte_ipv4_cksum(ip);
+    icmp->icmp_type = type;
+    icmp->icmp_code = code;
+    // Unused, except for the MTU in the last 2 bytes for 'fragmentation needed' (RFC 1191).
+    icmp->icmp_ident = 0;
+    icmp->icmp_seq_nb = rte_cpu_to_be_16(mtu);
+    icmp->icmp_cksum = 0;
+    icmp->icmp_cksum = (uint16_t)~rte_raw_cksum(icmp, sizeof(struct icmp_hdr) + quoted_len);
+    thr_conf->icmp_errors++;
+    // Wait for the MAC address of the gateway, if it is not resolved yet.
+    if (unlikely(!next_hop->resolved))
+    {
+        thread_hold_frame(thr_conf, next_hop, buf);
+        return;
+    }
+    l2_template_apply(next_hop, eth);
+    thread_transmit_frame(thr_conf, next_hop->dst_port, next_hop->vlan_id, buf);
+}
+
+/**
+ * self function sends the ipv4 packet to the given next hop, given it is valid.
+*/
+static void thread_send_ipv4_packet(
+    thread_config_ptr thr_conf, interface_config_ptr int_conf,
+    struct rte_mbuf *buf, struct routing_table_entry *next_hop)
+{
+    // Make sure the next hop is valid.
+    if (next_hop == NULL)
+    {
+        thread_send_icmp_error(thr_conf, int_conf, buf, ICMP_DEST_UNREACH, ICMP_NET_UNREACH, 0);
+        return;
+    }
+    struct ipv4_hdr *hdr = rte_pktmbuf_mtod_offset(
+        buf, struct ipv4_hdr *,
+        sizeof(struct ether_hdr));
+    // Check the TTL before decrementing it, so that the errors quote the header as it was received.
+    if (hdr->time_to_live <= 1)
+    {
+        thread_send_icmp_error(thr_conf, int_conf, buf, ICMP_TIME_EXCEEDED, ICMP_EXC_TTL, 0);
+        return;
+    }
+    // Packets that exceed the MTU of the egress interface are fragmented, unless they must not be.
+    bool too_big = buf->pkt_len > max_frame_lens[next_hop->dst_port];
+    if (unlikely(too_big) && (hdr->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_DF_FLAG)))
+    {
+        thread_send_icmp_error(thr_conf, int_conf, buf, ICMP_DEST_UNREACH, ICMP_FRAG_NEEDED,
+                               (uint16_t)(max_frame_lens[next_hop->dst_port] - ETHER_HDR_LEN));
+        return;
+    }
+    // Police the packets of metered routes, the others never touch a meter.
+    if (unlikely(next_hop->meter_id != 0) && !meter_police(thr_conf->meters, next_hop->meter_id, hdr))
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    hdr->time_to_live--;
+    // Calculate the header checksum.
+    hdr->hdr_checksum = 0;
+    hdr->hdr_checksum = rte_ipv4_cksum(hdr);
+    if (unlikely(too_big))
+    {
+        thread_send_fragments(thr_conf, buf, next_hop->dst_port, next_hop->vlan_id, next_hop);
+        return;
+    }
+    // Wait for the MAC address of the gateway, if it is not resolved yet.
+    if (unlikely(!next_hop->resolved))
+    {
+        thread_hold_frame(thr_conf, next_hop, buf);
+        return;
+    }
+    // Set the destination and source MAC addresses from the adjacency template.
+    struct ether_hdr *eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+    l2_template_apply(next_hop, eth);
+    // Send the packet.
+    thread_transmit_frame(thr_conf, next_hop->dst_port, next_hop->vlan_id, buf);
+}
+
+/**
+ * self function answers an echo request to one of our addresses in place: the
+ * addresses are swapped, which leaves the checksums as they are, and the few
+ * changed header fields are patched into the checksums. The reply goes back
+ * out of the interface the request came in on.
+*/
+static void thread_send_echo_reply(thread_config_ptr thr_conf, interface_config_ptr int_conf, struct rte_mbuf *buf)
+{
+    struct ether_hdr *eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+    struct ipv4_hdr *hdr = (struct ipv4_hdr *)(eth + 1);
+    struct icmp_hdr *icmp = (struct icmp_hdr *)((uint8_t *)hdr + (hdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER);
+    ipv4_addr addr = hdr->src_addr;
+    hdr->src_addr = hdr->dst_addr;
+    hdr->dst_addr = addr;
+    // The TTL shares its checksum word with the protocol.
+    hdr->hdr_checksum = update_cksum(hdr->hdr_checksum,
+                                     rte_cpu_to_be_16((uint16_t)(hdr->time_to_live << 8 | IPPROTO_ICMP)),
+                                     rte_cpu_to_be_16(ICMP_TTL << 8 | IPPROTO_ICMP));
+    hdr->time_to_live = ICMP_TTL;
+    // The type shares its checksum word with the code.
+    icmp->icmp_cksum = update_cksum(icmp->icmp_cksum,
+                                    rte_cpu_to_be_16((uint16_t)(IP_ICMP_ECHO_REQUEST << 8 | icmp->icmp_code)),
+                                    rte_cpu_to_be_16((uint16_t)(IP_ICMP_ECHO_REPLY << 8 | icmp->icmp_code)));
+    icmp->icmp_type = IP_ICMP_ECHO_REPLY;
+    ether_addr_copy(&eth->s_addr, &eth->d_addr);
+    ether_addr_copy(&int_conf->mac, &eth->s_addr);
+    thr_conf->echo_replies[int_conf->int_id]++;
+    // The reply to a reassembled request might not fit in a single frame either.
+    if (unlikely(buf->pkt_len > max_frame_lens[int_conf->int_id]))
+    {
+        thread_send_fragments(thr_conf, buf, int_conf->int_id, int_conf->vlan_id, NULL);
+        return;
+    }
+    // The interface might not send chained frames (see 'thread_send_fragments').
+    rte_pktmbuf_linearize(buf);
+    thread_transmit_frame(thr_conf, int_conf->int_id, int_conf->vlan_id, buf);
+}
+
+/**
+ * self function adds a fragment of a packet to one of our addresses to the
+ * reassembly table of the thread. Returns the reassembled packet, with a valid
+ * header checksum, once its last fragment arrived, NULL until then. The table
+ * owns the fragments meanwhile, and drops the ones whose packet is not complete
+ * in time.
+*/
+static struct rte_mbuf *thread_reassemble_ipv4(thread_config_ptr thr_conf, struct rte_mbuf *buf, uint16_t hdr_len)
+{
+    // The reassembled packet cannot be sent in the place of the fragment ('--steal-reorder').
+    if (thr_conf->frag_tbl == NULL || thr_conf->defer_tx)
+    {
+        rte_pktmbuf_free(buf);
+        return NULL;
+    }
+    struct ipv4_hdr *hdr = rte_pktmbuf_mtod_offset(
+        buf, struct ipv4_hdr *,
+        sizeof(struct ether_hdr));
+    buf->l2_len = sizeof(struct ether_hdr);
+    buf->l3_len = hdr_len;
+    buf = rte_ipv4_frag_reassemble_packet(thr_conf->frag_tbl, &thr_conf->death_row, buf, rte_rdtsc(), hdr);
+    rte_ip_frag_free_death_row(&thr_conf->death_row, 3);
+    if (buf == NULL)
+        return NULL;
+    // The header checksum is left to the NIC, but the reply patches it.
+    hdr = rte_pktmbuf_mtod_offset(
+        buf, struct ipv4_hdr *,
+        sizeof(struct ether_hdr));
+    hdr->hdr_checksum = rte_ipv4_cksum(hdr);
+    buf->ol_flags &= ~PKT_TX_IP_CKSUM;
+    thr_conf->reassembled++;
+    return buf;
+}
+
+/**
+ * self function handles an ipv4 packet to one of our addresses. Fragments are
+ * reassembled first. Only echo requests are served, they are answered right away.
+*/
+static void thread_handle_local_ipv4(thread_config_ptr thr_conf, interface_config_ptr int_conf, struct rte_mbuf *buf)
+{
+    struct ipv4_hdr *hdr = rte_pktmbuf_mtod_offset(
+        buf, struct ipv4_hdr *,
+        sizeof(struct ether_hdr));
+    uint16_t hdr_len = (hdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER;
+    if (rte_ipv4_frag_pkt_is_fragmented(hdr))
+    {
+        if ((buf = thread_reassemble_ipv4(thr_conf, buf, hdr_len)) == NULL)
+            return;
+        hdr = rte_pktmbuf_mtod_offset(
+            buf, struct ipv4_hdr *,
+            sizeof(struct ether_hdr));
+    }
+    uint32_t src = rte_be_to_cpu_32(hdr->src_addr);
+    // The ICMP header must be in the first segment, and the source must be unicast.
+    if (hdr->next_proto_id != IPPROTO_ICMP ||
+        rte_be_to_cpu_16(hdr->total_length) < hdr_len + sizeof(struct icmp_hdr) ||
+        buf->data_len < sizeof(struct ether_hdr) + hdr_len + sizeof(struct icmp_hdr) ||
+        src == 0 || src >= IPv4(224, 0, 0, 0))
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    struct icmp_hdr *icmp = (struct icmp_hdr *)((uint8_t *)hdr + hdr_len);
+    if (icmp->icmp_type != IP_ICMP_ECHO_REQUEST || icmp->icmp_code != 0)
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    thread_send_echo_reply(thr_conf, int_conf, buf);
+}
+
+/**
+ * self function handles ipv4 packet inside an ethernet frame.
+*/
+static void thread_handle_ether_ipv4(thread_config_ptr thr_conf, interface_config_ptr int_conf, struct rte_mbuf *buf)
+{
+    struct ipv4_hdr *hdr = rte_pktmbuf_mtod_offset(
+        buf, struct ipv4_hdr *,
+        sizeof(struct ether_hdr));
+    // Check if the ipv4 header (with its options) is in the first segment and valid.
+    if (buf->data_len < sizeof(struct ether_hdr) + (hdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER ||
+        !is_ipv4_hdr_valid(hdr, buf->pkt_len - sizeof(struct ether_hdr)))
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    // Packets to one of our addresses are never forwarded.
+    if (unlikely(find_local_addr(hdr->dst_addr) != NULL))
+    {
+        thread_handle_local_ipv4(thr_conf, int_conf, buf);
+        return;
+    }
+    // Get the next hop route entry.
+    struct routing_table_entry *next_hop = get_next_hop(rte_be_to_cpu_32(hdr->dst_addr));
+    thread_send_ipv4_packet(thr_conf, int_conf, buf, next_hop);
+}
+
+/**
+ * Performs validity check on the fields of an ARP message. Currently
+ * only mapping between MAC and IPv4 addresses are supported.
+*/
+static bool is_arp_msg_valid(struct arp_hdr *hdr, interface_config_ptr int_conf)
+{
+    // Check ARP hardware type (HTYPE).
+    if (rte_be_to_cpu_16(hdr->arp_hrd) != ARP_HRD_ETHER || hdr->arp_hln != 6)
+    {
+        return false;
+    }
+    // Check ARP protocol type (PTYPE).
+    if (rte_be_to_cpu_16(hdr->arp_pro) != ETHER_TYPE_IPv4 || hdr->arp_pln != 4)
+    {
+        return false;
+    }
+    // Check if the target address belongs to the interface (or VLAN) the message came in on.
+    return find_local_addr(hdr->arp_data.arp_tip) == int_conf;
+}
+
+/**
+ * self function handles arp request message inside an ethernet frame.
+ * Sends back an arp reply with the hardware address of the protocol
+ * address.
+*/
+static void thread_handle_ether_arp_request(thread_config_ptr thr_conf, interface_config_ptr int_conf, struct rte_mbuf *buf)
+{
+    struct arp_hdr *hdr = rte_pktmbuf_mtod_offset(
+        buf, struct arp_hdr *,
+        sizeof(struct ether_hdr));
+    // Swap destination and source MAC addresses.
+    struct ether_hdr *eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+    ether_addr_copy(&eth->s_addr, &eth->d_addr);
+    ether_addr_copy(&int_conf->mac, &eth->s_addr);
+    // Change the op code to ARP reply.
+    hdr->arp_op = rte_cpu_to_be_16(ARP_OP_REPLY);
+    // Save sender mac and ip addresses.
+    ether_addr sender_mac;
+    ether_addr_copy(&hdr->arp_data.arp_sha, &sender_mac);
+    ipv4_addr sender_ip = hdr->arp_data.arp_sip;
+    // Set sender mac and ip addresses to our addresses.
+    ether_addr_copy(&int_conf->mac, &hdr->arp_data.arp_sha);
+    hdr->arp_data.arp_sip = hdr->arp_data.arp_tip;
+    // Set the target addresses from the previous sender addresses.
+    ether_addr_copy(&sender_mac, &hdr->arp_data.arp_tha);
+    hdr->arp_data.arp_tip = sender_ip;
+    // Send the ARP message.
+    thread_transmit_frame(thr_conf, int_conf->int_id, int_conf->vlan_id, buf);
+}
+
+/**
+ * self function handles arp message inside an ethernet frame. Currently
+ * only supports MAC and IPv4 address resolution.
+*/
+static void thread_handle_ether_arp(thread_config_ptr thr_conf, interface_config_ptr int_conf, struct rte_mbuf *buf)
+{
+    struct arp_hdr *hdr = rte_pktmbuf_mtod_offset(
+        buf, struct arp_hdr *,
+        sizeof(struct ether_hdr));
+    // Check if the arp message is valid.
+    if (!is_arp_msg_valid(hdr, int_conf))
+    {
+        rte_pktmbuf_free(buf);
+        return;
+    }
+    // Learn the MAC address of a gateway from its replies and its own requests.
+    neighbor_ptr nb = neighbor_lookup(rte_be_to_cpu_32(hdr->arp_data.arp_sip));
+    if (nb != NULL && nb->int_id == int_conf->int_id && nb->vlan_id == int_conf->vlan_id)
+        thread_confirm_neighbor(thr_conf, nb, &hdr->arp_data.arp_sha);
+    // Check and handle the operation type, if possible.
+    switch (rte_be_to_cpu_16(hdr->arp_op))
+    {
+    case ARP_OP_REQUEST:
+        thread_handle_ether_arp_request(thr_conf, int_conf, buf);
+        break;
+    default:
+        rte_pktmbuf_free(buf);
+        return;
+    }
+}
+
+/**
+ * Checks if the frame can be further processed without worrying about the length
+ * and the destination MAC address.
+*/
+static bool is_frame_valid(struct rte_mbuf *buf, interface_config_ptr int_conf)
+{
+    // Check if the frame is too short. The headers must be in the first segment
+    // of a chained frame, only the payload may continue in the other ones.
+    if (buf->data_len < ETHER_HDR_LEN)
+        return false;
+    // Check if the frame was destined to us.
+    struct ether_hdr *eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+    if (!is_broadcast_ether_addr(&eth->d_addr) && !is_same_ether_addr(&eth->d_addr, &int_conf->mac))
+        return false;
+    // Check if the frame has a recognized payload type.
+    uint16_t ether_type = rte_be_to_cpu_16(rte_pktmbuf_mtod(buf, struct ether_hdr *)->ether_type);
+    uint32_t min_payload_len = 0;
+    switch (ether_type)
+    {
+    case ETHER_TYPE_IPv4:
+        min_payload_len = sizeof(struct ipv4_hdr);
+        break;
+    case ETHER_TYPE_IPv6:
+        min_payload_len = sizeof(struct ipv6_hdr);
+        break;
+    case ETHER_TYPE_ARP:
+        min_payload_len = sizeof(struct arp_hdr);
+        break;
+    default:
+        return false;
+    }
+    // Check if the frame is too short given the payload type.
+    if (buf->data_len < ETHER_HDR_LEN + min_payload_len)
+        return false;
+    // Check if the frame is too long.
+    if (buf->pkt_len > max_frame_lens[int_conf->int_id])
+        return false;
+    // Everything seems fine.
+    return true;
+}
+
+/**
+ * Checks if the frame carries a VLAN tag, in the frame or (stripped by the NIC) in the mbuf.
+*/
+static inline bool is_frame_tagged(struct rte_mbuf *buf)
+{
+    return (buf->ol_flags & PKT_RX_VLAN_STRIPPED) ||
+           (buf->data_len >= ETHER_HDR_LEN + sizeof(struct vlan_hdr) &&
+            rte_pktmbuf_mtod(buf, struct ether_hdr *)->ether_type == rte_cpu_to_be_16(ETHER_TYPE_VLAN));
+}
+
+/**
+ * self function pops the VLAN tag of a frame received on the given interface,
+ * unless the NIC stripped it already, and returns the VLAN sub-interface the
+ * frame belongs to. NULL if the interface does not carry its VLAN.
+*/
+static inline interface_config_ptr untag_frame(interface_config_ptr int_conf, struct rte_mbuf *buf)
+{
+    if (!(buf->ol_flags & PKT_RX_VLAN_STRIPPED))
+        rte_vlan_strip(buf);
+    interface_config_ptr *vlans = vlan_ints[int_conf->int_id];
+    return vlans == NULL ? NULL : vlans[buf->vlan_tci & (VLAN_IDS - 1)];
+}
+
+/**
+ * self function drops the frames of a burst that the ACL denies, all of them
+ * classified at once, and moves the others (and their interfaces) to the front.
+ * Returns the number of remaining frames.
+*/
+static uint16_t thread_filter_frames(struct rte_mbuf *bufs[], interface_config_ptr int_confs[], uint16_t nb_bufs)
+{
+    bool denied[MAX_BURST_SIZE];
+    uint16_t i, nb_permitted = 0;
+    if (acl_classify(bufs, nb_bufs, denied) == 0)
+        return nb_bufs;
+    for (i = 0; i < nb_bufs; i++)
+    {
+        if (denied[i])
+        {
+            rte_pktmbuf_free(bufs[i]);
+            continue;
+        }
+        bufs[nb_permitted] = bufs[i];
+        int_confs[nb_permitted++] = int_confs[i];
+    }
+    return nb_permitted;
+}
+
+/**
+ * self function checks each layer 2 frame for its type and if it knows
+ * how to handle the frame, it is further processed. Otherwise, the frame
+ * is discarded and freed. Tagged frames are handled as frames of their
+ * VLAN sub-interface, without the tag. With the ACL, the valid frames of
+ * the burst are filtered before any of them is processed.
+*/
+static void thread_handle_frames(
+    thread_config_ptr thr_conf, interface_config_ptr int_conf,
+    struct rte_mbuf *bufs[], uint16_t rx)
+{
+    // The caller's array stays as it is ('--steal-reorder' keeps track of the frames in it).
+    struct rte_mbuf *valid_bufs[MAX_BURST_SIZE];
+    interface_config_ptr int_confs[MAX_BURST_SIZE];
+    uint16_t i, nb_bufs = 0;
+    for (i = 0; i < rx; i++)
+    {
+        interface_config_ptr frame_int_conf = int_conf;
+        if (unlikely(is_frame_tagged(bufs[i])))
+            frame_int_conf = untag_frame(int_conf, bufs[i]);
+        // Check if the frame is valid first.
+        if (frame_int_conf == NULL || !is_frame_valid(bufs[i], frame_int_conf))
+        {
+            rte_pktmbuf_free(bufs[i]);
+            continue;
+        }
+        valid_bufs[nb_bufs] = bufs[i];
+        int_confs[nb_bufs++] = frame_int_conf;
+    }
+    if (acl_mode && nb_bufs > 0)
+        nb_bufs = thread_filter_frames(valid_bufs, int_confs, nb_bufs);
+    for (i = 0; i < nb_bufs; i++)
+    {
+        // Check if we know how to process the payload type.
+        uint16_t ether_type = rte_be_to_cpu_16(rte_pktmbuf_mtod(valid_bufs[i], struct ether_hdr *)->ether_type);
+        switch (ether_type)
+        {
+        case ETHER_TYPE_IPv4:
+            thread_handle_ether_ipv4(thr_conf, int_confs[i], valid_bufs[i]);
+            break;
+        case ETHER_TYPE_ARP:
+            thread_handle_ether_arp(thr_conf, int_confs[i], valid_bufs[i]);
+            break;
+        default:
+            rte_pktmbuf_free(valid_bufs[i]);
+            break;
+        }
+    }
+}
+
+/**
+ * self function processes a burst of frames received from different
+ * interfaces, each tagged with its ingress interface in 'port' (see
+ * 'thread_dispatch_frames'), interface by interface.
+*/
+static void thread_handle_tagged_frames(thread_config_ptr thr_conf, struct rte_mbuf *bufs[], uint16_t rx)
+{
+    uint16_t keys[MAX_BURST_SIZE], *next_keys = keys, i;
+    for (i = 0; i < rx; i++)
+        keys[i] = bufs[i]->port;
+    while (rx > 0)
+    {
+        uint16_t nb_bufs = group_frames_by_key(bufs, next_keys, rx);
+        interface_config_ptr int_conf = find_interface_config((dpdk_interface)next_keys[0]);
+        thread_handle_frames(thr_conf, int_conf, bufs, nb_bufs);
+        bufs += nb_bufs;
+        next_keys += nb_bufs;
+        rx -= nb_bufs;
+    }
+}
+
+/**
+ * self function rebalances the RSS redirection table of every interface based
+ * on the frames each of its rx queues received since the last rebalancing.
+ * Triggered by SIGUSR1 and run by the first thread.
+*/
+static void rebalance_interfaces()
+{
+    uint64_t queue_load[RTE_MAX_QUEUES_PER_PORT];
+    unsigned int i, j, k, nb_ints = pointer_list_len(&int_confs), nb_thrs = pointer_list_len(&thr_confs);
+    uint16_t nb_queues;
+    for (i = 0; i < nb_ints; i++)
+    {
+        interface_config_ptr int_conf = (interface_config_ptr)pointer_list_get(&int_confs, i);
+        memset(queue_load, 0, sizeof(queue_load));
+        nb_queues = 0;
+        // Sum up the load of every queue of the interface over all threads.
+        for (j = 0; j < nb_thrs; j++)
+        {
+            thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, j);
+            for (k = 0; k < pointer_list_len(&thr_conf->rx_queues); k++)
+            {
+                rx_queue_config_ptr rx_conf = (rx_queue_config_ptr)pointer_list_get(&thr_conf->rx_queues, k);
+                if (rx_conf->int_conf != int_conf || rx_conf->nb_queues != 1)
+                    continue;
+                uint64_t rx_frames = rx_conf->rx_frames;
+                queue_load[rx_conf->q_id] = rx_frames - rx_conf->rx_frames_at_rebalance;
+                rx_conf->rx_frames_at_rebalance = rx_frames;
+                nb_queues = RTE_MAX(nb_queues, rx_conf->q_id + 1);
+            }
+        }
+        int moved = rebalance_rss_reta(int_conf->int_id, queue_load, nb_queues);
+        if (moved > 0)
+            printf("interface id %d: moved %d rss redirection table entries.\n", int_conf->int_id, moved);
+    }
+}
+
+/**
+ * Main function of the control thread, which rebalances the RSS redirection
+ * tables on request (SIGUSR1). Updating a table goes through the admin queue
+ * of the NIC and takes milliseconds, during which a forwarding lcore would
+ * let its rx queues overflow. Keeps running until the lcores stopped.
+ */
+static void *control_thread_main(void *arg)
+{
+    while (!force_quit)
+    {
+        if (rebalance_requested)
+        {
+            rebalance_requested = false;
+            rebalance_interfaces();
+        }
+        usleep(CONTROL_POLL_US);
+    }
+    return arg;
+}
+
+/**
+ * Calculates a symmetric flow hash of a frame in software, for interfaces
+ * without (usable) RSS. Both directions of a TCP/UDP flow get the same hash,
+ * non-IPv4 frames all share the hash 0.
+*/
+static inline uint32_t soft_flow_hash(struct rte_mbuf *buf)
+{
+    struct ether_hdr *eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+    if (eth->ether_type != rte_cpu_to_be_16(ETHER_TYPE_IPv4) ||
+        buf->data_len < sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr))
+        return 0;
+    struct ipv4_hdr *hdr = (struct ipv4_hdr *)(eth + 1);
+    uint32_t addrs = hdr->src_addr ^ hdr->dst_addr, ports = 0;
+    uint32_t l4_offset = sizeof(struct ether_hdr) + (hdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER;
+    // Only the first fragment carries the ports.
+    if ((hdr->next_proto_id == IPPROTO_TCP || hdr->next_proto_id == IPPROTO_UDP) &&
+        (hdr->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_OFFSET_MASK)) == 0 &&
+        buf->data_len >= l4_offset + 2 * sizeof(uint16_t))
+    {
+        uint16_t *l4_ports = rte_pktmbuf_mtod_offset(buf, uint16_t *, l4_offset);
+        ports = l4_ports[0] ^ l4_ports[1];
+    }
+    return rte_hash_crc_4byte(ports, rte_hash_crc_4byte(addrs, hdr->next_proto_id));
+}
+
+/**
+ * self function tags the frames of a single queue interface with their flow
+ * hash and hands them to the distributor. Frames of the same flow are never
+ * processed by two workers at the same time, so their order is preserved.
+*/
+static void thread_distribute_frames(distributor_config_ptr dist_conf, struct rte_mbuf *bufs[], uint16_t rx)
+{
+    uint16_t i;
+    for (i = 0; i < rx; i++)
+    {
+        if (!(bufs[i]->ol_flags & PKT_RX_RSS_HASH))
+            bufs[i]->hash.usr = soft_flow_hash(bufs[i]);
+    }
+    rte_distributor_process(dist_conf->dist, bufs, rx);
+}
+
+/**
+ * self function processes the frames the distributors handed to this thread.
+ * Returns the largest number of frames received from a single distributor.
+*/
+static uint16_t thread_poll_distributors(thread_config_ptr thr_conf)
+{
+    unsigned int i, len = pointer_list_len(&thr_conf->dist_workers);
+    uint16_t received_frames = 0;
+    for (i = 0; i < len; i++)
+    {
+        distributor_worker_ptr worker = (distributor_worker_ptr)pointer_list_get(&thr_conf->dist_workers, i);
+        struct rte_mbuf *bufs[DISTRIBUTOR_BURST_SIZE];
+        int rx = rte_distributor_poll_pkt(worker->dist_conf->dist, worker->worker_id, bufs);
+        // The previous request has not been fulfilled yet.
+        if (rx < 0)
+            continue;
+        if (rx > 0)
+            thread_handle_frames(thr_conf, worker->dist_conf->int_conf, bufs, (uint16_t)rx);
+        // Releases the flows of the processed frames and asks for the next burst.
+        rte_distributor_request_pkt(worker->dist_conf->dist, worker->worker_id, NULL, 0);
+        received_frames = RTE_MAX(received_frames, (uint16_t)rx);
+    }
+    return received_frames;
+}
+
+/**
+ * self function transmits a burst of processed frames, each tagged with its
+ * egress interface in 'port', in one burst per interface. Frames that were
+ * dropped during processing are freed.
+*/
+static void transmit_tagged_frames(dpdk_queue q_id, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    uint16_t keys[MAX_BURST_SIZE], *next_keys = keys, i;
+    for (i = 0; i < nb_bufs; i++)
+        keys[i] = bufs[i]->port;
+    while (nb_bufs > 0)
+    {
+        uint16_t nb_group = group_frames_by_key(bufs, next_keys, nb_bufs);
+        if (next_keys[0] == STEAL_DROPPED_PORT)
+            for (i = 0; i < nb_group; i++)
+                rte_pktmbuf_free(bufs[i]);
+        else
+            transmit_frames((dpdk_interface)next_keys[0], q_id, bufs, nb_group);
+        bufs += nb_group;
+        next_keys += nb_group;
+        nb_bufs -= nb_group;
+    }
+}
+
+/**
+ * self function hands a burst of processed frames of a pipeline tx thread to
+ * the schedulers of their egress interfaces, one burst per interface. The
+ * frames to interfaces without a scheduler are transmitted right away.
+*/
+static void thread_schedule_frames(thread_config_ptr thr_conf, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    uint16_t nb_direct = qos_schedule_frames(bufs, nb_bufs);
+    if (nb_direct > 0)
+        transmit_tagged_frames(thr_conf->q_id, bufs, nb_direct);
+}
+
+/**
+ * self function transmits the frames the schedulers a pipeline tx thread owns
+ * release, at most a burst per interface. Returns the largest burst.
+*/
+static uint16_t thread_dequeue_schedulers(thread_config_ptr thr_conf)
+{
+    struct rte_mbuf *bufs[MAX_BURST_SIZE];
+    uint16_t nb_bufs, most = 0;
+    unsigned int i;
+    for (i = 0; i < qos_count(); i++)
+    {
+        dpdk_interface int_id = qos_get_interface(i);
+        if (qos_get_owner(int_id) != thr_conf->q_id || (nb_bufs = qos_dequeue(int_id, bufs, MAX_BURST_SIZE)) == 0)
+            continue;
+        transmit_frames(int_id, thr_conf->q_id, bufs, nb_bufs);
+        most = RTE_MAX(most, nb_bufs);
+    }
+    return most;
+}
+
+/**
+ * self function processes frames received by the thread of 'origin', which is
+ * either this thread or the one they were stolen from. With '--steal-reorder'
+ * the frames are not transmitted right away: they go back to 'origin', which
+ * transmits them in the order it received them.
+*/
+static void thread_process_frames(thread_config_ptr thr_conf, steal_state_ptr origin, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    if (!steal_reorder)
+    {
+        steal_count_late_frames(&thr_conf->steal, origin, bufs, nb_bufs);
+        thread_handle_tagged_frames(thr_conf, bufs, nb_bufs);
+        return;
+    }
+    steal_hold_frames(bufs, nb_bufs);
+    thr_conf->defer_tx = true;
+    thread_handle_tagged_frames(thr_conf, bufs, nb_bufs);
+    thr_conf->defer_tx = false;
+    steal_settle_frames(&thr_conf->steal, origin, bufs, nb_bufs);
+}
+
+/**
+ * self function processes the frames this thread received from an interface,
+ * apart from the ones it published for idle threads to steal.
+*/
+static void thread_handle_own_frames(thread_config_ptr thr_conf, dpdk_interface int_id, struct rte_mbuf *bufs[], uint16_t rx)
+{
+    uint16_t i;
+    for (i = 0; i < rx; i++)
+        bufs[i]->port = int_id;
+    thread_process_frames(thr_conf, &thr_conf->steal, bufs, steal_publish(&thr_conf->steal, bufs, rx, MAX_BURST_SIZE));
+}
+
+/**
+ * self function processes the published frames of this thread that nobody
+ * stole and reorders the frames the thieves returned. Returns the largest
+ * number of frames taken from one of the rings.
+*/
+static uint16_t thread_reclaim_frames(thread_config_ptr thr_conf)
+{
+    struct rte_mbuf *bufs[MAX_BURST_SIZE];
+    uint16_t rx = steal_reclaim(&thr_conf->steal, bufs, MAX_BURST_SIZE);
+    if (rx > 0)
+        thread_process_frames(thr_conf, &thr_conf->steal, bufs, rx);
+    return RTE_MAX(rx, steal_reorder_returned(&thr_conf->steal));
+}
+
+/**
+ * self function steals a burst of published frames from another thread and
+ * processes it. Returns the number of stolen frames.
+*/
+static uint16_t thread_steal_frames(thread_config_ptr thr_conf)
+{
+    struct rte_mbuf *bufs[MAX_BURST_SIZE];
+    steal_state_ptr victim;
+    uint16_t rx = steal_take(&thr_conf->steal, bufs, MAX_BURST_SIZE, &victim);
+    if (rx > 0)
+        thread_process_frames(thr_conf, victim, bufs, rx);
+    return rx;
+}
+
+/**
+ * self function prints how many ICMP errors the threads sent and how many the
+ * rate limit suppressed, and how many echo requests every interface answered.
+*/
+static void print_icmp_stats()
+{
+    unsigned int i, j, len = pointer_list_len(&thr_confs);
+    uint64_t sent = 0, limited = 0;
+    for (i = 0; i < len; i++)
+    {
+        thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        sent += thr_conf->icmp_errors;
+        limited += thr_conf->icmp_limited;
+    }
+    printf("icmp errors: %" PRIu64 " sent, %" PRIu64 " suppressed by the rate limit.\n", sent, limited);
+    for (i = 0; i < pointer_list_len(&int_confs); i++)
+    {
+        interface_config_ptr int_conf = (interface_config_ptr)pointer_list_get(&int_confs, i);
+        uint64_t replies = 0;
+        for (j = 0; j < len; j++)
+            replies += ((thread_config_ptr)pointer_list_get(&thr_confs, j))->echo_replies[int_conf->int_id];
+        printf("interface %d: %" PRIu64 " echo requests answered.\n", int_conf->int_id, replies);
+    }
+}
+
+/**
+ * self function prints how many packets every interface fragmented, into how
+ * many fragments, and how long it took per packet.
+*/
+static void print_frag_stats()
+{
+    unsigned int i, j, len = pointer_list_len(&thr_confs);
+    uint64_t total = 0, failures = 0, cycles = 0;
+    for (i = 0; i < pointer_list_len(&int_confs); i++)
+    {
+        interface_config_ptr int_conf = (interface_config_ptr)pointer_list_get(&int_confs, i);
+        uint64_t packets = 0, fragments = 0;
+        for (j = 0; j < len; j++)
+        {
+            thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, j);
+            packets += thr_conf->frag_packets[int_conf->int_id];
+            fragments += thr_conf->frag_fragments[int_conf->int_id];
+        }
+        printf("interface %d: %" PRIu64 " packets fragmented into %" PRIu64 " fragments.\n", int_conf->int_id, packets, fragments);
+        total += packets;
+    }
+    for (j = 0; j < len; j++)
+    {
+        thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, j);
+        failures += thr_conf->frag_failures;
+        cycles += thr_conf->frag_cycles;
+    }
+    printf("fragmentation: %" PRIu64 " packets could not be fragmented", failures);
+    if (total > 0)
+        printf(", %" PRIu64 " cycles per fragmented packet", cycles / total);
+    printf(".\n");
+}
+
+/**
+ * self function prints how many packets to our addresses were reassembled, how
+ * many were dropped because their fragments did not arrive in time (or their
+ * table was full) and how many are being reassembled.
+*/
+static void print_reassembly_stats()
+{
+    unsigned int i, len = pointer_list_len(&thr_confs);
+    uint64_t reassembled = 0, expired = 0;
+    uint32_t used = 0, max_entries = 0;
+    for (i = 0; i < len; i++)
+    {
+        thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        if (thr_conf->frag_tbl == NULL)
+            continue;
+        reassembled += thr_conf->reassembled;
+        // Expired entries are freed, or reused by the next packet of their bucket.
+        expired += thr_conf->frag_tbl->stat.del_num + thr_conf->frag_tbl->stat.reuse_num;
+        used += thr_conf->frag_tbl->use_entries;
+        max_entries += thr_conf->frag_tbl->max_entries;
+    }
+    printf("reassembly: %" PRIu64 " packets reassembled, %" PRIu64 " expired, %u of %u entries in use.\n",
+           reassembled, expired, used, max_entries);
+}
+
+/**
+ * self function hands the frames received by a pipeline rx thread to the
+ * workers, over rings or the event device. The frames are handed out by their
+ * flow hash, so the frames of a flow stay in order through the pipeline.
+*/
+static void thread_dispatch_frames(thread_config_ptr thr_conf, dpdk_interface int_id, struct rte_mbuf *bufs[], uint16_t rx)
+{
+    uint32_t hashes[MAX_BURST_SIZE];
     uint16_t i;
     for (i = 0; i < rx; i++)
     {
-        // Check if the frame is valid first.
-        if (!is_frame_valid(bufs[i], int_conf))
+        // The workers look the ingress interface up in the frame itself.
+        bufs[i]->port = int_id;
+        hashes[i] = (bufs[i]->ol_flags & PKT_RX_RSS_HASH) ? bufs[i]->hash.rss : soft_flow_hash(bufs[i]);
+    }
+    if (eventdev_mode)
+        pipeline_enqueue_events(&thr_conf->pipeline, bufs, hashes, rx);
+    else
+        pipeline_dispatch_frames(&thr_conf->pipeline, bufs, hashes, rx);
+}
+
+/**
+ * self function stops all threads for a hot restarted instance, which takes
+ * over the interfaces once the threads drained their rings. Unlike on a
+ * shutdown, the rx queues are left to the new instance.
+*/
+static void release_interfaces()
+{
+    handoff_begin();
+    force_quit = true;
+    printf("a new instance takes over, stopping.\n");
+}
+
+/**
+ * self function prints the pressure on the mempools and, with work stealing,
+ * its statistics.
+*/
+static void print_stats()
+{
+    print_mempool_stats();
+    print_icmp_stats();
+    print_frag_stats();
+    print_reassembly_stats();
+    if (meter_count() > 0)
+        meter_print_stats();
+    if (qos_mode)
+        qos_print_stats();
+    if (acl_mode)
+        acl_print_stats();
+    if (steal_mode)
+        steal_print_stats();
+}
+
+/**
+ * self function receives a burst from an rx queue of this thread and hands it
+ * on, depending on the mode. Returns the number of received frames.
+*/
+static uint16_t thread_poll_rx_queue(thread_config_ptr thr_conf, rx_queue_config_ptr rx_conf)
+{
+    struct rte_mbuf *bufs[MAX_BURST_SIZE];
+    dpdk_interface int_id = rx_conf->int_conf->int_id;
+    uint16_t rx;
+    if (rx_conf->nb_queues == 1)
+        rx = rte_eth_rx_burst(int_id, rx_conf->q_id, bufs, MAX_BURST_SIZE);
+    else
+        rx = recv_from_device(int_id, rx_conf->nb_queues, bufs, MAX_BURST_SIZE);
+    rx_conf->rx_frames += rx;
+
+    if (rx_conf->dist_conf != NULL)
+    {
+        // Called even without frames, so that the backlog reaches the workers.
+        thread_distribute_frames(rx_conf->dist_conf, bufs, rx);
+        return rx;
+    }
+    if (rx == 0)
+        return 0;
+    if (thr_conf->role == THREAD_ROLE_RX)
+        thread_dispatch_frames(thr_conf, int_id, bufs, rx);
+    else if (steal_mode)
+        thread_handle_own_frames(thr_conf, int_id, bufs, rx);
+    else
+        thread_handle_frames(thr_conf, rx_conf->int_conf, bufs, rx);
+    return rx;
+}
+
+/**
+ * self function forwards the frames the rx queues of this thread still hold
+ * once the router quits. The interfaces keep receiving meanwhile, so every
+ * queue is polled until it is empty, but at most 'DRAIN_MAX_BURSTS' times.
+*/
+static void thread_drain_rx_queues(thread_config_ptr thr_conf)
+{
+    unsigned int i, j, nb_rx_queues = pointer_list_len(&thr_conf->rx_queues);
+    // The new instance continues with what the queues hold.
+    if (handoff_in_progress())
+        return;
+    for (i = 0; i < nb_rx_queues; i++)
+    {
+        rx_queue_config_ptr rx_conf = (rx_queue_config_ptr)pointer_list_get(&thr_conf->rx_queues, i);
+        for (j = 0; j < DRAIN_MAX_BURSTS; j++)
+        {
+            uint16_t rx = thread_poll_rx_queue(thr_conf, rx_conf);
+            if (rx == 0)
+                break;
+            rx_conf->drained_frames += rx;
+        }
+    }
+}
+
+/**
+ * Main function of the thread performing the packet processing.
+ */
+static int router_thread(void *arg)
+{
+    thread_config_ptr thr_conf = (thread_config_ptr)arg;
+    pointer_list_ptr rx_queues = &thr_conf->rx_queues;
+    unsigned int i, nb_rx_queues = pointer_list_len(rx_queues);
+    idle_state_ptr idle = &thr_conf->idle;
+    uint16_t q, received_frames;
+    uint64_t stats_period = stats_interval * rte_get_timer_hz(), next_stats = rte_get_timer_cycles() + stats_period;
+    bool stealing;
+
+    // Every queue this thread polls can wake it up when it sleeps.
+    idle_state_init(idle, rte_lcore_id());
+    for (i = 0; i < nb_rx_queues; i++)
+    {
+        rx_queue_config_ptr rx_conf = (rx_queue_config_ptr)pointer_list_get(rx_queues, i);
+        for (q = 0; q < rx_conf->nb_queues; q++)
+            idle_state_add_queue(idle, rx_conf->int_conf->int_id, rx_conf->q_id + q);
+    }
+    idle_state_start(idle);
+
+    // Ask every distributor for the first burst.
+    for (i = 0; i < pointer_list_len(&thr_conf->dist_workers); i++)
+    {
+        distributor_worker_ptr worker = (distributor_worker_ptr)pointer_list_get(&thr_conf->dist_workers, i);
+        rte_distributor_request_pkt(worker->dist_conf->dist, worker->worker_id, NULL, 0);
+    }
+
+    while (!force_quit)
+    {
+        received_frames = 0;
+        for (i = 0; i < nb_rx_queues; i++)
+            received_frames = RTE_MAX(received_frames, thread_poll_rx_queue(thr_conf, (rx_queue_config_ptr)pointer_list_get(rx_queues, i)));
+        received_frames = RTE_MAX(received_frames, thread_poll_distributors(thr_conf));
+        if (steal_mode)
+        {
+            // Finish what nobody stole, or help the other threads if there was nothing to do.
+            received_frames = RTE_MAX(received_frames, thread_reclaim_frames(thr_conf));
+            if (received_frames == 0)
+                received_frames = thread_steal_frames(thr_conf);
+        }
+        if (stats_period > 0 && thr_conf->q_id == 0 && rte_get_timer_cycles() >= next_stats)
+        {
+            next_stats += stats_period;
+            print_stats();
+        }
+        thread_tick_neighbors(thr_conf);
+        // The first thread takes care of a hot restart.
+        if (thr_conf->q_id == 0 && unlikely(handoff_requested()))
+            release_interfaces();
+        // Back off (and eventually sleep) if we did not receive any frames from any interface.
+        if (received_frames == 0)
+            idle_wait(idle);
+        else
+            idle_busy(idle, received_frames, MAX_BURST_SIZE);
+    }
+
+    thread_drain_rx_queues(thr_conf);
+    // Hand the frames our distributors still hold to their workers before leaving.
+    for (i = 0; i < nb_rx_queues; i++)
+    {
+        rx_queue_config_ptr rx_conf = (rx_queue_config_ptr)pointer_list_get(rx_queues, i);
+        if (rx_conf->dist_conf == NULL)
+            continue;
+        rte_distributor_flush(rx_conf->dist_conf->dist);
+        __sync_fetch_and_sub(&nb_distributing_threads, 1);
+    }
+    // A distributor blocks until its workers take their bursts, so keep serving them until all are flushed.
+    while (nb_distributing_threads > 0)
+        thread_poll_distributors(thr_conf);
+    if (steal_mode)
+    {
+        // Thieves might still return frames, so keep reclaiming until all of them stopped.
+        steal_stop();
+        do
+        {
+            stealing = steal_running();
+            while (thread_reclaim_frames(thr_conf) > 0)
+                ;
+        } while (stealing);
+        // Everything came back, do not wait for frames that were sent early.
+        steal_flush(&thr_conf->steal);
+    }
+    idle_state_finalize(idle);
+
+    return 1;
+}
+
+/**
+ * Main function of a pipeline rx thread.
+ */
+static int pipeline_rx_thread(void *arg)
+{
+    thread_config_ptr thr_conf = (thread_config_ptr)arg;
+    pointer_list_ptr rx_queues = &thr_conf->rx_queues;
+    unsigned int i, nb_rx_queues = pointer_list_len(rx_queues);
+    idle_state_ptr idle = &thr_conf->idle;
+    uint16_t received_frames;
+    uint64_t stats_period = stats_interval * rte_get_timer_hz(), next_stats = rte_get_timer_cycles() + stats_period;
+
+    idle_state_init(idle, rte_lcore_id());
+    for (i = 0; i < nb_rx_queues; i++)
+    {
+        rx_queue_config_ptr rx_conf = (rx_queue_config_ptr)pointer_list_get(rx_queues, i);
+        idle_state_add_queue(idle, rx_conf->int_conf->int_id, rx_conf->q_id);
+    }
+    idle_state_start(idle);
+
+    while (!force_quit)
+    {
+        received_frames = 0;
+        for (i = 0; i < nb_rx_queues; i++)
+            received_frames = RTE_MAX(received_frames, thread_poll_rx_queue(thr_conf, (rx_queue_config_ptr)pointer_list_get(rx_queues, i)));
+        pipeline_schedule_events(&thr_conf->pipeline);
+        if (stats_period > 0 && thr_conf->q_id == 0 && rte_get_timer_cycles() >= next_stats)
+        {
+            next_stats += stats_period;
+            print_stats();
+        }
+        // The first rx thread takes care of a hot restart.
+        if (thr_conf->q_id == 0 && unlikely(handoff_requested()))
+            release_interfaces();
+        if (received_frames == 0)
+            idle_wait(idle);
+        else
+            idle_busy(idle, received_frames, MAX_BURST_SIZE);
+    }
+    thread_drain_rx_queues(thr_conf);
+    pipeline_stop_rx(&thr_conf->pipeline);
+    idle_state_finalize(idle);
+
+    return 1;
+}
+
+/**
+ * self function processes a burst of events scheduled to a pipeline worker.
+ * Dequeuing the next burst releases the flows of the previous one.
+*/
+static uint16_t thread_handle_events(thread_config_ptr thr_conf)
+{
+    struct rte_mbuf *bufs[MAX_BURST_SIZE];
+    uint16_t rx = pipeline_dequeue_events(&thr_conf->pipeline, bufs, MAX_BURST_SIZE);
+    if (rx == 0)
+        return 0;
+    thread_handle_tagged_frames(thr_conf, bufs, rx);
+    return rx;
+}
+
+/**
+ * Main function of a pipeline worker thread. Keeps running until the rx
+ * threads have stopped and their rings (or events) are drained.
+ */
+static int pipeline_worker_thread(void *arg)
+{
+    thread_config_ptr thr_conf = (thread_config_ptr)arg;
+    unsigned int i, nb_in_rings = pointer_list_len(&thr_conf->pipeline.in_rings);
+    idle_state_ptr idle = &thr_conf->idle;
+    uint16_t received_frames;
+    bool rx_stopped;
+
+    idle_state_init(idle, rte_lcore_id());
+    idle_state_start(idle);
+
+    do
+    {
+        // Read before polling, so that an empty pass after the rx threads stopped means they are drained.
+        rx_stopped = !pipeline_rx_running();
+        received_frames = 0;
+        if (eventdev_mode)
+            received_frames = thread_handle_events(thr_conf);
+        for (i = 0; i < nb_in_rings; i++)
+        {
+            struct rte_mbuf *bufs[MAX_BURST_SIZE];
+            uint16_t rx = pipeline_dequeue(&thr_conf->pipeline, i, bufs, MAX_BURST_SIZE);
+            if (rx == 0)
+                continue;
+            received_frames = RTE_MAX(received_frames, rx);
+            thread_handle_tagged_frames(thr_conf, bufs, rx);
+        }
+        thread_tick_neighbors(thr_conf);
+        pipeline_flush(&thr_conf->pipeline);
+        if (received_frames == 0)
+            idle_wait(idle);
+        else
+            idle_busy(idle, received_frames, MAX_BURST_SIZE);
+    } while (!rx_stopped || received_frames > 0 || !pipeline_events_drained());
+    pipeline_stop_worker();
+    idle_state_finalize(idle);
+
+    return 1;
+}
+
+/**
+ * Main function of a pipeline tx thread. Keeps running until the workers
+ * have stopped and their rings are empty.
+ */
+static int pipeline_tx_thread(void *arg)
+{
+    thread_config_ptr thr_conf = (thread_config_ptr)arg;
+    unsigned int i, nb_in_rings = pointer_list_len(&thr_conf->pipeline.in_rings);
+    idle_state_ptr idle = &thr_conf->idle;
+    uint16_t received_frames;
+    bool workers_stopped;
+
+    idle_state_init(idle, rte_lcore_id());
+    idle_state_start(idle);
+
+    do
+    {
+        workers_stopped = !pipeline_workers_running();
+        received_frames = 0;
+        for (i = 0; i < nb_in_rings; i++)
+        {
+            struct rte_mbuf *bufs[MAX_BURST_SIZE];
+            uint16_t rx = pipeline_dequeue(&thr_conf->pipeline, i, bufs, MAX_BURST_SIZE);
+            if (rx == 0)
+                continue;
+            received_frames = RTE_MAX(received_frames, rx);
+            // Send (or schedule) the frames in one burst per egress interface.
+            if (qos_mode)
+                thread_schedule_frames(thr_conf, bufs, rx);
+            else
+                transmit_tagged_frames(thr_conf->q_id, bufs, rx);
+        }
+        // The schedulers release the frames at the rates of their interfaces. The
+        // ones still queued once the workers stopped are dropped.
+        if (qos_mode)
+            received_frames = RTE_MAX(received_frames, thread_dequeue_schedulers(thr_conf));
+        if (received_frames == 0)
+            idle_wait(idle);
+        else
+            idle_busy(idle, received_frames, MAX_BURST_SIZE);
+    } while (!workers_stopped || received_frames > 0);
+    idle_state_finalize(idle);
+
+    return 1;
+}
+
+/**
+ * self function returns the main function of a thread, depending on its role.
+*/
+static lcore_function_t *get_thread_main(thread_config_ptr thr_conf)
+{
+    switch (thr_conf->role)
+    {
+    case THREAD_ROLE_RX:
+        return pipeline_rx_thread;
+    case THREAD_ROLE_WORKER:
+        return pipeline_worker_thread;
+    case THREAD_ROLE_TX:
+        return pipeline_tx_thread;
+    default:
+        return router_thread;
+    }
+}
+
+/**
+ * Initialize a thread handling the packet processing.
+ */
+static void start_thread(thread_config_ptr thr_conf)
+{
+    rte_eal_remote_launch(get_thread_main(thr_conf), thr_conf, thr_conf->lcore_id);
+}
+
+/**
+ * self function initializes all static variables of 'router.c' and
+ * enables the parsing and starting functions.
+*/
+void router_init()
+{
+    unsigned int i;
+
+    // Allocate memory for the interface configuration list.
+    pointer_list_init(&int_confs);
+    pointer_list_init(&vlan_confs);
+    memset(vlan_ints, 0, sizeof(vlan_ints));
+    memset(local_addrs, 0, sizeof(local_addrs));
+    nb_local_addrs = 0;
+
+    // Allocate memory for the rx queue assignments.
+    pointer_list_init(&queue_confs);
+    vswitch_mode = false;
+
+    // Allocate memory for the thread configurations.
+    pointer_list_init(&thr_confs);
+    pointer_list_init(&dist_confs);
+    memset(distributed_ints, 0, sizeof(distributed_ints));
+    memset((void *)tx_drops, 0, sizeof(tx_drops));
+    nb_distributing_threads = 0;
+    pipeline_mode = false;
+    memset(lcore_roles, 0, sizeof(lcore_roles));
+    eventdev_mode = false;
+    pipeline_init();
+    acl_mode = false;
+    meter_init();
+    qos_mode = false;
+    qos_init();
+    steal_mode = false;
+    steal_reorder = false;
+    stats_interval = 0;
+    nb_mbufs = 0;
+    reorder_size = DEFAULT_REORDER_SIZE;
+    reorder_timeout_us = DEFAULT_REORDER_TIMEOUT_US;
+    icmp_rate = DEFAULT_ICMP_RATE;
+
+    // Set quit status to false and register signal handlers.
+    force_quit = false;
+    rebalance_requested = false;
+    handoff_init();
+    for (i = 0; i < RTE_MAX_ETHPORTS; i++)
+        max_frame_lens[i] = ETHER_MAX_LEN - ETHER_CRC_LEN;
+
+    // Create the cache of the gateways to resolve.
+    char name[RTE_HASH_NAMESIZE];
+    object_name(name, sizeof(name), "neighbors");
+    if (!neighbor_init(name))
+        printf("gateway routes cannot be resolved.\n");
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGUSR1, signal_handler);
+}
+
+/**
+ * self function stops and closes the started interfaces. With 'report' it
+ * prints how many frames each interface drained at shutdown and how many it
+ * dropped since it was started, including the ones left in its rx queues.
+*/
+static void close_interfaces(bool report)
+{
+    unsigned int i, j, k, len = pointer_list_len(&int_confs);
+    for (i = 0; i < len; i++)
+    {
+        interface_config_ptr int_conf = (interface_config_ptr)pointer_list_get(&int_confs, i);
+        struct rte_eth_stats stats;
+        uint64_t drained = 0, left;
+        if (!int_conf->started)
+            continue;
+        memset(&stats, 0, sizeof(stats));
+        left = close_device(int_conf->int_id, &stats);
+        int_conf->started = false;
+        if (!report)
+            continue;
+        for (j = 0; j < pointer_list_len(&thr_confs); j++)
+        {
+            thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, j);
+            for (k = 0; k < pointer_list_len(&thr_conf->rx_queues); k++)
+            {
+                rx_queue_config_ptr rx_conf = (rx_queue_config_ptr)pointer_list_get(&thr_conf->rx_queues, k);
+                if (rx_conf->int_conf == int_conf)
+                    drained += rx_conf->drained_frames;
+            }
+        }
+        printf("interface %d: %" PRIu64 " frames drained at shutdown, %" PRIu64 " dropped (%" PRIu64 " left in the rx queues, "
+               "%" PRIu64 " rx missed, %" PRIu64 " rx without mbufs, %" PRIu64 " tx queue full).\n",
+               int_conf->int_id, drained, left + stats.imissed + stats.rx_nombuf + tx_drops[int_conf->int_id],
+               left, stats.imissed, stats.rx_nombuf, tx_drops[int_conf->int_id]);
+    }
+}
+
+/**
+ * self function frees memory used by all static variables of 'router.c'.
+*/
+void router_finalize()
+{
+    unsigned int i, len;
+    // Interfaces still started when setting up failed.
+    close_interfaces(false);
+    // Clean up all of the interface configurations.
+    pointer_list_deep_clear(&int_confs);
+    pointer_list_deep_clear(&vlan_confs);
+    for (i = 0; i < RTE_MAX_ETHPORTS; i++)
+    {
+        free(vlan_ints[i]);
+        vlan_ints[i] = NULL;
+    }
+    nb_local_addrs = 0;
+
+    // Clean up all of the rx queue assignments.
+    pointer_list_deep_clear(&queue_confs);
+
+    // Clean up all of the thread configurations.
+    thread_config_ptr thr_conf;
+    len = pointer_list_len(&thr_confs);
+    for (i = 0; i < len; i++)
+    {
+        thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        thread_config_clear(thr_conf);
+    }
+    pointer_list_deep_clear(&thr_confs);
+
+    // Clean up all of the distributor configurations (the distributors live in memzones).
+    pointer_list_deep_clear(&dist_confs);
+
+    pipeline_finalize();
+
+    // Drop the frames still waiting for their gateway.
+    neighbor_finalize();
+
+    // Stop reloading the rules of the ACL and free them.
+    acl_finalize();
+    acl_mode = false;
+
+    // Free the meters of the threads.
+    meter_finalize();
+
+    // Free the schedulers with the frames they still queue.
+    qos_finalize();
+}
+
+/**
+ * Parse the arguments for the application.
+ *
+ * self router offers 2 main arguments. '-p' for specifying a DPDK interface and the
+ * corresponding IP address to attach self router program. '-r' for specifying a
+ * routing entry which will be used for forwarding IP packets on attached interfaces.
+ */
+int parse_args(int argc, char **argv)
+{
+    enum long_option
+    {
+        OPT_CONFIG = 256,
+        OPT_VSWITCH,
+        OPT_DISTRIBUTE,
+        OPT_PIPELINE,
+        OPT_RING_SIZE,
+        OPT_EVENTDEV,
+        OPT_STEAL,
+        OPT_STEAL_REORDER,
+        OPT_STATS,
+        OPT_REORDER_SIZE,
+        OPT_REORDER_TIMEOUT,
+        OPT_MBUFS,
+        OPT_DESCS,
+        OPT_DESCS_FILE,
+        OPT_MTU,
+        OPT_MBUF_SIZE,
+        OPT_ICMP_RATE,
+        OPT_ACL,
+        OPT_METER,
+        OPT_QOS,
+        OPT_QOS_DSCP
+    };
+    static const struct option long_options[] = {
+        {"config", required_argument, NULL, OPT_CONFIG},
+        {"vswitch", no_argument, NULL, OPT_VSWITCH},
+        {"distribute", required_argument, NULL, OPT_DISTRIBUTE},
+        {"pipeline", required_argument, NULL, OPT_PIPELINE},
+        {"ring-size", required_argument, NULL, OPT_RING_SIZE},
+        {"eventdev", no_argument, NULL, OPT_EVENTDEV},
+        {"steal", no_argument, NULL, OPT_STEAL},
+        {"steal-reorder", no_argument, NULL, OPT_STEAL_REORDER},
+        {"stats", required_argument, NULL, OPT_STATS},
+        {"reorder-size", required_argument, NULL, OPT_REORDER_SIZE},
+        {"reorder-timeout", required_argument, NULL, OPT_REORDER_TIMEOUT},
+        {"mbufs", required_argument, NULL, OPT_MBUFS},
+        {"descs", required_argument, NULL, OPT_DESCS},
+        {"descs-file", required_argument, NULL, OPT_DESCS_FILE},
+        {"mtu", required_argument, NULL, OPT_MTU},
+        {"mbuf-size", required_argument, NULL, OPT_MBUF_SIZE},
+        {"icmp-rate", required_argument, NULL, OPT_ICMP_RATE},
+        {"acl", required_argument, NULL, OPT_ACL},
+        {"meter", required_argument, NULL, OPT_METER},
+        {"qos", required_argument, NULL, OPT_QOS},
+        {"qos-dscp", required_argument, NULL, OPT_QOS_DSCP},
+        {NULL, 0, NULL, 0}};
+    interface_config_ptr int_conf;
+    idle_policy policy;
+    char name[RTE_ACL_NAMESIZE];
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:r:i:", long_options, NULL)) != EOF)
+    {
+        switch (opt)
+        {
+        /* DPDK interface and the IP address */
+        case 'p':
+            if ((int_conf = parse_option_p(optarg)) == NULL)
+            {
+                usage();
+                break;
+            }
+            if (int_conf->int_id >= rte_eth_dev_count())
+            {
+                printf("interface id %d is greater than the number of available interfaces (%d).\n",
+                       int_conf->int_id, rte_eth_dev_count());
+                free(int_conf);
+                break;
+            }
+            if (!add_local_addr(int_conf))
+            {
+                printf("too many interface addresses (at most %d).\n", MAX_LOCAL_ADDRS);
+                free(int_conf);
+                break;
+            }
+            if (int_conf->vlan_id == 0)
+            {
+                pointer_list_append(&int_confs, (generic_ptr)int_conf);
+            }
+            else if (!add_vlan_interface(int_conf))
+            {
+                nb_local_addrs--;
+                free(int_conf);
+            }
+            break;
+            /* routing entry */
+        case 'r':
+            if (!parse_option_r(optarg))
+            {
+                usage();
+                break;
+            }
+            break;
+            /* idle policy */
+        case 'i':
+            if (idle_policy_from_str(optarg, &policy) == -1)
+            {
+                usage();
+                break;
+            }
+            idle_set_policy(policy);
+            // Sleeping on rx queues requires the devices to be configured with interrupts.
+            set_rx_interrupts(policy == IDLE_POLICY_POWER);
+            break;
+            /* rx queue to lcore assignments */
+        case OPT_CONFIG:
+            if (!parse_option_config(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* poll all queues of an interface from every lcore */
+        case OPT_VSWITCH:
+            vswitch_mode = true;
+            break;
+            /* software flow distribution of an interface */
+        case OPT_DISTRIBUTE:
+            if (!parse_option_distribute(optarg))
+            {
+                usage();
+                break;
+            }
+            break;
+            /* dedicated rx, worker and tx lcores */
+        case OPT_PIPELINE:
+            if (!parse_option_pipeline(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* size of the pipeline rings */
+        case OPT_RING_SIZE:
+            if (!parse_option_ring_size(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* schedule the pipeline with the software event device */
+        case OPT_EVENTDEV:
+            eventdev_mode = true;
+            break;
+            /* work stealing between the lcores */
+        case OPT_STEAL_REORDER:
+            steal_reorder = true;
+            // fall through
+        case OPT_STEAL:
+            steal_mode = true;
+            break;
+            /* interval of the work stealing statistics */
+        case OPT_STATS:
+            if (!parse_option_stats(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* window of the reorder buffers */
+        case OPT_REORDER_SIZE:
+            if (!parse_option_reorder_size(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* time to wait for overdue frames */
+        case OPT_REORDER_TIMEOUT:
+            if (!parse_option_reorder_timeout(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* size of the mbuf pools */
+        case OPT_MBUFS:
+            if (!parse_option_mbufs(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* descriptor rings of the interfaces */
+        case OPT_DESCS:
+            if (!parse_option_descs(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+        case OPT_DESCS_FILE:
+            if (!parse_option_descs_file(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* jumbo frames */
+        case OPT_MTU:
+            if (!parse_option_mtu(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+        case OPT_MBUF_SIZE:
+            if (!parse_option_mbuf_size(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* rate limit of the icmp errors */
+        case OPT_ICMP_RATE:
+            if (!parse_option_icmp_rate(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* ingress filtering */
+        case OPT_ACL:
+            object_name(name, sizeof(name), "acl");
+            if (!acl_init(name, optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            acl_mode = true;
+            // The rules are reloaded on SIGHUP.
+            signal(SIGHUP, signal_handler);
+            break;
+            /* policing of the routes */
+        case OPT_METER:
+            if (!parse_option_meter(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+            /* egress scheduling */
+        case OPT_QOS:
+            if (!parse_option_qos(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+        case OPT_QOS_DSCP:
+            if (!parse_option_qos_dscp(optarg))
+            {
+                usage();
+                router_finalize();
+                return -1;
+            }
+            break;
+        case 0:
+        default:
+            usage();
+            router_finalize();
+            return -1;
+        }
+    }
+    // A hot restarted instance builds its own table too, while the running one still forwards.
+    build_routing_table();
+    return 1;
+}
+
+/**
+ * self function returns the thread configuration of the given lcore, creating
+ * it if the lcore does not have one yet. Each thread owns the tx queue with the
+ * same index as the thread on every interface.
+*/
+static thread_config_ptr get_thread_config(unsigned int lcore_id)
+{
+    unsigned int i, len = pointer_list_len(&thr_confs);
+    thread_config_ptr thr_conf;
+    for (i = 0; i < len; i++)
+    {
+        thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        if (thr_conf->lcore_id == lcore_id)
+            return thr_conf;
+    }
+    thr_conf = (thread_config_ptr)malloc(sizeof(thread_config));
+    thread_config_init(thr_conf, lcore_id, (dpdk_queue)len);
+    pointer_list_append(&thr_confs, (generic_ptr)thr_conf);
+    return thr_conf;
+}
+
+/**
+ * self function checks that an lcore given in '--config' can run a worker.
+*/
+static bool is_worker_lcore(unsigned int lcore_id)
+{
+    if (!rte_lcore_is_enabled(lcore_id))
+        return false;
+#ifndef MASTER_LCORE_DOES_WORK
+    if (lcore_id == rte_get_master_lcore())
+        return false;
+#endif
+    return true;
+}
+
+/**
+ * self function fills 'queue_confs' with the default assignment: every worker
+ * lcore owns one rx queue of every interface, so that RSS spreads the traffic
+ * of each interface over all workers. With '--pipeline' only the rx lcores
+ * poll queues.
+*/
+static void default_queue_configs(unsigned int worker_count)
+{
+    unsigned int i, len = pointer_list_len(&int_confs), lcore_id, worker_idx = 0;
+    RTE_LCORE_FOREACH(lcore_id)
+    {
+        if (!is_worker_lcore(lcore_id) || worker_idx >= worker_count)
+            continue;
+        if (pipeline_mode && lcore_roles[lcore_id] != THREAD_ROLE_RX)
+            continue;
+        for (i = 0; i < len; i++)
+        {
+            interface_config_ptr int_conf = (interface_config_ptr)pointer_list_get(&int_confs, i);
+            // A distributed interface has a single rx queue, polled by the i-th worker.
+            if (distributed_ints[int_conf->int_id] && worker_idx != i % worker_count)
+                continue;
+            queue_config_ptr q_conf = (queue_config_ptr)malloc(sizeof(queue_config));
+            q_conf->int_id = int_conf->int_id;
+            q_conf->q_id = distributed_ints[int_conf->int_id] ? 0 : (dpdk_queue)worker_idx;
+            q_conf->lcore_id = lcore_id;
+            pointer_list_append(&queue_confs, (generic_ptr)q_conf);
+        }
+        worker_idx++;
+    }
+}
+
+/**
+ * self function creates the thread configurations from 'queue_confs'. Returns
+ * false if an assignment refers to an unusable lcore, an interface that is not
+ * attached or a queue that is assigned twice.
+*/
+static bool assign_queues_to_threads()
+{
+    unsigned int i, j, len = pointer_list_len(&queue_confs);
+    for (i = 0; i < len; i++)
+    {
+        queue_config_ptr q_conf = (queue_config_ptr)pointer_list_get(&queue_confs, i);
+        interface_config_ptr int_conf = find_interface_config(q_conf->int_id);
+        if (int_conf == NULL)
+        {
+            printf("interface id %d in --config is not attached with -p.\n", q_conf->int_id);
+            return false;
+        }
+        if (!is_worker_lcore(q_conf->lcore_id))
+        {
+            printf("lcore %u in --config is not enabled or cannot run a worker.\n", q_conf->lcore_id);
+            return false;
+        }
+        if (pipeline_mode && lcore_roles[q_conf->lcore_id] != THREAD_ROLE_RX)
+        {
+            printf("lcore %u in --config is not an rx lcore of --pipeline.\n", q_conf->lcore_id);
+            return false;
+        }
+        for (j = 0; j < i; j++)
+        {
+            queue_config_ptr other = (queue_config_ptr)pointer_list_get(&queue_confs, j);
+            if (other->int_id == q_conf->int_id && other->q_id == q_conf->q_id)
+            {
+                printf("rx queue %d of interface id %d is assigned more than once.\n", q_conf->q_id, q_conf->int_id);
+                return false;
+            }
+        }
+        thread_config_add_rx_queue(get_thread_config(q_conf->lcore_id), int_conf, q_conf->q_id, 1);
+    }
+    return true;
+}
+
+/**
+ * self function returns the number of rx queues an interface needs for the
+ * assignments in 'queue_confs'. Returns 0 if the queue ids are not contiguous,
+ * since RSS would otherwise steer frames into queues nobody polls.
+*/
+static uint16_t get_nb_rx_queues(dpdk_interface int_id)
+{
+    unsigned int i, len = pointer_list_len(&queue_confs);
+    uint16_t nb_queues = 0, max_queue = 0;
+    for (i = 0; i < len; i++)
+    {
+        queue_config_ptr q_conf = (queue_config_ptr)pointer_list_get(&queue_confs, i);
+        if (q_conf->int_id != int_id)
+            continue;
+        nb_queues++;
+        max_queue = RTE_MAX(max_queue, q_conf->q_id);
+    }
+    if (nb_queues == 0 || max_queue + 1 != nb_queues)
+        return 0;
+    return nb_queues;
+}
+
+/**
+ * self function finds the socket of the lcore that polls each rx queue and of
+ * the lcore that transmits on each tx queue of an interface, so that their
+ * descriptors and mbufs are allocated next to it. Queues no lcore uses get
+ * SOCKET_ID_ANY.
+*/
+static void get_queue_sockets(dpdk_interface int_id, int *rx_socket_ids, uint16_t nb_rx_queues,
+                              int *tx_socket_ids, uint16_t nb_tx_queues)
+{
+    unsigned int i, j, k, len = pointer_list_len(&thr_confs);
+    for (k = 0; k < nb_rx_queues; k++)
+        rx_socket_ids[k] = SOCKET_ID_ANY;
+    for (k = 0; k < nb_tx_queues; k++)
+        tx_socket_ids[k] = SOCKET_ID_ANY;
+    for (i = 0; i < len; i++)
+    {
+        thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        int socket_id = (int)rte_lcore_to_socket_id(thr_conf->lcore_id);
+        // Only the tx threads of the pipeline transmit.
+        if ((thr_conf->role == THREAD_ROLE_RUN_TO_COMPLETION || thr_conf->role == THREAD_ROLE_TX) &&
+            thr_conf->q_id < nb_tx_queues)
+            tx_socket_ids[thr_conf->q_id] = socket_id;
+        for (j = 0; j < pointer_list_len(&thr_conf->rx_queues); j++)
         {
-            rte_pktmbuf_free(bufs[i]);
-            continue;
+            rx_queue_config_ptr rx_conf = (rx_queue_config_ptr)pointer_list_get(&thr_conf->rx_queues, j);
+            if (rx_conf->int_conf->int_id != int_id)
+                continue;
+            // With --vswitch several lcores poll a queue, the first one decides.
+            for (k = rx_conf->q_id; k < (unsigned int)rx_conf->q_id + rx_conf->nb_queues && k < nb_rx_queues; k++)
+                if (rx_socket_ids[k] == SOCKET_ID_ANY)
+                    rx_socket_ids[k] = socket_id;
         }
-        // Check if we know how to process the payload type.
-        uint16_t ether_type = rte_be_to_cpu_16(rte_pktmbuf_mtod(bufs[i], struct ether_hdr *)->ether_type);
-        switch (ether_type)
+    }
+}
+
+/**
+ * self function returns true if the thread polls the rx queue of a distributed interface.
+*/
+static bool is_distributing_thread(thread_config_ptr thr_conf)
+{
+    unsigned int i, len = pointer_list_len(&thr_conf->rx_queues);
+    for (i = 0; i < len; i++)
+    {
+        rx_queue_config_ptr rx_conf = (rx_queue_config_ptr)pointer_list_get(&thr_conf->rx_queues, i);
+        if (distributed_ints[rx_conf->int_conf->int_id])
+            return true;
+    }
+    return false;
+}
+
+/**
+ * self function creates a distributor for every interface selected with
+ * '--distribute'. The thread polling the single rx queue of the interface
+ * hands its frames to all threads that do not poll a distributed interface.
+ * A distributing thread must never be a worker of another distributor: it
+ * blocks until its workers take their bursts, so two of them could wait for
+ * each other. Lcores without any rx queue are only workers of the distributors.
+ * Returns false if a distributed interface has more than one rx queue.
+*/
+static bool create_distributors(unsigned int worker_count)
+{
+    unsigned int i, j, k, thr_count, nb_workers = 0, lcore_id;
+    char name[RTE_MEMZONE_NAMESIZE];
+    for (i = 0; i < RTE_MAX_ETHPORTS && !distributed_ints[i]; i++)
+        ;
+    if (i == RTE_MAX_ETHPORTS)
+        return true;
+    RTE_LCORE_FOREACH(lcore_id)
+    {
+        if (is_worker_lcore(lcore_id) && pointer_list_len(&thr_confs) < worker_count)
+            get_thread_config(lcore_id);
+    }
+    thr_count = pointer_list_len(&thr_confs);
+    for (i = 0; i < thr_count; i++)
+        if (!is_distributing_thread((thread_config_ptr)pointer_list_get(&thr_confs, i)))
+            nb_workers++;
+
+    for (i = 0; i < thr_count; i++)
+    {
+        thread_config_ptr rx_thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        for (j = 0; j < pointer_list_len(&rx_thr_conf->rx_queues); j++)
         {
-        case ETHER_TYPE_IPv4:
-            thread_handle_ether_ipv4(thr_conf, int_conf, bufs[i]);
-            break;
-        case ETHER_TYPE_ARP:
-            thread_handle_ether_arp(thr_conf, int_conf, bufs[i]);
-            break;
-        default:
-            rte_pktmbuf_free(bufs[i]);
-            break;
+            rx_queue_config_ptr rx_conf = (rx_queue_config_ptr)pointer_list_get(&rx_thr_conf->rx_queues, j);
+            interface_config_ptr int_conf = rx_conf->int_conf;
+            if (!distributed_ints[int_conf->int_id])
+                continue;
+            if (rx_conf->q_id != 0 || get_nb_rx_queues(int_conf->int_id) != 1)
+            {
+                printf("distributed interface id %d must have exactly 1 rx queue.\n", int_conf->int_id);
+                return false;
+            }
+            if (nb_workers == 0 || nb_workers > MAX_DISTRIBUTOR_WORKERS)
+            {
+                printf("interface id %d cannot be distributed over %u worker lcores, processing it locally.\n",
+                       int_conf->int_id, nb_workers);
+                continue;
+            }
+            // Create the distributor.
+            distributor_config_ptr dist_conf = (distributor_config_ptr)malloc(sizeof(distributor_config));
+            dist_conf->int_conf = int_conf;
+            dist_conf->nb_workers = nb_workers;
+            object_name(name, sizeof(name), "dist%d", int_conf->int_id);
+            dist_conf->dist = rte_distributor_create(name, rte_socket_id(), nb_workers, RTE_DIST_ALG_BURST);
+            if (dist_conf->dist == NULL)
+            {
+                printf("could not create the distributor of interface id %d: %s\n", int_conf->int_id, rte_strerror(rte_errno));
+                free(dist_conf);
+                return false;
+            }
+            pointer_list_append(&dist_confs, (generic_ptr)dist_conf);
+            rx_conf->dist_conf = dist_conf;
+            nb_distributing_threads++;
+
+            // Register its workers.
+            unsigned int worker_id = 0;
+            for (k = 0; k < thr_count; k++)
+            {
+                thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, k);
+                if (is_distributing_thread(thr_conf))
+                    continue;
+                distributor_worker_ptr worker = (distributor_worker_ptr)malloc(sizeof(distributor_worker));
+                worker->dist_conf = dist_conf;
+                worker->worker_id = worker_id++;
+                pointer_list_append(&thr_conf->dist_workers, (generic_ptr)worker);
+            }
         }
     }
+    return true;
 }
 
 /**
- * Main function of the thread performing the packet processing.
- */
-static int router_thread(void *arg)
+ * self function creates the worker and tx threads of the pipeline and the
+ * rings between the stages: one from every rx thread to every worker, and one
+ * from every worker to every tx thread. Every tx thread owns its own tx queue
+ * on every interface, and the interfaces with a scheduler are spread over the
+ * tx threads. Returns the number of tx threads, or 0 if the pipeline cannot be
+ * built.
+*/
+static unsigned int create_pipeline()
 {
-    thread_config_ptr thr_conf = (thread_config_ptr)arg;
-    pointer_list_ptr thr_int_confs = &thr_conf->int_confs;
-    unsigned int i, nb_ports = pointer_list_len(thr_int_confs);
-    uint16_t worker_count = thr_conf->worker_count;
-    bool received_frames;
+    unsigned int i, j, lcore_id, thr_count, nb_rx = 0, nb_workers = 0, nb_tx = 0;
+    char name[RTE_RING_NAMESIZE];
+    if (vswitch_mode)
+    {
+        printf("--pipeline cannot be combined with --vswitch.\n");
+        return 0;
+    }
+    for (i = 0; i < RTE_MAX_ETHPORTS; i++)
+    {
+        if (distributed_ints[i])
+        {
+            printf("--pipeline cannot be combined with --distribute.\n");
+            return 0;
+        }
+    }
+    for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++)
+    {
+        if (lcore_roles[lcore_id] == THREAD_ROLE_RUN_TO_COMPLETION)
+            continue;
+        if (!is_worker_lcore(lcore_id))
+        {
+            printf("lcore %u in --pipeline is not enabled or cannot run a worker.\n", lcore_id);
+            return 0;
+        }
+        // The rx threads were created with their rx queues.
+        if (lcore_roles[lcore_id] != THREAD_ROLE_RX)
+            get_thread_config(lcore_id);
+    }
 
-    while (!force_quit)
+    thr_count = pointer_list_len(&thr_confs);
+    thread_config_ptr rx_threads[RTE_MAX_LCORE], workers[RTE_MAX_LCORE], tx_threads[RTE_MAX_LCORE];
+    pipeline_state_ptr rx_states[RTE_MAX_LCORE], worker_states[RTE_MAX_LCORE];
+    for (i = 0; i < thr_count; i++)
     {
-        received_frames = false;
-        for (i = 0; i < nb_ports; i++)
+        thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        if (thr_conf->role == THREAD_ROLE_RX)
+            rx_threads[nb_rx++] = thr_conf;
+        else if (thr_conf->role == THREAD_ROLE_WORKER)
+            workers[nb_workers++] = thr_conf;
+        else if (thr_conf->role == THREAD_ROLE_TX)
         {
-            interface_config_ptr int_conf = (interface_config_ptr)pointer_list_get(thr_int_confs, i);
-            struct rte_mbuf *bufs[MAX_BURST_SIZE];
-            uint16_t rx = recv_from_device(int_conf->int_id, worker_count, bufs, MAX_BURST_SIZE);
+            thr_conf->q_id = (dpdk_queue)nb_tx;
+            tx_threads[nb_tx++] = thr_conf;
+        }
+    }
+    if (nb_rx == 0 || nb_workers == 0 || nb_tx == 0)
+    {
+        printf("--pipeline needs at least 1 rx lcore polling a queue, 1 worker lcore and 1 tx lcore.\n");
+        return 0;
+    }
 
-            if (rx == 0)
-                continue;
-            received_frames = true;
-            thread_handle_frames(thr_conf, int_conf, bufs, rx);
+    for (i = 0; i < nb_rx; i++)
+        rx_states[i] = &rx_threads[i]->pipeline;
+    for (j = 0; j < nb_workers; j++)
+        worker_states[j] = &workers[j]->pipeline;
+
+    // Connect every rx thread to every worker, over rings or the event device.
+    if (eventdev_mode && !pipeline_create_event_device(rx_states, nb_rx, worker_states, nb_workers))
+        return 0;
+    for (i = 0; i < nb_rx && !eventdev_mode; i++)
+    {
+        for (j = 0; j < nb_workers; j++)
+        {
+            object_name(name, sizeof(name), "rx%u_w%u", rx_threads[i]->lcore_id, workers[j]->lcore_id);
+            if (!pipeline_connect(rx_states[i], worker_states[j], name))
+                return 0;
         }
-        // If we did not receive any frames from any interface, then sleep a bit.
-        if (!received_frames)
+    }
+    // Connect every worker to every tx thread. The frames to interfaces without
+    // a scheduler go to the tx thread of the worker.
+    for (j = 0; j < nb_workers; j++)
+    {
+        worker_states[j]->tx_ring = (uint16_t)(j % nb_tx);
+        for (i = 0; i < nb_tx; i++)
         {
-            usleep(100);
+            object_name(name, sizeof(name), "w%u_tx%u", workers[j]->lcore_id, tx_threads[i]->lcore_id);
+            if (!pipeline_connect(worker_states[j], &tx_threads[i]->pipeline, name))
+                return 0;
         }
     }
-
-    return 1;
+    qos_assign_owners(nb_tx);
+    pipeline_start(rx_states, nb_rx, worker_states, nb_workers, nb_tx);
+    return nb_tx;
 }
 
 /**
- * Initialize a thread handling the packet processing.
- */
-static void start_thread(unsigned int thr_idx)
+ * self function gives every thread the ring it publishes its surplus frames
+ * to and, with '--steal-reorder', the ring the thieves return them over and
+ * the buffer restoring their order. Returns false on error.
+*/
+static bool create_steal_rings()
 {
-    thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, thr_idx);
-    rte_eal_remote_launch(router_thread, thr_conf, thr_idx + DPDK_MIN_WORKER_ID);
+    unsigned int i, len = pointer_list_len(&thr_confs);
+    char name[RTE_RING_NAMESIZE];
+    if (pipeline_mode)
+    {
+        printf("--steal cannot be combined with --pipeline.\n");
+        return false;
+    }
+    steal_init(len, steal_reorder, reorder_size, reorder_timeout_us, transmit_tagged_frames);
+    for (i = 0; i < len; i++)
+    {
+        thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        object_name(name, sizeof(name), "steal%u", thr_conf->lcore_id);
+        if (!steal_state_create(&thr_conf->steal, name, thr_conf->lcore_id, thr_conf->q_id))
+            return false;
+    }
+    return true;
 }
 
 /**
- * self function initializes all static variables of 'router.c' and
- * enables the parsing and starting functions.
+ * self function gives every forwarding thread the table it reassembles the
+ * fragments of the packets to our addresses in. Returns false on error.
 */
-void router_init()
+static bool create_reassembly_tables()
 {
-    // Allocate memory for the interface configuration list.
-    pointer_list_init(&int_confs);
-
-    // Allocate memory for the thread configurations.
-    pointer_list_init(&thr_confs);
-
-    // Set quit status to false and register signal handlers.
-    force_quit = false;
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    unsigned int i, len = pointer_list_len(&thr_confs);
+    uint64_t max_cycles = rte_get_tsc_hz() * REASSEMBLY_TIMEOUT_MS / 1000;
+    for (i = 0; i < len; i++)
+    {
+        thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        if (thr_conf->role != THREAD_ROLE_RUN_TO_COMPLETION && thr_conf->role != THREAD_ROLE_WORKER)
+            continue;
+        thr_conf->frag_tbl = rte_ip_frag_table_create(REASSEMBLY_BUCKETS, REASSEMBLY_BUCKET_ENTRIES, REASSEMBLY_MAX_ENTRIES,
+                                                      max_cycles, (int)rte_lcore_to_socket_id(thr_conf->lcore_id));
+        if (thr_conf->frag_tbl == NULL)
+        {
+            printf("could not create the reassembly table of lcore %u: %s\n", thr_conf->lcore_id, rte_strerror(rte_errno));
+            return false;
+        }
+    }
+    return true;
 }
 
 /**
- * self function frees memory used by all static variables of 'router.c'.
+ * self function gives every forwarding thread its own tokens and counters of
+ * every meter, whose buckets they all share. Returns false on error.
 */
-void router_finalize()
+static bool create_meters()
 {
-    // Clean up all of the interface configurations.
-    pointer_list_deep_clear(&int_confs);
-
-    // Clean up all of the thread configurations.
-    unsigned int i, len;
+    unsigned int i, nb_forwarding = 0, len = pointer_list_len(&thr_confs);
+    unsigned int lcore_ids[RTE_MAX_LCORE];
     thread_config_ptr thr_conf;
-    len = pointer_list_len(&thr_confs);
     for (i = 0; i < len; i++)
     {
         thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
-        pointer_list_clear(&thr_conf->int_confs);
+        if (thr_conf->role == THREAD_ROLE_RUN_TO_COMPLETION || thr_conf->role == THREAD_ROLE_WORKER)
+            lcore_ids[nb_forwarding++] = thr_conf->lcore_id;
     }
-    pointer_list_deep_clear(&thr_confs);
+    if (!meter_create_states(lcore_ids, nb_forwarding))
+        return false;
+    for (i = 0; i < len; i++)
+    {
+        thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        thr_conf->meters = meter_get_states(thr_conf->lcore_id);
+    }
+    return true;
 }
 
 /**
- * Parse the arguments for the application.
- *
- * self router offers 2 arguments. '-p' for specifying a DPDK interface and the
- * corresponding IP address to attach self router program. '-r' for specifying a
- * routing entry which will be used for forwarding IP packets on attached interfaces.
- */
-int parse_args(int argc, char **argv)
+ * self function creates the scheduler of every egress interface with '--qos' on
+ * the pipeline tx thread that owns it, which gets the frames of the interface
+ * from all workers.
+*/
+static bool create_schedulers()
 {
-    interface_config_ptr int_conf;
-    int opt;
-    while ((opt = getopt(argc, argv, "p:r:")) != EOF)
+    unsigned int i, len = pointer_list_len(&thr_confs);
+    int int_id;
+    char name[RTE_MEMZONE_NAMESIZE];
+    for (int_id = 0; int_id < RTE_MAX_ETHPORTS; int_id++)
     {
-        switch (opt)
+        int owner = qos_get_owner((dpdk_interface)int_id);
+        if (owner < 0)
+            continue;
+        if (find_interface_config((dpdk_interface)int_id) == NULL)
         {
-        /* DPDK interface and the IP address */
-        case 'p':
-            if ((int_conf = parse_option_p(optarg)) == NULL)
-            {
-                usage();
-                break;
-            }
-            if (int_conf->int_id >= rte_eth_dev_count())
-            {
-                printf("interface id %d is greater than the number of available interfaces (%d).\n",
-                       int_conf->int_id, rte_eth_dev_count());
-                free(int_conf);
-                break;
-            }
-            pointer_list_append(&int_confs, (generic_ptr)int_conf);
-            break;
-            /* routing entry */
-        case 'r':
-            if (!parse_option_r(optarg))
-            {
-                usage();
-                break;
-            }
-            break;
-        case 0:
-        default:
-            usage();
-            router_finalize();
-            return -1;
+            printf("--qos is given for interface id %d, which is not attached with -p.\n", int_id);
+            return false;
+        }
+        for (i = 0; i < len; i++)
+        {
+            thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+            if (thr_conf->role != THREAD_ROLE_TX || thr_conf->q_id != owner)
+                continue;
+            object_name(name, sizeof(name), "sched%d_%u", int_id, thr_conf->lcore_id);
+            if (!qos_create((dpdk_interface)int_id, name, thr_conf->lcore_id, max_frame_lens[int_id]))
+                return false;
         }
     }
-    build_routing_table();
-    return 1;
+    return true;
+}
+
+/**
+ * self function reserves the mbufs every thread can hold besides the ones in
+ * the descriptor rings: a burst in flight, its tx buffer, its rings to the
+ * next stage or to the thieves, its reorder buffer and the events or frames
+ * the event device and the distributors hand to it.
+*/
+static void reserve_thread_mbufs()
+{
+    unsigned int i, len = pointer_list_len(&thr_confs);
+    for (i = 0; i < len; i++)
+    {
+        thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        uint32_t nb_bufs = 2 * MAX_BURST_SIZE;
+        nb_bufs += pipeline_reserved_mbufs(&thr_conf->pipeline);
+        nb_bufs += steal_reserved_mbufs(&thr_conf->steal);
+        if (thr_conf->frag_tbl != NULL)
+            nb_bufs += REASSEMBLY_MAX_ENTRIES * RTE_LIBRTE_IP_FRAG_MAX_FRAG;
+        nb_bufs += pointer_list_len(&thr_conf->dist_workers) * MAX_BURST_SIZE;
+        // The schedulers are created once the interfaces are configured.
+        if (thr_conf->role == THREAD_ROLE_TX)
+            nb_bufs += qos_reserved_mbufs(thr_conf->q_id);
+        reserve_lcore_mbufs(thr_conf->lcore_id, nb_bufs);
+    }
+}
+
+/**
+ * self function distributes DPDK interfaces to all available lcores the way it
+ * was done before '--config' existed: whole interfaces are assigned round-robin
+ * and every thread polls all of the queues of its interfaces.
+*/
+static void assign_interfaces_to_threads(unsigned int worker_count)
+{
+    unsigned int i, len = pointer_list_len(&int_confs), lcore_id, thr_idx;
+    RTE_LCORE_FOREACH(lcore_id)
+    {
+        if (is_worker_lcore(lcore_id) && pointer_list_len(&thr_confs) < worker_count)
+            get_thread_config(lcore_id);
+    }
+    for (i = 0; i < len; i++)
+    {
+        interface_config_ptr int_conf = (interface_config_ptr)pointer_list_get(&int_confs, i);
+        // Assign to the next thread.
+        thr_idx = i % pointer_list_len(&thr_confs);
+        thread_config_ptr thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, thr_idx);
+        thread_config_add_rx_queue(thr_conf, int_conf, 0, (uint16_t)worker_count);
+    }
 }
 
 /**
- * self function will evenly distribute DPDK interfaces to all available
- * lcores and launch them. Then wait for all to finish.
+ * self function assigns the rx queues of the DPDK interfaces to the lcores
+ * (see '--config'), configures the interfaces and launches all workers. Then
+ * waits for all to finish.
  * 
  * Note: Depending on the whether 'MASTER_LCORE_DOES_WORK' macro is defined,
  * the master lcore (main thread) will also be doing work along with all the
@@ -618,50 +3710,197 @@ void start_router(unsigned int lcore_count)
     }
     // Let's print all of the interface configurations.
     pointer_list_print(&int_confs, interface_config_print);
+    pointer_list_print(&vlan_confs, interface_config_print);
     // Let's print all of the route entries.
     print_routes();
 
-    unsigned int i, len, thr_idx, thr_count;
+    unsigned int i, len, thr_count, nb_tx_queues, worker_count = lcore_count - DPDK_MIN_WORKER_ID;
+    uint16_t nb_rx_queues;
+    int rx_socket_ids[RTE_MAX_QUEUES_PER_PORT], tx_socket_ids[RTE_MAX_QUEUES_PER_PORT];
     interface_config_ptr int_conf;
     thread_config_ptr thr_conf;
 
-    thr_count = lcore_count - DPDK_MIN_WORKER_ID;
-    // Create a configuration for each worker lcore (1 thread per core).
-    for (i = DPDK_MIN_WORKER_ID; i < lcore_count; i++)
+    // Decide which thread polls which queue.
+    if (vswitch_mode)
+    {
+        assign_interfaces_to_threads(worker_count);
+    }
+    else
+    {
+        if (pointer_list_len(&queue_confs) == 0)
+            default_queue_configs(worker_count);
+        pointer_list_print(&queue_confs, queue_config_print);
+        if (!assign_queues_to_threads() || !create_distributors(worker_count))
+        {
+            router_finalize();
+            return;
+        }
+    }
+    thr_count = pointer_list_len(&thr_confs);
+    nb_tx_queues = thr_count;
+    if (eventdev_mode && !pipeline_mode)
+    {
+        printf("--eventdev needs the lcores of --pipeline.\n");
+        router_finalize();
+        return;
+    }
+    if (eventdev_mode && rte_eal_process_type() == RTE_PROC_SECONDARY)
+    {
+        // Virtual devices can only be created by the primary process.
+        printf("--eventdev is not available to a hot restarted instance.\n");
+        router_finalize();
+        return;
+    }
+    if (qos_mode && !pipeline_mode)
+    {
+        printf("--qos needs the tx lcores of --pipeline, which run the schedulers.\n");
+        router_finalize();
+        return;
+    }
+    if (pipeline_mode)
     {
-        // Allocate.
-        thr_conf = (thread_config_ptr)malloc(sizeof(thread_config));
-        // Initialize.
-        thread_config_init(thr_conf, thr_count, pointer_list_len(&thr_confs));
-        // Append to the list.
-        pointer_list_append(&thr_confs, (generic_ptr)thr_conf);
+        // Only the tx threads of the pipeline transmit.
+        if ((nb_tx_queues = create_pipeline()) == 0)
+        {
+            router_finalize();
+            return;
+        }
+        thr_count = pointer_list_len(&thr_confs);
+    }
+    if (steal_mode && !create_steal_rings())
+    {
+        router_finalize();
+        return;
+    }
+    if (!create_reassembly_tables() || (meter_count() > 0 && !create_meters()))
+    {
+        router_finalize();
+        return;
     }
 
-    // Configure each interface and evenly distribute them to threads.
+    // Check the queues of each interface and reserve mbufs for them on the sockets of their lcores.
     len = pointer_list_len(&int_confs);
     for (i = 0; i < len; i++)
     {
         // Get interface configuration.
         int_conf = (interface_config_ptr)pointer_list_get(&int_confs, i);
-        // Do actual configuration.
-        configure_device(int_conf->int_id, thr_count);
-        // Assign to the next thread.
-        thr_idx = i % thr_count;
-        // Get the corresponding thread configuration.
-        thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, thr_idx);
-        // Append the interface configuration to the list.
-        pointer_list_append(&thr_conf->int_confs, (generic_ptr)int_conf);
+        nb_rx_queues = vswitch_mode ? worker_count : get_nb_rx_queues(int_conf->int_id);
+        if (nb_rx_queues == 0)
+        {
+            printf("rx queues of interface id %d must be numbered contiguously from 0 and polled by an lcore.\n",
+                   int_conf->int_id);
+            router_finalize();
+            return;
+        }
+        if (rte_eal_process_type() == RTE_PROC_SECONDARY)
+        {
+            // The running instance configured the interface, it must fit our queues.
+            if (!is_device_configured(int_conf->int_id, nb_rx_queues, nb_tx_queues))
+            {
+                printf("interface id %d is configured differently by the running instance.\n", int_conf->int_id);
+                router_finalize();
+                return;
+            }
+            max_frame_lens[int_conf->int_id] = get_device_max_frame_len(int_conf->int_id);
+            vlan_insert[int_conf->int_id] = has_vlan_insert(int_conf->int_id);
+            continue;
+        }
+        get_queue_sockets(int_conf->int_id, rx_socket_ids, nb_rx_queues, tx_socket_ids, (uint16_t)nb_tx_queues);
+        reserve_mbufs(int_conf->int_id, rx_socket_ids, nb_rx_queues, tx_socket_ids, (uint16_t)nb_tx_queues);
+    }
+    // The running instance of a hot restart owns the pools.
+    if (rte_eal_process_type() == RTE_PROC_PRIMARY)
+    {
+        reserve_thread_mbufs();
+        create_mempools(nb_mbufs);
+    }
+    // Configure each interface with its rx queues and one tx queue per transmitting thread.
+    for (i = 0; i < len && rte_eal_process_type() == RTE_PROC_PRIMARY; i++)
+    {
+        int_conf = (interface_config_ptr)pointer_list_get(&int_confs, i);
+        nb_rx_queues = vswitch_mode ? worker_count : get_nb_rx_queues(int_conf->int_id);
+        // Do actual configuration, with every queue on the socket of its lcore.
+        get_queue_sockets(int_conf->int_id, rx_socket_ids, nb_rx_queues, tx_socket_ids, (uint16_t)nb_tx_queues);
+        configure_device(int_conf->int_id, nb_rx_queues, (uint16_t)nb_tx_queues, rx_socket_ids, tx_socket_ids);
+        int_conf->started = true;
+        max_frame_lens[int_conf->int_id] = get_device_max_frame_len(int_conf->int_id);
+        vlan_insert[int_conf->int_id] = has_vlan_insert(int_conf->int_id);
+        // Starting the device might have changed its MAC address.
+        refresh_interface_mac(int_conf);
+    }
+    // The schedulers need the frame sizes of their interfaces.
+    if (qos_mode && !create_schedulers())
+    {
+        router_finalize();
+        return;
+    }
+    if (rte_eal_process_type() == RTE_PROC_SECONDARY ? !handoff_take_over() : !handoff_share())
+    {
+        router_finalize();
+        return;
+    }
+
+    // Every thread may send a tenth of a second worth of ICMP errors at once.
+    if (icmp_rate > 0)
+    {
+        icmp_cost_cycles = rte_get_timer_hz() / icmp_rate;
+        icmp_burst_cycles = icmp_cost_cycles * RTE_MAX(icmp_rate / 10, 1U);
+    }
+
+    // The first forwarding thread resolves the gateways.
+    for (i = 0; i < thr_count; i++)
+    {
+        thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        if (thr_conf->role == THREAD_ROLE_RUN_TO_COMPLETION || thr_conf->role == THREAD_ROLE_WORKER)
+        {
+            thr_conf->ticks_neighbors = true;
+            break;
+        }
     }
 
+    bool control_started = pthread_create(&control_thread, NULL, control_thread_main, NULL) == 0;
+    if (!control_started)
+        printf("could not start the control thread, the rss redirection tables will not be rebalanced.\n");
+
     // Launch all of the slave worker threads.
-    for (i = DPDK_MIN_SLAVE_ID - DPDK_MIN_WORKER_ID; i < thr_count; i++)
+    thread_config_ptr master_thr_conf = NULL;
+    for (i = 0; i < thr_count; i++)
     {
-        start_thread(i);
+        thr_conf = (thread_config_ptr)pointer_list_get(&thr_confs, i);
+        if (thr_conf->lcore_id == rte_get_master_lcore())
+            master_thr_conf = thr_conf;
+        else
+            start_thread(thr_conf);
     }
-#ifdef MASTER_LCORE_DOES_WORK
-    router_thread(pointer_list_get(&thr_confs, 0));
-#endif
+    if (master_thr_conf != NULL)
+        get_thread_main(master_thr_conf)(master_thr_conf);
     rte_eal_mp_wait_lcore();
+    if (control_started)
+        pthread_join(control_thread, NULL);
+    if (handoff_in_progress())
+    {
+        // The interfaces keep running for the new instance.
+        for (i = 0; i < len; i++)
+            ((interface_config_ptr)pointer_list_get(&int_confs, i))->started = false;
+        handoff_complete();
+        printf("released the interfaces to the new instance.\n");
+    }
+    // The pools still hold the mbufs of the rx descriptors here.
+    print_mempool_stats();
+    // All threads drained their queues and rings, nothing is transmitted anymore.
+    close_interfaces(true);
+    pipeline_print_stats();
+    print_icmp_stats();
+    print_frag_stats();
+    print_reassembly_stats();
+    if (meter_count() > 0)
+        meter_print_stats();
+    if (qos_mode)
+        qos_print_stats();
+    if (acl_mode)
+        acl_print_stats();
+    if (steal_mode)
+        steal_print_stats();
 
     router_finalize();
 }
@@ -25,5 +25,6 @@ void router_init();
 void router_finalize();
 int parse_args(int argc, char **argv);
 void start_router(unsigned int);
+int router_set_interface_mac(dpdk_interface int_id, ether_addr *mac);
 
 #endif
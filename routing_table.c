@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 
+#include <rte_atomic.h>
+
 // Must not be bigger than 32 !
 #define TBL_PREFIX_LEN 24
 
@@ -37,11 +39,44 @@ typedef struct
     bool in_use;
 } next_hop_info, *next_hop_info_ptr;
 
-static tbl24_entry tbl24_table[TBL24_TABLE_SIZE];
-static tbllong_entry tbllong_table[TBLLONG_TABLE_SIZE];
+// The tables read by 'get_next_hop'. Every instance builds its own from its
+// '-r' arguments, a hot restarted one included.
+typedef struct
+{
+    tbl24_entry tbl24_table[TBL24_TABLE_SIZE];
+    tbllong_entry tbllong_table[TBLLONG_TABLE_SIZE];
+    next_hop_info nh_id_to_info[NH_ID_TO_INFO_SIZE];
+} routing_tables;
+
+static routing_tables tables;
 static uint16_t tbllong_table_idx;
-static next_hop_info nh_id_to_info[NH_ID_TO_INFO_SIZE] = {0};
 static uint16_t nh_id_to_info_idx = 0;
+// Source MAC address of each port, used when filling the adjacency templates.
+static struct ether_addr port_id_to_mac[RTE_MAX_ETHPORTS];
+
+static void _fill_l2_template(struct routing_table_entry *next_hop)
+{
+    l2_template tmpl;
+    ether_addr_copy(&next_hop->dst_mac, &tmpl.d_addr);
+    ether_addr_copy(&port_id_to_mac[next_hop->dst_port], &tmpl.s_addr);
+    tmpl.ether_type = rte_cpu_to_be_16(ETHER_TYPE_IPv4);
+    tmpl.pad = 0;
+    // Publish the whole template with one aligned store so that readers never see half of it.
+    next_hop->l2.val = tmpl.val;
+}
+
+void set_port_mac(uint8_t port, struct ether_addr *mac)
+{
+    ether_addr_copy(mac, &port_id_to_mac[port]);
+
+    uint16_t nh_id;
+    for (nh_id = 0; nh_id < NH_ID_TO_INFO_SIZE; nh_id++)
+    {
+        next_hop_info_ptr nh_info = &tables.nh_id_to_info[nh_id];
+        if (nh_info->in_use && nh_info->next_hop.dst_port == port)
+            _fill_l2_template(&nh_info->next_hop);
+    }
+}
 
 void add_route(uint32_t ip_addr, uint8_t prefix, struct ether_addr *mac_addr, uint8_t port)
 {
@@ -50,17 +85,71 @@ void add_route(uint32_t ip_addr, uint8_t prefix, struct ether_addr *mac_addr, ui
         printf("ERROR: cannot add any more routes!\n");
         exit(EXIT_FAILURE);
     }
-    next_hop_info_ptr nh_info = &nh_id_to_info[nh_id_to_info_idx++];
+    next_hop_info_ptr nh_info = &tables.nh_id_to_info[nh_id_to_info_idx++];
     nh_info->ip_addr = ip_addr;
     nh_info->prefix = (prefix <= 32) ? prefix : 32;
     ether_addr_copy(mac_addr, &nh_info->next_hop.dst_mac);
     nh_info->next_hop.dst_port = port;
+    nh_info->next_hop.vlan_id = 0;
+    nh_info->next_hop.meter_id = 0;
+    nh_info->next_hop.gateway = 0;
+    nh_info->next_hop.resolved = true;
+    _fill_l2_template(&nh_info->next_hop);
     nh_info->in_use = true;
 }
 
+void add_gateway_route(uint32_t ip_addr, uint8_t prefix, uint32_t gateway, uint8_t port)
+{
+    struct ether_addr unresolved;
+    memset(&unresolved, 0, sizeof(unresolved));
+    add_route(ip_addr, prefix, &unresolved, port);
+    next_hop_info_ptr nh_info = &tables.nh_id_to_info[nh_id_to_info_idx - 1];
+    nh_info->next_hop.gateway = gateway;
+    nh_info->next_hop.resolved = false;
+}
+
+void set_route_vlan(uint16_t vlan_id)
+{
+    if (nh_id_to_info_idx > 0)
+        tables.nh_id_to_info[nh_id_to_info_idx - 1].next_hop.vlan_id = vlan_id;
+}
+
+void set_route_meter(uint8_t meter_id)
+{
+    if (nh_id_to_info_idx > 0)
+        tables.nh_id_to_info[nh_id_to_info_idx - 1].next_hop.meter_id = meter_id;
+}
+
+void set_gateway_mac(uint32_t gateway, struct ether_addr *mac)
+{
+    uint16_t nh_id;
+    for (nh_id = 0; nh_id < NH_ID_TO_INFO_SIZE; nh_id++)
+    {
+        next_hop_info_ptr nh_info = &tables.nh_id_to_info[nh_id];
+        if (!nh_info->in_use || nh_info->next_hop.gateway != gateway)
+            continue;
+        ether_addr_copy(mac, &nh_info->next_hop.dst_mac);
+        _fill_l2_template(&nh_info->next_hop);
+        // The template must be complete before the adjacency is used.
+        rte_smp_wmb();
+        nh_info->next_hop.resolved = true;
+    }
+}
+
+void clear_gateway_mac(uint32_t gateway)
+{
+    uint16_t nh_id;
+    for (nh_id = 0; nh_id < NH_ID_TO_INFO_SIZE; nh_id++)
+    {
+        next_hop_info_ptr nh_info = &tables.nh_id_to_info[nh_id];
+        if (nh_info->in_use && nh_info->next_hop.gateway == gateway)
+            nh_info->next_hop.resolved = false;
+    }
+}
+
 static void _build_route_lte_24_long_idx(uint16_t nh_id, uint16_t long_idx)
 {
-    tbllong_entry_ptr tbllong_ent = &tbllong_table[long_idx];
+    tbllong_entry_ptr tbllong_ent = &tables.tbllong_table[long_idx];
     uint64_t i;
     // Iterate over all tbllong entry ports and replace the port id if possible.
     for (i = 0; i < TBLLONG_ENTRY_SIZE; i++)
@@ -73,7 +162,7 @@ static void _build_route_lte_24_long_idx(uint16_t nh_id, uint16_t long_idx)
             continue;
         }
         // If the current port id belongs to a lesser or equal destination prefix, then replace it.
-        if (nh_id_to_info[curr_nh_id].prefix <= nh_id_to_info[nh_id].prefix)
+        if (tables.nh_id_to_info[curr_nh_id].prefix <= tables.nh_id_to_info[nh_id].prefix)
         {
             (*tbllong_ent)[i] = nh_id;
         }
@@ -83,31 +172,31 @@ static void _build_route_lte_24_long_idx(uint16_t nh_id, uint16_t long_idx)
 static void _build_route_lte_24_idx(uint16_t nh_id, uint32_t idx)
 {
     // If the tbl24 entry is not used, then start using it.
-    if (tbl24_table[idx].val == INVALID_NH_ID)
+    if (tables.tbl24_table[idx].val == INVALID_NH_ID)
     {
-        tbl24_table[idx].next_id = nh_id;
-        tbl24_table[idx].is_long = 0;
+        tables.tbl24_table[idx].next_id = nh_id;
+        tables.tbl24_table[idx].is_long = 0;
         return;
     }
 
     // If the tbl24 entry is used by a destination prefix <= 24.
-    if (tbl24_table[idx].is_long == 0)
+    if (tables.tbl24_table[idx].is_long == 0)
     {
         // If the entry is used by a lesser or equal destination prefix, then replace it.
-        if (nh_id_to_info[tbl24_table[idx].next_id].prefix <= nh_id_to_info[nh_id].prefix)
+        if (tables.nh_id_to_info[tables.tbl24_table[idx].next_id].prefix <= tables.nh_id_to_info[nh_id].prefix)
         {
-            tbl24_table[idx].next_id = nh_id;
+            tables.tbl24_table[idx].next_id = nh_id;
         }
         return;
     }
 
     // If the entry is used by a destination prefix > 24.
-    _build_route_lte_24_long_idx(nh_id, tbl24_table[idx].next_id);
+    _build_route_lte_24_long_idx(nh_id, tables.tbl24_table[idx].next_id);
 }
 
 static void _build_route_lte_24(uint16_t nh_id)
 {
-    next_hop_info_ptr nh_info = &nh_id_to_info[nh_id];
+    next_hop_info_ptr nh_info = &tables.nh_id_to_info[nh_id];
     uint32_t min_index, max_index;
     min_index = (nh_info->ip_addr >> (32 - nh_info->prefix)) << (TBL_PREFIX_LEN - nh_info->prefix);
     max_index = min_index | ((1 << (TBL_PREFIX_LEN - nh_info->prefix)) - 1);
@@ -121,12 +210,12 @@ static void _build_route_lte_24(uint16_t nh_id)
 
 static void _build_route_gt_24_long_idx(uint16_t nh_id, uint16_t long_idx)
 {
-    next_hop_info_ptr nh_info = &nh_id_to_info[nh_id];
+    next_hop_info_ptr nh_info = &tables.nh_id_to_info[nh_id];
     uint32_t min_i, max_i;
     min_i = (nh_info->ip_addr & ((1 << (32 - TBL_PREFIX_LEN)) - 1)) & (~((1 << (32 - nh_info->prefix)) - 1));
     max_i = min_i | ((1 << (32 - nh_info->prefix)) - 1);
 
-    tbllong_entry_ptr tbllong_ent = &tbllong_table[long_idx];
+    tbllong_entry_ptr tbllong_ent = &tables.tbllong_table[long_idx];
     uint64_t i;
     for (i = min_i; i <= max_i; i++)
     {
@@ -138,7 +227,7 @@ static void _build_route_gt_24_long_idx(uint16_t nh_id, uint16_t long_idx)
             continue;
         }
         // If the current port id belongs to a lesser or equal destination prefix, then replace it.
-        if (nh_id_to_info[curr_nh_id].prefix <= nh_id_to_info[nh_id].prefix)
+        if (tables.nh_id_to_info[curr_nh_id].prefix <= tables.nh_id_to_info[nh_id].prefix)
         {
             (*tbllong_ent)[i] = nh_id;
         }
@@ -153,15 +242,15 @@ static void _build_route_gt_24_idx(uint16_t nh_id, uint32_t idx)
         exit(EXIT_FAILURE);
     }
 
-    uint16_t long_idx = tbl24_table[idx].next_id = tbllong_table_idx++;
-    tbl24_table[idx].is_long = 1;
+    uint16_t long_idx = tables.tbl24_table[idx].next_id = tbllong_table_idx++;
+    tables.tbl24_table[idx].is_long = 1;
 
-    next_hop_info_ptr nh_info = &nh_id_to_info[nh_id];
+    next_hop_info_ptr nh_info = &tables.nh_id_to_info[nh_id];
     uint32_t min_i, max_i;
     min_i = (nh_info->ip_addr & ((1 << (32 - TBL_PREFIX_LEN)) - 1)) & (~((1 << (32 - nh_info->prefix)) - 1));
     max_i = min_i | ((1 << (32 - nh_info->prefix)) - 1);
 
-    tbllong_entry_ptr tbllong_ent = &tbllong_table[long_idx];
+    tbllong_entry_ptr tbllong_ent = &tables.tbllong_table[long_idx];
     uint64_t i;
     for (i = min_i; i <= max_i; i++)
     {
@@ -171,25 +260,25 @@ static void _build_route_gt_24_idx(uint16_t nh_id, uint32_t idx)
 
 static void _build_route_gt_24(uint16_t nh_id)
 {
-    uint32_t idx = nh_id_to_info[nh_id].ip_addr >> (32 - TBL_PREFIX_LEN);
+    uint32_t idx = tables.nh_id_to_info[nh_id].ip_addr >> (32 - TBL_PREFIX_LEN);
     // If the tbl24 entry is not used, then start using it.
-    if (tbl24_table[idx].val == INVALID_NH_ID)
+    if (tables.tbl24_table[idx].val == INVALID_NH_ID)
     {
         _build_route_gt_24_idx(nh_id, idx);
         return;
     }
 
     // If the tbl24 entry is used by a destination prefix <= 24.
-    if (tbl24_table[idx].is_long == 0)
+    if (tables.tbl24_table[idx].is_long == 0)
     {
-        uint16_t cur_nh_id = tbl24_table[idx].next_id;
+        uint16_t cur_nh_id = tables.tbl24_table[idx].next_id;
         _build_route_gt_24_idx(nh_id, idx);
-        _build_route_lte_24_long_idx(cur_nh_id, tbl24_table[idx].next_id);
+        _build_route_lte_24_long_idx(cur_nh_id, tables.tbl24_table[idx].next_id);
         return;
     }
 
     // If the entry is used by a destination prefix > 24.
-    _build_route_gt_24_long_idx(nh_id, tbl24_table[idx].next_id);
+    _build_route_gt_24_long_idx(nh_id, tables.tbl24_table[idx].next_id);
 }
 
 void build_routing_table()
@@ -199,16 +288,16 @@ void build_routing_table()
     uint64_t i, j;
     for (i = 0; i < TBL24_TABLE_SIZE; i++)
     {
-        tbl24_table[i].val = INVALID_NH_ID;
+        tables.tbl24_table[i].val = INVALID_NH_ID;
     }
     for (i = 0; i < TBLLONG_TABLE_SIZE; i++)
         for (j = 0; j < TBLLONG_ENTRY_SIZE; j++)
-            tbllong_table[i][j] = INVALID_NH_ID;
+            tables.tbllong_table[i][j] = INVALID_NH_ID;
 
     uint16_t nh_id;
     for (nh_id = 0; nh_id < nh_id_to_info_idx; nh_id++)
     {
-        next_hop_info_ptr nh_info = &nh_id_to_info[nh_id];
+        next_hop_info_ptr nh_info = &tables.nh_id_to_info[nh_id];
         if (!nh_info->in_use)
             continue;
 
@@ -223,14 +312,22 @@ void build_routing_table()
 void print_routes()
 {
     uint16_t nh_id;
-    for (nh_id = 0; nh_id_to_info[nh_id].in_use; nh_id++)
+    for (nh_id = 0; tables.nh_id_to_info[nh_id].in_use; nh_id++)
     {
-        next_hop_info_ptr nh_info = &nh_id_to_info[nh_id];
+        next_hop_info_ptr nh_info = &tables.nh_id_to_info[nh_id];
         char mac_str[ETHER_ADDR_FMT_SIZE], msg_str[MAX_STR_LEN];
+        if (nh_info->next_hop.gateway != 0)
+        {
+            printf("-r argument: ipv4 addr 0x%08x, cidr %d, gateway 0x%08x, interface id %d, vlan %d, meter %d\n",
+                   nh_info->ip_addr, nh_info->prefix, nh_info->next_hop.gateway, nh_info->next_hop.dst_port,
+                   nh_info->next_hop.vlan_id, nh_info->next_hop.meter_id);
+            continue;
+        }
         ether_format_addr(mac_str, ETHER_ADDR_FMT_SIZE, &nh_info->next_hop.dst_mac);
         snprintf(msg_str, MAX_STR_LEN,
-                 "-r argument: ipv4 addr 0x%08x, cidr %d, MAC %s, interface id %d\n",
-                 nh_info->ip_addr, nh_info->prefix, mac_str, nh_info->next_hop.dst_port);
+                 "-r argument: ipv4 addr 0x%08x, cidr %d, MAC %s, interface id %d, vlan %d, meter %d\n",
+                 nh_info->ip_addr, nh_info->prefix, mac_str, nh_info->next_hop.dst_port, nh_info->next_hop.vlan_id,
+                 nh_info->next_hop.meter_id);
         printf(msg_str);
     }
 }
@@ -242,16 +339,16 @@ struct routing_table_entry *get_next_hop(uint32_t ip)
 {
     uint32_t idx = ip >> (32 - TBL_PREFIX_LEN);
 
-    if (tbl24_table[idx].val == INVALID_NH_ID)
+    if (tables.tbl24_table[idx].val == INVALID_NH_ID)
         return NULL;
 
-    if (tbl24_table[idx].is_long == 0)
-        return &nh_id_to_info[tbl24_table[idx].next_id].next_hop;
+    if (tables.tbl24_table[idx].is_long == 0)
+        return &tables.nh_id_to_info[tables.tbl24_table[idx].next_id].next_hop;
 
-    tbllong_entry_ptr tbllong_ent = &tbllong_table[tbl24_table[idx].next_id];
+    tbllong_entry_ptr tbllong_ent = &tables.tbllong_table[tables.tbl24_table[idx].next_id];
     uint32_t ent_idx = ip & ((1 << (32 - TBL_PREFIX_LEN)) - 1);
     uint16_t nh_id = (*tbllong_ent)[ent_idx];
     if (nh_id == INVALID_NH_ID)
         return NULL;
-    return &nh_id_to_info[nh_id].next_hop;
+    return &tables.nh_id_to_info[nh_id].next_hop;
 }
@@ -2,22 +2,73 @@
 #define ROUTING_TABLE_H__
 
 #include <stdbool.h>
+#include <string.h>
 
 #include <rte_config.h>
+#include <rte_memory.h>
 #include <rte_ether.h>
+#include <rte_vect.h>
 
 // build a new routing table
 void add_route(uint32_t ip_addr, uint8_t prefix, struct ether_addr *mac_addr, uint8_t port);
+// add a route via a gateway whose MAC address is resolved later
+void add_gateway_route(uint32_t ip_addr, uint8_t prefix, uint32_t gateway, uint8_t port);
+// make the route added last egress a VLAN sub-interface of its port
+void set_route_vlan(uint16_t vlan_id);
+// police the packets of the route added last with a meter (0 for none)
+void set_route_meter(uint8_t meter_id);
 void print_routes();
 void print_port_id_to_mac();
 void build_routing_table();
 void print_next_hop_tab();
+// set the source MAC of a port and refresh the templates of all adjacencies egressing it
+void set_port_mac(uint8_t port, struct ether_addr *mac);
+// set the resolved MAC of a gateway, or mark it unresolved, in the adjacencies of all routes via it
+void set_gateway_mac(uint32_t gateway, struct ether_addr *mac);
+void clear_gateway_mac(uint32_t gateway);
+
+// Precomputed ethernet header of an adjacency. The trailing 2 bytes only pad it to
+// a full SSE register and are never written into the packet.
+typedef union l2_template
+{
+    struct
+    {
+        struct ether_addr d_addr;
+        struct ether_addr s_addr;
+        uint16_t ether_type;
+        uint16_t pad;
+    };
+    xmm_t val;
+} l2_template;
 
 struct routing_table_entry
 {
+    l2_template l2;
     struct ether_addr dst_mac;
     uint8_t dst_port;
-};
+    // Meter policing the packets of the route, 0 for none.
+    uint8_t meter_id;
+    // VLAN sub-interface of 'dst_port' the frames are tagged for, 0 for untagged.
+    uint16_t vlan_id;
+    // Can frames be sent with 'l2'? Only routes via a gateway (not 0) wait for it to be resolved.
+    volatile bool resolved;
+    uint32_t gateway;
+} __rte_cache_aligned;
+
+/**
+ * Writes the destination MAC, source MAC and ether type of the adjacency into
+ * 'eth' with a single 14-byte store (the 2 bytes following the ethernet header
+ * are blended back unchanged). The frame must hold at least 16 bytes.
+ */
+static inline void l2_template_apply(const struct routing_table_entry *next_hop, struct ether_hdr *eth)
+{
+#ifdef __SSE4_1__
+    xmm_t hdr = _mm_loadu_si128((const xmm_t *)eth);
+    _mm_storeu_si128((xmm_t *)eth, _mm_blend_epi16(next_hop->l2.val, hdr, 0x80));
+#else
+    memcpy(eth, &next_hop->l2, sizeof(struct ether_hdr));
+#endif
+}
 
 void print_routing_table_entry(struct routing_table_entry *info);
 
@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <rte_config.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+
+#include "steal.h"
+
+// Number of slots of the ring a thread publishes its surplus frames to ('--steal').
+#define STEAL_RING_SIZE 256
+// Number of slots of the ring thieves return the processed frames to ('--steal-reorder').
+#define STEAL_RETURN_RING_SIZE 1024
+
+// Threads that steal from each other, in the order they look for victims in.
+static steal_state_ptr states[RTE_MAX_LCORE];
+static unsigned int nb_states;
+// Is the order of the frames restored ('--steal-reorder'), the window and timeout
+// of the reorder buffers, and how the reordered frames are transmitted.
+static bool reorder_mode;
+static unsigned int reorder_size;
+static uint64_t reorder_timeout_cycles;
+static steal_transmit_fn transmit_frames;
+// Number of threads that might still steal (and return) frames.
+static volatile unsigned int nb_stealing_threads;
+
+/**
+ * self function sets up work stealing between 'nb_threads' threads, which all
+ * create their state afterwards. With 'reorder' the frames are transmitted in
+ * the order their thread received them, by 'transmit'.
+*/
+void steal_init(unsigned int nb_threads, bool reorder, unsigned int size, unsigned int timeout_us,
+                steal_transmit_fn transmit)
+{
+    memset(states, 0, sizeof(states));
+    nb_states = 0;
+    reorder_mode = reorder;
+    reorder_size = size;
+    reorder_timeout_cycles = rte_get_tsc_hz() * timeout_us / 1000000;
+    transmit_frames = transmit;
+    nb_stealing_threads = nb_threads;
+    if (reorder)
+        printf("work stealing between %u lcores, frames reordered in a window of %u with a timeout of %u us.\n",
+               nb_threads, size, timeout_us);
+    else
+        printf("work stealing between %u lcores.\n", nb_threads);
+}
+
+/**
+ * self function tells the other threads that this thread does not steal anymore.
+*/
+void steal_stop()
+{
+    __sync_fetch_and_sub(&nb_stealing_threads, 1);
+}
+
+/**
+ * self function returns true while any thread might still steal (and return) frames.
+*/
+bool steal_running()
+{
+    return nb_stealing_threads > 0;
+}
+
+/**
+ * self function prints how many frames every thread received, published, stole
+ * and sent out of order, the share of stolen and of reordered frames and the
+ * imbalance of the threads.
+*/
+void steal_print_stats()
+{
+    unsigned int i;
+    uint64_t total_rx = 0, total_stolen = 0, total_late = 0, max_rx = 0;
+    for (i = 0; i < nb_states; i++)
+    {
+        steal_state_ptr self = states[i];
+        printf("lcore %u: received %" PRIu64 " frames, published %" PRIu64 ", stole %" PRIu64 ", sent %" PRIu64 " out of order",
+               self->lcore_id, self->received_frames, self->published_frames, self->stolen_frames, self->late_frames);
+        if (reorder_mode)
+            printf(", gave up on overdue frames %" PRIu64 " times", self->reorder_timeouts);
+        printf(".\n");
+        total_rx += self->received_frames;
+        total_stolen += self->stolen_frames;
+        total_late += self->late_frames;
+        max_rx = RTE_MAX(max_rx, self->received_frames);
+    }
+    if (total_rx == 0)
+        return;
+    printf("work stealing: %.1f%% of the frames were stolen, %.2f%% sent out of order, the busiest lcore received %.2fx the mean.\n",
+           100.0 * total_stolen / total_rx, 100.0 * total_late / total_rx, (double)max_rx * nb_states / total_rx);
+}
+
+void steal_state_init(steal_state_ptr self)
+{
+    memset(self, 0, sizeof(steal_state));
+    self->last_sent_seqn = UINT32_MAX;
+}
+
+/**
+ * self function gives the thread the ring it publishes its surplus frames to
+ * and, with '--steal-reorder', the ring the thieves return them over and the
+ * buffer restoring their order, all named after 'name'. Returns false on error.
+*/
+bool steal_state_create(steal_state_ptr self, const char *name, unsigned int lcore_id, dpdk_queue q_id)
+{
+    int socket_id = (int)rte_lcore_to_socket_id(lcore_id);
+    char ring_name[RTE_RING_NAMESIZE];
+    self->lcore_id = lcore_id;
+    self->q_id = q_id;
+    // Only the owner publishes, but the owner and all thieves take.
+    if ((self->steal_ring = rte_ring_create(name, STEAL_RING_SIZE, socket_id, RING_F_SP_ENQ)) == NULL)
+    {
+        printf("could not create the work stealing ring %s: %s\n", name, rte_strerror(rte_errno));
+        return false;
+    }
+    if (reorder_mode)
+    {
+        snprintf(ring_name, sizeof(ring_name), "%s_ret", name);
+        if ((self->return_ring = rte_ring_create(ring_name, STEAL_RETURN_RING_SIZE, socket_id, RING_F_SC_DEQ)) == NULL)
+        {
+            printf("could not create the work stealing ring %s: %s\n", ring_name, rte_strerror(rte_errno));
+            return false;
+        }
+        snprintf(ring_name, sizeof(ring_name), "%s_reorder", name);
+        if ((self->reorder_buf = rte_reorder_create(ring_name, socket_id, reorder_size)) == NULL ||
+            (self->reorder_marker = (struct rte_mbuf *)rte_zmalloc_socket(ring_name, sizeof(struct rte_mbuf), RTE_CACHE_LINE_SIZE, socket_id)) == NULL)
+        {
+            printf("could not create the reorder buffer %s: %s\n", ring_name, rte_strerror(rte_errno));
+            return false;
+        }
+    }
+    self->idx = nb_states;
+    states[nb_states++] = self;
+    return true;
+}
+
+void steal_state_finalize(steal_state_ptr self)
+{
+    // Frees the frames that are still waiting for their predecessors as well.
+    rte_reorder_free(self->reorder_buf);
+    rte_free(self->reorder_marker);
+    rte_ring_free(self->return_ring);
+    rte_ring_free(self->steal_ring);
+    steal_state_init(self);
+}
+
+/**
+ * self function returns the frames the rings and the reorder buffer of the
+ * thread can hold at most.
+*/
+uint32_t steal_reserved_mbufs(steal_state_ptr self)
+{
+    uint32_t nb_bufs = 0;
+    if (self->steal_ring != NULL)
+        nb_bufs += rte_ring_get_size(self->steal_ring);
+    if (self->return_ring != NULL)
+        nb_bufs += rte_ring_get_size(self->return_ring);
+    if (self->reorder_buf != NULL)
+        nb_bufs += reorder_size;
+    return nb_bufs;
+}
+
+/**
+ * self function numbers the frames the thread received from an interface. If
+ * the burst is full ('burst_size'), the queue is backlogged: the last half of
+ * the frames is published for idle threads to steal. Returns the number of
+ * frames left at the front of 'bufs' for the thread to process itself.
+*/
+uint16_t steal_publish(steal_state_ptr self, struct rte_mbuf *bufs[], uint16_t nb_bufs, uint16_t burst_size)
+{
+    uint16_t i, nb_published = 0;
+    for (i = 0; i < nb_bufs; i++)
+        bufs[i]->seqn = self->next_seqn++;
+    self->received_frames += nb_bufs;
+    if (nb_bufs == burst_size)
+    {
+        // This thread is the only producer, so all of them fit.
+        unsigned int room = rte_ring_free_count(self->steal_ring);
+        // Thieves must be able to return every frame, within the reorder window.
+        if (reorder_mode)
+        {
+            unsigned int max_outstanding = RTE_MIN((unsigned int)STEAL_RETURN_RING_SIZE - 1, reorder_size / 2);
+            room = RTE_MIN(room, max_outstanding - (unsigned int)(self->published_frames - self->settled_frames));
+        }
+        nb_published = (uint16_t)RTE_MIN((unsigned int)nb_bufs / 2, room);
+        rte_ring_sp_enqueue_burst(self->steal_ring, (void **)(bufs + nb_bufs - nb_published), nb_published, NULL);
+        self->published_frames += nb_published;
+    }
+    return nb_bufs - nb_published;
+}
+
+/**
+ * self function takes back published frames of the thread that nobody stole,
+ * for the thread to process itself.
+*/
+uint16_t steal_reclaim(steal_state_ptr self, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    uint16_t rx = (uint16_t)rte_ring_mc_dequeue_burst(self->steal_ring, (void **)bufs, nb_bufs, NULL);
+    self->settled_frames += rx;
+    return rx;
+}
+
+/**
+ * self function steals a burst of published frames from the next thread that
+ * has any, starting after this thread, and sets 'victim' to it. Returns the
+ * number of stolen frames.
+*/
+uint16_t steal_take(steal_state_ptr self, struct rte_mbuf *bufs[], uint16_t nb_bufs, steal_state_ptr *victim)
+{
+    unsigned int i;
+    for (i = 1; i < nb_states; i++)
+    {
+        steal_state_ptr other = states[(self->idx + i) % nb_states];
+        if (rte_ring_empty(other->steal_ring))
+            continue;
+        uint16_t rx = (uint16_t)rte_ring_mc_dequeue_burst(other->steal_ring, (void **)bufs, nb_bufs, NULL);
+        if (rx == 0)
+            continue;
+        self->stolen_frames += rx;
+        *victim = other;
+        return rx;
+    }
+    return 0;
+}
+
+/**
+ * self function counts the frames of 'origin' that leave an lcore behind a
+ * newer frame of 'origin', i.e. the frames work stealing put out of order.
+*/
+void steal_count_late_frames(steal_state_ptr self, steal_state_ptr origin, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    uint32_t last = origin->last_sent_seqn, newest = last;
+    uint16_t i;
+    for (i = 0; i < nb_bufs; i++)
+    {
+        if ((int32_t)(bufs[i]->seqn - newest) < 0)
+            self->late_frames++;
+        else
+            newest = bufs[i]->seqn;
+    }
+    // Several thieves of the same thread might race here, keep the newest.
+    while ((int32_t)(newest - last) > 0 && !__sync_bool_compare_and_swap(&origin->last_sent_seqn, last, newest))
+        last = origin->last_sent_seqn;
+}
+
+/**
+ * self function puts processed frames of this thread back into the order they
+ * were received in and transmits all frames whose predecessors are done.
+*/
+static void reorder_frames(steal_state_ptr self, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    struct rte_mbuf *ready[STEAL_MAX_BURST];
+    uint16_t i, nb_ready = 0, nb_drained;
+    bool progress = false;
+    for (i = 0; i < nb_bufs; i++)
+    {
+        // Frames far outside of the reorder window are sent as they are.
+        if (rte_reorder_insert(self->reorder_buf, bufs[i]) == 0)
+            self->reorder_pending++;
+        else
+            ready[nb_ready++] = bufs[i];
+    }
+    steal_count_late_frames(self, self, ready, nb_ready);
+    transmit_frames(self->q_id, ready, nb_ready);
+    while ((nb_drained = (uint16_t)rte_reorder_drain(self->reorder_buf, ready, STEAL_MAX_BURST)) > 0)
+    {
+        // Markers only moved the window on, they are no frames.
+        for (i = 0, nb_ready = 0; i < nb_drained; i++)
+        {
+            if (ready[i] != self->reorder_marker)
+                ready[nb_ready++] = ready[i];
+        }
+        self->reorder_pending -= nb_ready;
+        steal_count_late_frames(self, self, ready, nb_ready);
+        transmit_frames(self->q_id, ready, nb_ready);
+        progress = true;
+    }
+    if (progress || self->reorder_pending == 0)
+        self->reorder_progress_tsc = rte_rdtsc();
+}
+
+/**
+ * self function stops waiting for overdue frames: a marker one window ahead of
+ * the next sequence number makes the reorder buffer skip its gaps and release
+ * all frames it holds. Overdue frames are sent as they come in later.
+*/
+static void skip_overdue_frames(steal_state_ptr self)
+{
+    struct rte_mbuf *marker = self->reorder_marker;
+    // Whoever frees the marker, it never goes back to a pool.
+    rte_mbuf_refcnt_set(marker, UINT16_MAX);
+    marker->seqn = self->next_seqn + reorder_size - 1;
+    if (rte_reorder_insert(self->reorder_buf, marker) == 0)
+        self->reorder_timeouts++;
+    reorder_frames(self, NULL, 0);
+}
+
+/**
+ * self function holds a reference to every frame before it is processed with
+ * '--steal-reorder', so that the dropped ones can keep their place in the order.
+*/
+void steal_hold_frames(struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    uint16_t i;
+    for (i = 0; i < nb_bufs; i++)
+        rte_mbuf_refcnt_update(bufs[i], 1);
+}
+
+/**
+ * self function takes the frames of 'origin' the thread processed with
+ * '--steal-reorder' (and held before) on to their transmission: the dropped
+ * ones are tagged 'STEAL_DROPPED_PORT', then the frames are reordered if they
+ * are the thread's own, or go back to 'origin', which transmits them in the
+ * order it received them.
+*/
+void steal_settle_frames(steal_state_ptr self, steal_state_ptr origin, struct rte_mbuf *bufs[], uint16_t nb_bufs)
+{
+    uint16_t i;
+    for (i = 0; i < nb_bufs; i++)
+    {
+        if (rte_mbuf_refcnt_read(bufs[i]) == 1)
+        {
+            // Only the first segment was held, the others are gone.
+            bufs[i]->next = NULL;
+            bufs[i]->nb_segs = 1;
+            bufs[i]->port = STEAL_DROPPED_PORT;
+        }
+        else
+        {
+            rte_mbuf_refcnt_update(bufs[i], -1);
+        }
+    }
+    if (origin == self)
+    {
+        reorder_frames(self, bufs, nb_bufs);
+        return;
+    }
+    // The owner bounds its published frames so that they always fit, but never leak frames.
+    unsigned int sent = rte_ring_mp_enqueue_burst(origin->return_ring, (void **)bufs, nb_bufs, NULL);
+    for (; sent < nb_bufs; sent++)
+        rte_pktmbuf_free(bufs[sent]);
+}
+
+/**
+ * self function reorders the frames the thieves returned to the thread.
+ * Returns the number of returned frames.
+*/
+uint16_t steal_reorder_returned(steal_state_ptr self)
+{
+    struct rte_mbuf *bufs[STEAL_MAX_BURST];
+    if (self->return_ring == NULL)
+        return 0;
+    uint16_t returned = (uint16_t)rte_ring_sc_dequeue_burst(self->return_ring, (void **)bufs, STEAL_MAX_BURST, NULL);
+    self->settled_frames += returned;
+    if (returned > 0)
+        reorder_frames(self, bufs, returned);
+    // Do not hold back the frames behind a gap forever.
+    else if (self->reorder_pending > 0 && rte_rdtsc() - self->reorder_progress_tsc > reorder_timeout_cycles)
+        skip_overdue_frames(self);
+    return returned;
+}
+
+/**
+ * self function transmits the frames the reorder buffer of the thread still
+ * holds, once everything came back: it does not wait for frames that were
+ * sent early.
+*/
+void steal_flush(steal_state_ptr self)
+{
+    if (self->reorder_pending > 0)
+        skip_overdue_frames(self);
+}
@@ -0,0 +1,76 @@
+#ifndef STEAL_H__
+#define STEAL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <rte_config.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_reorder.h>
+
+#include "utils/utils.h"
+
+// Maximum number of frames handed to the functions below at once.
+#define STEAL_MAX_BURST 32
+// Egress interface of a frame that was dropped while it was processed, so that
+// it only fills its place in the reorder buffer.
+#define STEAL_DROPPED_PORT UINT16_MAX
+
+// Transmits a burst of processed frames, each tagged with its egress interface
+// in 'port' (or 'STEAL_DROPPED_PORT'), on the tx queue 'q_id'.
+typedef void (*steal_transmit_fn)(dpdk_queue q_id, struct rte_mbuf *bufs[], uint16_t nb_bufs);
+
+typedef struct steal_state
+{
+    // Position among the threads that steal from each other, the lcore of the
+    // thread and the tx queue its reordered frames are transmitted on.
+    unsigned int idx;
+    unsigned int lcore_id;
+    dpdk_queue q_id;
+    // The ring this thread publishes its surplus frames to, the ring thieves
+    // return them to after processing and the buffer restoring their order
+    // ('--steal-reorder').
+    struct rte_ring *steal_ring;
+    struct rte_ring *return_ring;
+    struct rte_reorder_buffer *reorder_buf;
+    uint32_t next_seqn;
+    // Number of frames in the reorder buffer, when the buffer last released
+    // frames (tsc) and the marker used to skip over overdue frames.
+    uint32_t reorder_pending;
+    uint64_t reorder_progress_tsc;
+    struct rte_mbuf *reorder_marker;
+    // Frames this thread received, published, and how many of those it got back.
+    uint64_t received_frames;
+    uint64_t published_frames;
+    uint64_t settled_frames;
+    // Frames this thread stole from other threads.
+    uint64_t stolen_frames;
+    // Newest sequence number of this thread's frames that left an lcore, the
+    // frames this thread sent behind a newer frame of the same thread, and
+    // how often it stopped waiting for overdue frames.
+    volatile uint32_t last_sent_seqn;
+    uint64_t late_frames;
+    uint64_t reorder_timeouts;
+} steal_state, *steal_state_ptr;
+
+void steal_init(unsigned int nb_threads, bool reorder, unsigned int size, unsigned int timeout_us,
+                steal_transmit_fn transmit);
+void steal_stop();
+bool steal_running();
+void steal_print_stats();
+
+void steal_state_init(steal_state_ptr self);
+bool steal_state_create(steal_state_ptr self, const char *name, unsigned int lcore_id, dpdk_queue q_id);
+void steal_state_finalize(steal_state_ptr self);
+uint32_t steal_reserved_mbufs(steal_state_ptr self);
+uint16_t steal_publish(steal_state_ptr self, struct rte_mbuf *bufs[], uint16_t nb_bufs, uint16_t burst_size);
+uint16_t steal_reclaim(steal_state_ptr self, struct rte_mbuf *bufs[], uint16_t nb_bufs);
+uint16_t steal_take(steal_state_ptr self, struct rte_mbuf *bufs[], uint16_t nb_bufs, steal_state_ptr *victim);
+void steal_count_late_frames(steal_state_ptr self, steal_state_ptr origin, struct rte_mbuf *bufs[], uint16_t nb_bufs);
+void steal_hold_frames(struct rte_mbuf *bufs[], uint16_t nb_bufs);
+void steal_settle_frames(steal_state_ptr self, steal_state_ptr origin, struct rte_mbuf *bufs[], uint16_t nb_bufs);
+uint16_t steal_reorder_returned(steal_state_ptr self);
+void steal_flush(steal_state_ptr self);
+
+#endif
@@ -4,6 +4,8 @@ extern "C"
 {
 #include "../router.h"
 #include "../routing_table.h"
+#include "../acl.h"
+#include <rte_icmp.h>
 }
 
 #include <ctype.h>
@@ -55,6 +57,209 @@ TEST(VERY_SIMPLE_TEST, SIMPLE_ADDRESSES)
 	EXPECT_EQ(NULL, get_next_hop(IPv4(10, 0, 11, 0)));
 }
 
+TEST(VERY_SIMPLE_TEST, L2_TEMPLATE)
+{
+	struct ether_addr src_mac = {{0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0x01}};
+	set_port_mac(2, &src_mac);
+	add_route(IPv4(10, 0, 20, 0), 24, &port_id_to_mac[7], 2);
+	build_routing_table();
+
+	struct routing_table_entry *info = get_next_hop(IPv4(10, 0, 20, 1));
+	ASSERT_TRUE(info != NULL);
+	EXPECT_EQ(0, (uintptr_t)info % RTE_CACHE_LINE_SIZE);
+
+	struct
+	{
+		struct ether_hdr eth;
+		uint16_t next;
+	} frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.next = 0x4545;
+	l2_template_apply(info, &frame.eth);
+	EXPECT_EQ(0, memcmp(&frame.eth.d_addr, &port_id_to_mac[7], sizeof(struct ether_addr)));
+	EXPECT_EQ(0, memcmp(&frame.eth.s_addr, &src_mac, sizeof(struct ether_addr)));
+	EXPECT_EQ(rte_cpu_to_be_16(ETHER_TYPE_IPv4), frame.eth.ether_type);
+	EXPECT_EQ(0x4545, frame.next);
+
+	// A MAC change of the egress port must be visible without rebuilding the table.
+	src_mac.addr_bytes[5] = 0x02;
+	set_port_mac(2, &src_mac);
+	l2_template_apply(info, &frame.eth);
+	EXPECT_EQ(0, memcmp(&frame.eth.s_addr, &src_mac, sizeof(struct ether_addr)));
+}
+
+TEST(VERY_SIMPLE_TEST, GATEWAY_ROUTE)
+{
+	add_route(IPv4(10, 0, 20, 0), 24, &port_id_to_mac[7], 2);
+	add_gateway_route(IPv4(10, 0, 30, 0), 24, IPv4(10, 0, 20, 254), 2);
+	build_routing_table();
+
+	struct routing_table_entry *info = get_next_hop(IPv4(10, 0, 30, 1));
+	ASSERT_TRUE(info != NULL);
+	EXPECT_EQ(2, info->dst_port);
+	EXPECT_FALSE(info->resolved);
+
+	// Resolving the gateway completes the adjacency without rebuilding the table.
+	set_gateway_mac(IPv4(10, 0, 20, 254), &port_id_to_mac[9]);
+	EXPECT_TRUE(info->resolved);
+	struct
+	{
+		struct ether_hdr eth;
+		uint16_t next;
+	} frame;
+	memset(&frame, 0, sizeof(frame));
+	l2_template_apply(info, &frame.eth);
+	EXPECT_EQ(0, memcmp(&frame.eth.d_addr, &port_id_to_mac[9], sizeof(struct ether_addr)));
+
+	clear_gateway_mac(IPv4(10, 0, 20, 254));
+	EXPECT_FALSE(info->resolved);
+	// Routes with a MAC address are not affected.
+	EXPECT_TRUE(get_next_hop(IPv4(10, 0, 20, 1))->resolved);
+}
+
+// 0x0000 and 0xffff are the same checksum in one's complement.
+static uint16_t cksum_value(uint16_t cksum)
+{
+	return cksum == 0xffff ? 0 : cksum;
+}
+
+TEST(CKSUM_TEST, IPV4_TTL_PROTO_WORD)
+{
+	struct ipv4_hdr hdr;
+	int old_ffff = 0, new_ffff = 0;
+	for (uint32_t id = 0; id <= UINT16_MAX; ++id)
+	{
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.version_ihl = 0x45;
+		hdr.total_length = rte_cpu_to_be_16(84);
+		hdr.packet_id = rte_cpu_to_be_16((uint16_t)id);
+		hdr.time_to_live = 17;
+		hdr.next_proto_id = IPPROTO_UDP;
+		hdr.src_addr = rte_cpu_to_be_32(IPv4(10, 0, 0, 2));
+		hdr.dst_addr = rte_cpu_to_be_32(IPv4(10, 2, 0, 5));
+		hdr.hdr_checksum = rte_ipv4_cksum(&hdr);
+		old_ffff += hdr.hdr_checksum == 0xffff;
+
+		// Patch the word the TTL shares with the protocol, like an echo reply does.
+		uint16_t cksum = update_cksum(hdr.hdr_checksum, rte_cpu_to_be_16(17 << 8 | IPPROTO_UDP),
+									  rte_cpu_to_be_16(64 << 8 | IPPROTO_ICMP));
+		hdr.time_to_live = 64;
+		hdr.next_proto_id = IPPROTO_ICMP;
+		hdr.hdr_checksum = 0;
+		uint16_t expected = rte_ipv4_cksum(&hdr);
+		new_ffff += expected == 0xffff;
+		ASSERT_EQ(cksum_value(expected), cksum_value(cksum)) << "packet id " << id;
+		// The patched header must verify.
+		hdr.hdr_checksum = cksum;
+		ASSERT_EQ(0xffff, rte_raw_cksum(&hdr, sizeof(hdr))) << "packet id " << id;
+	}
+	// Both edge cases were hit: a header summing to 0xffff before and after the patch.
+	EXPECT_GT(old_ffff, 0);
+	EXPECT_GT(new_ffff, 0);
+}
+
+TEST(CKSUM_TEST, ICMP_TYPE_WORD)
+{
+	struct
+	{
+		struct icmp_hdr icmp;
+		uint32_t payload;
+	} __attribute__((packed)) msg;
+	int old_zero = 0, new_zero = 0;
+	for (uint32_t ident = 0; ident <= UINT16_MAX; ++ident)
+	{
+		memset(&msg, 0, sizeof(msg));
+		msg.icmp.icmp_type = IP_ICMP_ECHO_REQUEST;
+		msg.icmp.icmp_ident = rte_cpu_to_be_16((uint16_t)ident);
+		msg.icmp.icmp_seq_nb = rte_cpu_to_be_16(1);
+		msg.payload = 0xdeadbeef;
+		msg.icmp.icmp_cksum = (uint16_t)~rte_raw_cksum(&msg, sizeof(msg));
+		uint16_t old_cksum = msg.icmp.icmp_cksum;
+		old_zero += old_cksum == 0;
+
+		// Patch the word the type shares with the code.
+		uint16_t cksum = update_cksum(old_cksum, rte_cpu_to_be_16(IP_ICMP_ECHO_REQUEST << 8),
+									  rte_cpu_to_be_16(IP_ICMP_ECHO_REPLY << 8));
+		msg.icmp.icmp_type = IP_ICMP_ECHO_REPLY;
+		msg.icmp.icmp_cksum = 0;
+		uint16_t expected = (uint16_t)~rte_raw_cksum(&msg, sizeof(msg));
+		new_zero += expected == 0;
+		ASSERT_EQ(cksum_value(expected), cksum_value(cksum)) << "ident " << ident;
+		// A sender may have written the zero checksum as 0xffff.
+		if (old_cksum == 0)
+		{
+			uint16_t from_ffff = update_cksum(0xffff, rte_cpu_to_be_16(IP_ICMP_ECHO_REQUEST << 8),
+											  rte_cpu_to_be_16(IP_ICMP_ECHO_REPLY << 8));
+			ASSERT_EQ(cksum_value(cksum), cksum_value(from_ffff)) << "ident " << ident;
+		}
+		msg.icmp.icmp_cksum = cksum;
+		ASSERT_EQ(0xffff, rte_raw_cksum(&msg, sizeof(msg))) << "ident " << ident;
+	}
+	EXPECT_GT(old_zero, 0);
+	EXPECT_GT(new_zero, 0);
+}
+
+struct acl_rule_case
+{
+	const char *line;
+	bool valid;
+	uint32_t src_addr, src_depth, dst_addr, dst_depth;
+	uint8_t proto, proto_mask;
+	uint16_t src_low, src_high, dst_low, dst_high;
+};
+
+// The fields of a rule that must be rejected are not checked.
+#define ACL_INVALID false, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+
+TEST(ACL_TEST, PARSE_RULE)
+{
+	const struct acl_rule_case cases[] = {
+		{"permit any any", true, 0, 0, 0, 0, 0, 0, 0, UINT16_MAX, 0, UINT16_MAX},
+		{"deny 10.0.0.1 any", true, IPv4(10, 0, 0, 1), 32, 0, 0, 0, 0, 0, UINT16_MAX, 0, UINT16_MAX},
+		{"permit 0.0.0.0/0 10.1.2.3/32 tcp", true, 0, 0, IPv4(10, 1, 2, 3), 32, IPPROTO_TCP, UINT8_MAX, 0, UINT16_MAX, 0, UINT16_MAX},
+		{"deny\t10.0.0.0/8  any udp 53 1024-65535", true, IPv4(10, 0, 0, 0), 8, 0, 0, IPPROTO_UDP, UINT8_MAX, 53, 53, 1024, UINT16_MAX},
+		{"permit any any 132 any 7-7", true, 0, 0, 0, 0, IPPROTO_SCTP, UINT8_MAX, 0, UINT16_MAX, 7, 7},
+		{"permit any any icmp", true, 0, 0, 0, 0, IPPROTO_ICMP, UINT8_MAX, 0, UINT16_MAX, 0, UINT16_MAX},
+		// Invalid prefixes.
+		{"permit 10.0.0.0/33 any", ACL_INVALID},
+		{"permit 10.0.0.0/ any", ACL_INVALID},
+		{"permit 10.0.0.256 any", ACL_INVALID},
+		// A port range with low greater than high, or beyond 16 bits.
+		{"permit any any udp 1000-20", ACL_INVALID},
+		{"permit any any tcp any 65536", ACL_INVALID},
+		{"permit any any tcp 1-", ACL_INVALID},
+		// Ports without TCP, UDP or SCTP.
+		{"permit any any icmp 53", ACL_INVALID},
+		{"permit any any any any 53", ACL_INVALID},
+		// Too many or too few fields, or an unknown action.
+		{"permit any any tcp any any any", ACL_INVALID},
+		{"permit any", ACL_INVALID},
+		{"allow any any", ACL_INVALID},
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+	{
+		const struct acl_rule_case *c = &cases[i];
+		char line[MAX_STR_LEN];
+		struct acl_rule rule;
+		uint8_t action;
+		snprintf(line, sizeof(line), "%s", c->line);
+		ASSERT_EQ(c->valid, acl_parse_rule(line, &rule, &action)) << c->line;
+		if (!c->valid)
+			continue;
+		EXPECT_EQ(c->line[0] == 'p' ? ACL_ACTION_PERMIT : ACL_ACTION_DENY, action) << c->line;
+		EXPECT_EQ(c->src_addr, rule.field[ACL_FIELD_SRC].value.u32) << c->line;
+		EXPECT_EQ(c->src_depth, rule.field[ACL_FIELD_SRC].mask_range.u32) << c->line;
+		EXPECT_EQ(c->dst_addr, rule.field[ACL_FIELD_DST].value.u32) << c->line;
+		EXPECT_EQ(c->dst_depth, rule.field[ACL_FIELD_DST].mask_range.u32) << c->line;
+		EXPECT_EQ(c->proto, rule.field[ACL_FIELD_PROTO].value.u8) << c->line;
+		EXPECT_EQ(c->proto_mask, rule.field[ACL_FIELD_PROTO].mask_range.u8) << c->line;
+		EXPECT_EQ(c->src_low, rule.field[ACL_FIELD_SRC_PORT].value.u16) << c->line;
+		EXPECT_EQ(c->src_high, rule.field[ACL_FIELD_SRC_PORT].mask_range.u16) << c->line;
+		EXPECT_EQ(c->dst_low, rule.field[ACL_FIELD_DST_PORT].value.u16) << c->line;
+		EXPECT_EQ(c->dst_high, rule.field[ACL_FIELD_DST_PORT].mask_range.u16) << c->line;
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	::testing::InitGoogleTest(&argc, argv);
@@ -165,3 +165,31 @@ int mac_addr_from_str(char *addr_str, ether_addr *mac)
     mac->addr_bytes[group_idx] = (uint8_t)group_val;
     return 0;
 }
+
+/**
+ * This function moves the frames whose key equals the key of the first frame
+ * to the front of 'bufs' (and 'keys'), keeping the order of all frames with
+ * the same key. Returns the number of moved frames.
+*/
+uint16_t group_frames_by_key(struct rte_mbuf *bufs[], uint16_t keys[], uint16_t nb_bufs)
+{
+    struct rte_mbuf *rest_bufs[nb_bufs];
+    uint16_t rest_keys[nb_bufs];
+    uint16_t i, nb_match = 0, nb_rest = 0, key = keys[0];
+    for (i = 0; i < nb_bufs; i++)
+    {
+        if (keys[i] == key)
+        {
+            bufs[nb_match] = bufs[i];
+            keys[nb_match++] = key;
+        }
+        else
+        {
+            rest_bufs[nb_rest] = bufs[i];
+            rest_keys[nb_rest++] = keys[i];
+        }
+    }
+    memcpy(bufs + nb_match, rest_bufs, nb_rest * sizeof(bufs[0]));
+    memcpy(keys + nb_match, rest_keys, nb_rest * sizeof(keys[0]));
+    return nb_match;
+}
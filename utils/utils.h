@@ -25,6 +25,8 @@
 #define IPV4_MAX_GROUP_VAL 0xff
 #define DPDK_MIN_INTERFACE_VAL 0x00
 #define DPDK_MAX_INTERFACE_VAL 0xff
+#define VLAN_MIN_ID 1
+#define VLAN_MAX_ID 4094
 #define IPV4_MIN_CIDR_VAL 0
 #define IPV4_MAX_CIDR_VAL 32
 
@@ -44,6 +46,7 @@ typedef uint8_t dpdk_interface;
 typedef uint16_t dpdk_queue;
 typedef uint32_t ipv4_addr;
 typedef struct ether_addr ether_addr;
+struct rte_mbuf;
 typedef void *generic_ptr;
 typedef void (*printer_fn)(const generic_ptr);
 
@@ -53,5 +56,16 @@ bool are_all_char_hexadecimal(const char *str);
 int32_t ipv4_group_val_from_group_str(const char *group_str, int group_idx);
 int ipv4_addr_from_str(char *addr_str, ipv4_addr *addr);
 int mac_addr_from_str(char *addr_str, ether_addr *mac);
+uint16_t group_frames_by_key(struct rte_mbuf *bufs[], uint16_t keys[], uint16_t nb_bufs);
+
+// Updates an internet checksum for a 16-bit word of the checked data that changed
+// from 'old_word' to 'new_word' (as they are in memory), see https://tools.ietf.org/html/rfc1624 .
+static inline uint16_t update_cksum(uint16_t cksum, uint16_t old_word, uint16_t new_word)
+{
+    uint32_t sum = (uint32_t)(uint16_t)~cksum + (uint16_t)~old_word + new_word;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
 
 #endif
\ No newline at end of file